@@ -0,0 +1,348 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "asyncIo.h"
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+// the ring is driven with the raw system calls, liburing is not required
+static int uringSetup(unsigned entries, io_uring_params* params)
+{
+  return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+  return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static unsigned loadAcquire(const unsigned* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void storeRelease(unsigned* p, unsigned value)
+{
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+
+AsyncIo::AsyncIo(const std::uint32_t queueDepth, const std::uint32_t threads, const bool useUring)
+	: pendingCount(0), nextTicket(1), ringFd(-1),
+	  sqRing(MAP_FAILED), sqRingBytes(0), cqRing(MAP_FAILED), cqRingBytes(0), sqes(NULL), sqesBytes(0),
+	  sqPending(0), inPool(0), poolRunning(true)
+{
+  if (useUring)
+    setupRing(queueDepth);
+
+  std::uint32_t numThreads = threads > 0 ? threads : 1;
+  for (std::uint32_t i = 0; i < numThreads; i++)
+    workers.push_back(std::thread(&AsyncIo::poolLoop, this));
+}
+
+AsyncIo::~AsyncIo()
+{
+  // requests in flight still write into their pages, so wait for them
+  std::vector<IoCompletion> done;
+  queued.clear();
+  pendingCount = inRing.size() + inPool;
+  while (pendingCount > 0)
+    complete(done, 1);
+
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    poolRunning = false;
+  }
+  poolWork.notify_all();
+  for (std::size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  if (ringFd >= 0)
+  {
+    munmap(sqes, sqesBytes);
+    if (cqRing != sqRing)
+      munmap(cqRing, cqRingBytes);
+    munmap(sqRing, sqRingBytes);
+    close(ringFd);
+  }
+}
+
+bool AsyncIo::setupRing(const std::uint32_t queueDepth)
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  int fd = uringSetup(queueDepth > 0 ? queueDepth : 1, &params);
+  if (fd < 0)
+    return false;
+
+  sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMap)
+    sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+  sqRing = mmap(NULL, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+  {
+    close(fd);
+    return false;
+  }
+  cqRing = singleMap ? sqRing
+    : mmap(NULL, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqeMap = mmap(NULL, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (cqRing == MAP_FAILED || sqeMap == MAP_FAILED)
+  {
+    if (sqeMap != MAP_FAILED)
+      munmap(sqeMap, sqesBytes);
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+      munmap(cqRing, cqRingBytes);
+    munmap(sqRing, sqRingBytes);
+    close(fd);
+    return false;
+  }
+
+  char* sq = static_cast<char*>(sqRing);
+  char* cq = static_cast<char*>(cqRing);
+  sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sqEntries = params.sq_entries;
+  cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  sqes = static_cast<io_uring_sqe*>(sqeMap);
+  ringFd = fd;
+  return true;
+}
+
+
+std::uint64_t AsyncIo::submitRead(File* file, const PageId pageNo, Page& page)
+{
+  return enqueue(IO_READ, file, pageNo, &page);
+}
+
+std::uint64_t AsyncIo::submitWrite(File* file, const PageId pageNo, const Page& page)
+{
+  return enqueue(IO_WRITE, file, pageNo, const_cast<Page*>(&page));
+}
+
+std::uint64_t AsyncIo::enqueue(IoOp op, File* file, const PageId pageNo, Page* page)
+{
+  Request request = {nextTicket++, op, file, pageNo, page};
+  queued.push_back(request);
+  pendingCount++;
+  return request.ticket;
+}
+
+void AsyncIo::submit()
+{
+  if (queued.empty() && sqPending == 0)
+    return;
+
+  std::vector<Request> later;
+  unsigned tail = ringFd >= 0 ? *sqTail : 0;
+  for (std::size_t i = 0; i < queued.size(); i++)
+  {
+    const Request& request = queued[i];
+    if (ringFd < 0 || !request.file->rawPages())
+    {
+      toPool(request);
+      continue;
+    }
+    // the ring is full; the rest goes in with a later call
+    if (inRing.size() >= sqEntries)
+    {
+      later.push_back(request);
+      continue;
+    }
+
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request.op == IO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = request.file->descriptor();
+    sqe->addr = reinterpret_cast<std::uint64_t>(request.page);
+    sqe->len = Page::SIZE;
+    sqe->off = request.file->pageOffset(request.pageNo);
+    sqe->user_data = request.ticket;
+    sqArray[index] = index;
+    tail++;
+    sqPending++;
+    inRing[request.ticket] = request;
+  }
+  queued.swap(later);
+
+  if (sqPending == 0)
+    return;
+  storeRelease(sqTail, tail);
+  // entries the kernel did not take yet stay in the ring for the next call
+  while (sqPending > 0)
+  {
+    int submitted = uringEnter(ringFd, sqPending, 0, 0);
+    if (submitted < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    sqPending -= submitted;
+  }
+}
+
+std::size_t AsyncIo::reapRing(std::vector<IoCompletion>& done)
+{
+  if (ringFd < 0)
+    return 0;
+
+  std::size_t count = 0;
+  unsigned head = *cqHead;
+  unsigned tail = loadAcquire(cqTail);
+  while (head != tail)
+  {
+    const io_uring_cqe& cqe = cqes[head & *cqMask];
+    std::map<std::uint64_t, Request>::iterator it = inRing.find(cqe.user_data);
+    head++;
+    if (it == inRing.end())
+      continue;
+    Request request = it->second;
+    inRing.erase(it);
+
+    if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP
+        || (cqe.res >= 0 && cqe.res < (int) Page::SIZE && request.op == IO_WRITE))
+    {
+      // operation unknown to this kernel, or a short write: redo it the regular way
+      toPool(request);
+      continue;
+    }
+
+    IoCompletion completion = {request.ticket, request.op, request.file, request.pageNo, true, ""};
+    if (cqe.res < 0)
+    {
+      completion.ok = false;
+      completion.error = std::strerror(-cqe.res);
+    }
+    else if (cqe.res < (int) Page::SIZE)
+    {
+      // past the end of the file, as File::readAt() does
+      std::memset(reinterpret_cast<char*>(request.page) + cqe.res, 0, Page::SIZE - cqe.res);
+    }
+    done.push_back(completion);
+    pendingCount--;
+    count++;
+  }
+  storeRelease(cqHead, head);
+  return count;
+}
+
+
+IoCompletion AsyncIo::run(const Request& request)
+{
+  IoCompletion completion = {request.ticket, request.op, request.file, request.pageNo, true, ""};
+  try
+  {
+    if (request.op == IO_READ)
+      request.file->readPageInto(request.pageNo, *request.page);
+    else
+      request.file->writePage(request.pageNo, *request.page);
+  }
+  catch (const BadgerDbException &e)
+  {
+    completion.ok = false;
+    completion.error = e.message();
+  }
+  return completion;
+}
+
+void AsyncIo::toPool(const Request& request)
+{
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    poolQueue.push_back(request);
+    inPool++;
+  }
+  poolWork.notify_one();
+}
+
+void AsyncIo::poolLoop()
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+  while (true)
+  {
+    if (poolQueue.empty())
+    {
+      if (!poolRunning)
+        return;
+      poolWork.wait(lock);
+      continue;
+    }
+
+    Request request = poolQueue.front();
+    poolQueue.pop_front();
+    lock.unlock();
+    IoCompletion completion = run(request);
+    lock.lock();
+    poolDone.push_back(completion);
+    poolFinished.notify_all();
+  }
+}
+
+std::size_t AsyncIo::reapPool(std::vector<IoCompletion>& done)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  std::size_t count = poolDone.size();
+  done.insert(done.end(), poolDone.begin(), poolDone.end());
+  poolDone.clear();
+  inPool -= count;
+  pendingCount -= count;
+  return count;
+}
+
+std::size_t AsyncIo::complete(std::vector<IoCompletion>& done, std::size_t minDone)
+{
+  if (minDone > pendingCount)
+    minDone = pendingCount;
+
+  std::size_t count = 0;
+  while (true)
+  {
+    submit();
+    count += reapRing(done);
+    count += reapPool(done);
+    if (count >= minDone)
+      return count;
+
+    if (!inRing.empty() && inPool == 0)
+    {
+      uringEnter(ringFd, sqPending, 1, IORING_ENTER_GETEVENTS);
+    }
+    else
+    {
+      // with requests in the ring as well, look at the ring again now and then
+      std::unique_lock<std::mutex> lock(poolMutex);
+      if (poolDone.empty())
+      {
+        if (inRing.empty())
+          poolFinished.wait(lock);
+        else
+          poolFinished.wait_for(lock, std::chrono::milliseconds(1));
+      }
+    }
+  }
+}
+
+}
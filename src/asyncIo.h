@@ -0,0 +1,286 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace badgerdb {
+
+/**
+ * @brief Kind of an asynchronous page request
+ */
+enum IoOp {
+  IO_READ,
+  IO_WRITE
+};
+
+/**
+ * @brief A finished asynchronous page request
+ */
+struct IoCompletion {
+  /**
+   * Ticket the request was given when it was queued
+   */
+  std::uint64_t ticket;
+
+  /**
+   * Kind of the request
+   */
+  IoOp op;
+
+  /**
+   * File and page of the request
+   */
+  File* file;
+  PageId pageNo;
+
+  /**
+   * True if the page was read or written
+   */
+  bool ok;
+
+  /**
+   * What went wrong if the request failed
+   */
+  std::string error;
+};
+
+/**
+ * @brief Asynchronous page I/O engine with a submission and a completion queue.
+ *
+ * Requests are queued with submitRead() and submitWrite() and handed over
+ * together by submit(), so that many reads and writes cost few system calls.
+ * When the kernel supports io_uring, requests on files whose pages are stored
+ * raw on disk (see File::rawPages()) go through a ring and a whole batch is
+ * submitted with a single io_uring_enter() call.  Other requests, and all
+ * requests when io_uring is not available, are run by a small pool of
+ * threads through the regular File interface.
+ *
+ * The engine is meant to be driven by one thread at a time.  Pages and files
+ * of a request must stay alive until its completion has been collected.
+ */
+class AsyncIo {
+ public:
+  /**
+   * Default number of requests in flight in the ring
+   */
+  static const std::uint32_t DEFAULT_QUEUE_DEPTH = 64;
+
+  /**
+   * Default number of threads of the fallback pool
+   */
+  static const std::uint32_t DEFAULT_THREADS = 4;
+
+  /**
+   * Sets up the engine, with a ring if the kernel supports it.
+   *
+   * @param queueDepth  Most requests in flight in the ring at once
+   * @param threads     Number of threads of the fallback pool
+   * @param useUring    False to run every request on the thread pool
+   */
+  explicit AsyncIo(const std::uint32_t queueDepth = DEFAULT_QUEUE_DEPTH,
+                   const std::uint32_t threads = DEFAULT_THREADS,
+                   const bool useUring = true);
+
+  /**
+   * Waits for the requests in flight and tears the engine down. Their
+   * completions are dropped.
+   */
+  ~AsyncIo();
+
+  /**
+   * Returns true if the engine could set up an io_uring ring
+   */
+  bool usesUring() const { return ringFd >= 0; }
+
+  /**
+   * Queues a read of the given page into the given page object.
+   *
+   * @return Ticket of the request
+   */
+  std::uint64_t submitRead(File* file, const PageId pageNo, Page& page);
+
+  /**
+   * Queues a write of the given page object to the given page.
+   *
+   * @return Ticket of the request
+   */
+  std::uint64_t submitWrite(File* file, const PageId pageNo, const Page& page);
+
+  /**
+   * Hands all queued requests over to the ring and the thread pool.
+   */
+  void submit();
+
+  /**
+   * Submits the queued requests and collects finished ones, waiting until at
+   * least the given number of them is available.
+   *
+   * @param done      Finished requests are appended to this
+   * @param minDone   Number of requests to wait for, at most the number pending
+   * @return Number of requests appended
+   */
+  std::size_t complete(std::vector<IoCompletion>& done, std::size_t minDone);
+
+  /**
+   * Returns the number of requests queued or in flight
+   */
+  std::size_t pending() const { return pendingCount; }
+
+ private:
+  AsyncIo(const AsyncIo&);
+  AsyncIo& operator=(const AsyncIo&);
+
+  /**
+   * A queued or running request
+   */
+  struct Request {
+    std::uint64_t ticket;
+    IoOp op;
+    File* file;
+    PageId pageNo;
+    Page* page;
+  };
+
+  /**
+   * Queues a request
+   */
+  std::uint64_t enqueue(IoOp op, File* file, const PageId pageNo, Page* page);
+
+  /**
+   * Runs a request through the File interface and returns its completion
+   */
+  static IoCompletion run(const Request& request);
+
+  /**
+   * Hands a request to the thread pool
+   */
+  void toPool(const Request& request);
+
+  /**
+   * Main loop of a pool thread
+   */
+  void poolLoop();
+
+  /**
+   * Maps the rings of a new io_uring instance, returning false if the kernel does not allow it
+   */
+  bool setupRing(const std::uint32_t queueDepth);
+
+  /**
+   * Moves finished ring requests into the given list, returning how many were moved
+   */
+  std::size_t reapRing(std::vector<IoCompletion>& done);
+
+  /**
+   * Moves finished pool requests into the given list, returning how many were moved
+   */
+  std::size_t reapPool(std::vector<IoCompletion>& done);
+
+  /**
+   * Requests queued by submitRead() and submitWrite() and not yet submitted
+   */
+  std::vector<Request> queued;
+
+  /**
+   * Number of requests queued or in flight
+   */
+  std::size_t pendingCount;
+
+  /**
+   * Next ticket to hand out
+   */
+  std::uint64_t nextTicket;
+
+  /**
+   * Descriptor of the ring, -1 without io_uring
+   */
+  int ringFd;
+
+  /**
+   * Mappings of the ring
+   */
+  void* sqRing;
+  std::size_t sqRingBytes;
+  void* cqRing;
+  std::size_t cqRingBytes;
+  io_uring_sqe* sqes;
+  std::size_t sqesBytes;
+
+  /**
+   * Fields of the submission and completion rings shared with the kernel
+   */
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned sqEntries;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  io_uring_cqe* cqes;
+
+  /**
+   * Number of entries placed in the submission ring that the kernel has not taken yet
+   */
+  unsigned sqPending;
+
+  /**
+   * Requests in flight in the ring, keyed by ticket
+   */
+  std::map<std::uint64_t, Request> inRing;
+
+  /**
+   * Pool threads
+   */
+  std::vector<std::thread> workers;
+
+  /**
+   * Requests waiting for a pool thread
+   */
+  std::deque<Request> poolQueue;
+
+  /**
+   * Requests finished by the pool and not yet collected
+   */
+  std::vector<IoCompletion> poolDone;
+
+  /**
+   * Number of requests handed to the pool and not yet collected
+   */
+  std::size_t inPool;
+
+  /**
+   * True until the pool threads are asked to stop
+   */
+  bool poolRunning;
+
+  /**
+   * Latch protecting the pool queues
+   */
+  std::mutex poolMutex;
+
+  /**
+   * Wakes pool threads up when requests are queued, and the engine when requests finish
+   */
+  std::condition_variable poolWork;
+  std::condition_variable poolFinished;
+};
+
+}
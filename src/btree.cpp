@@ -5,6 +5,7 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include "btree.h"
 #include "filescan.h"
 #include "exceptions/bad_index_info_exception.h"
@@ -30,14 +31,19 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		BufMgr *scanBufMgr,
+		Catalog *catalogIn)
 {
 	bufMgr = bufMgrIn;
+	catalog = catalogIn;
 	this->attrByteOffset = attrByteOffset;
 	attributeType = attrType;
 	leafOccupancy = INTARRAYLEAFSIZE;
 	nodeOccupancy = INTARRAYNONLEAFSIZE;
 	scanExecuting = false;
+	maxReadAhead = DEFAULT_READ_AHEAD;
+	readAheadWindow = 0;
 
 	///constructing the index name 
 	std::ostringstream idxStr;
@@ -49,24 +55,43 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 	Page* rootPage;
 	IndexMetaInfo* metadata;
 
-	///if the index file exists
-	try {
-
+	///if the index file exists, as the catalog or else the filesystem tells
+	file = NULL;
+	CatalogEntry entry;
+	bool cataloged = false;
+	if (catalog != NULL && catalog->lookup(outIndexName, entry)) {
+		if (entry.type != CATALOG_INDEX || entry.relation_name != relationName ||
+		    entry.attr_byte_offset != attrByteOffset || entry.attr_type != attrType) {
+			throw BadIndexInfoException("catalog entry of " + outIndexName + " does not match the index asked for");
+		}
+		try {
+			file = new BlobFile(outIndexName, false);
+			headerPageNum = entry.header_page;
+			cataloged = true;
+		}
+		catch (FileNotFoundException& e) {
+			//the file was removed without its entry; drop the entry and build the index anew
+			catalog->remove(outIndexName);
+		}
+	}
+	else if (File::exists(outIndexName)) {
 		file = new BlobFile(outIndexName, false);
-
 		//get the pid of the first page
 		headerPageNum = file->getFirstPageNo();
-		//read the header page and set metadataPage as a pointer to that page
-		bufMgr->readPage(file, headerPageNum, metadataPage);
-
-		metadata = (IndexMetaInfo*)metadataPage;
-		rootPageNum = metadata->rootPageNo;
+	}
 
-		bufMgr->unPinPage(file, headerPageNum, false);
+	if (file != NULL) {
+		//the metadata page has the final say on the root, the catalog may lag behind it after a crash
+		readMetadata(relationName, outIndexName);
+		if (!cataloged || entry.root_page != rootPageNum) {
+			recordInCatalog(relationName);
+		}
+		//the root only moves away from the page after the header page when it splits
+		rootIsLeaf = rootPageNum == headerPageNum + 1;
 	}
 
 	//if the index file does not exists, create a new one
-	catch (FileNotFoundException& e) {
+	else {
 		file = new BlobFile(outIndexName, true);
 
 		bufMgr->allocPage(file, headerPageNum, metadataPage);
@@ -90,8 +115,10 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		bufMgr->unPinPage(file, headerPageNum, true);
 		bufMgr->unPinPage(file, rootPageNum, true);
 
-		//create a new file scanner
-		FileScan fscan(relationName, bufMgr);
+		recordInCatalog(relationName);
+
+		//create a new file scanner, reading the relation through a bulk-read ring
+		FileScan fscan(relationName, scanBufMgr != NULL ? scanBufMgr : bufMgr, true /* bulkRead */);
 		try {
 			RecordId scanRid;
 			while (1) {
@@ -108,6 +135,51 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 }
 
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::readMetadata
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::readMetadata(const std::string & relationName, const std::string & indexName)
+{
+	//read the header page and take the root from it
+	Page* metadataPage;
+	bufMgr->readPage(file, headerPageNum, metadataPage);
+	IndexMetaInfo* metadata = (IndexMetaInfo*)metadataPage;
+	rootPageNum = metadata->rootPageNo;
+	const bool matches = strncmp(metadata->relationName, relationName.c_str(), 20) == 0 &&
+	                     metadata->attrByteOffset == attrByteOffset && metadata->attrType == attributeType;
+	bufMgr->unPinPage(file, headerPageNum, false);
+
+	//a file of that name which is not this index, e.g. left over from another run, is not scanned as one
+	if (!matches) {
+		bufMgr->flushFile(file);
+		delete file;
+		throw BadIndexInfoException("metadata of " + indexName + " does not match the index asked for");
+	}
+}
+
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::recordInCatalog
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::recordInCatalog(const std::string & relationName)
+{
+	if (catalog == NULL) {
+		return;
+	}
+	CatalogEntry entry;
+	entry.name = file->filename();
+	entry.type = CATALOG_INDEX;
+	entry.relation_name = relationName;
+	entry.attr_byte_offset = attrByteOffset;
+	entry.attr_type = attributeType;
+	entry.header_page = headerPageNum;
+	entry.root_page = rootPageNum;
+	catalog->put(entry);
+}
+
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::~BTreeIndex -- destructor
 // -----------------------------------------------------------------------------
@@ -120,6 +192,13 @@ BTreeIndex::~BTreeIndex()
 	}
 	/// flush and delete the object file
 	bufMgr->flushFile(file);
+
+	/// the root in the catalog only follows the metadata page once that is on disk
+	CatalogEntry entry;
+	if (catalog != NULL && catalog->lookup(file->filename(), entry) && entry.root_page != rootPageNum) {
+		entry.root_page = rootPageNum;
+		catalog->put(entry);
+	}
 	delete file;
 }
 
@@ -188,9 +267,10 @@ void BTreeIndex::insertEntryHelper(const int key,
 					PageId* newlyCreatedPageId,
 					bool isLeafBool) 
 {
-	// Read page, which is a node
-	Page *currNode;
-  	bufMgr->readPage(file, currPageId, currNode);
+	// Read page, which is a node; the guard unpins it on every way out. A leaf is always modified,
+	// an inner node only if its child splits
+	PageGuard currGuard = bufMgr->readPage(file, currPageId, isLeafBool ? GUARD_WRITE : GUARD_READ);
+	Page *currNode = currGuard.getPage();
 
   	// Base Case: current node is a leaf node
   	if (isLeafBool) {
@@ -209,7 +289,7 @@ void BTreeIndex::insertEntryHelper(const int key,
   		if (currLeafNode->ridArray[INTARRAYLEAFSIZE - 1].page_number == Page::INVALID_NUMBER) {
   		//if (currLeafNode->size < INTARRAYLEAFSIZE) {	
 			insertLeafNode(key, rid, currLeafNode, index);
-  			bufMgr->unPinPage(file, currPageId, true);
+  			currGuard.release(true);
   			*middleValueFromChild = 0;
   			*newlyCreatedPageId = 0;
   		} 
@@ -217,8 +297,8 @@ void BTreeIndex::insertEntryHelper(const int key,
   		else {
   			// Allocate a new page for the right split
   			PageId newPageId;
-  			Page* newNode;
-  			bufMgr->allocPage(file, newPageId, newNode);
+  			PageGuard newGuard = bufMgr->allocPage(file, newPageId);
+  			Page* newNode = newGuard.getPage();
   			memset(newNode, 0, Page::SIZE);
   			LeafNodeInt* newLeafNode = (LeafNodeInt *)newNode;
 
@@ -252,13 +332,13 @@ void BTreeIndex::insertEntryHelper(const int key,
 			newLeafNode->rightSibPageNo = currLeafNode->rightSibPageNo;
   			currLeafNode->rightSibPageNo = newPageId;
 
-  			// Unpin the nodes
-  			bufMgr->unPinPage(file, currPageId, true);
-  			bufMgr->unPinPage(file, newPageId, true);
-
   			// Return values using pointers
   			*middleValueFromChild = newLeafNode->keyArray[0];
   			*newlyCreatedPageId = newPageId;
+
+  			// Unpin the nodes
+  			currGuard.release(true);
+  			newGuard.release();
   		}
   	}
   	// Recursive Case: current node is not a leaf node
@@ -282,12 +362,14 @@ void BTreeIndex::insertEntryHelper(const int key,
 
 		// If there is no split in child node
 		if ((int) newChildId == 0) {
-		  bufMgr->unPinPage(file, currPageId, false);
+		  currGuard.release();
 		  *middleValueFromChild = 0;
 		  *newlyCreatedPageId = 0;
 		}
 		// If there is a split in child node
 		else {
+			currGuard.markDirty();
+
 	  		// Index of the new middle key from children to be inserted
 	  		int index = currNonLeafNode->size;
 	  		for(int i = 0; i < currNonLeafNode->size; i++) {
@@ -301,7 +383,7 @@ void BTreeIndex::insertEntryHelper(const int key,
   			if (currNonLeafNode->pageNoArray[INTARRAYNONLEAFSIZE] == Page::INVALID_NUMBER) {
   			//if (currNonLeafNode->size < INTARRAYNONLEAFSIZE) {
   				insertNonLeafNode(newChildMiddleKey, newChildId, currNonLeafNode, index);
-  				bufMgr->unPinPage(file, currPageId, true);
+  				currGuard.release(true);
 	  			*middleValueFromChild = 0;
 	  			*newlyCreatedPageId = 0;
   			}
@@ -309,8 +391,8 @@ void BTreeIndex::insertEntryHelper(const int key,
   			else {
 	  			// Allocate a new page for the right split
 	  			PageId newPageId;
-	  			Page* newNode;
-	  			bufMgr->allocPage(file, newPageId, newNode);
+	  			PageGuard newGuard = bufMgr->allocPage(file, newPageId);
+	  			Page* newNode = newGuard.getPage();
 	  			memset(newNode, 0, Page::SIZE);
 	  			NonLeafNodeInt* newNonLeafNode = (NonLeafNodeInt *)newNode;
 	  			newNonLeafNode->level = currNonLeafNode->level;
@@ -332,8 +414,8 @@ void BTreeIndex::insertEntryHelper(const int key,
 					newNonLeafNode->size = INTARRAYNONLEAFSIZE - mid;
 
 		  			// Unpin the nodes
-		  			bufMgr->unPinPage(file, currPageId, true);
-		  			bufMgr->unPinPage(file, newPageId, true);
+		  			currGuard.release(true);
+		  			newGuard.release();
 
 					// Return values using pointers
 		  			*middleValueFromChild = newChildMiddleKey;
@@ -370,8 +452,8 @@ void BTreeIndex::insertEntryHelper(const int key,
 					}
 
 		  			// Unpin the nodes
-		  			bufMgr->unPinPage(file, currPageId, true);
-		  			bufMgr->unPinPage(file, newPageId, true);
+		  			currGuard.release(true);
+		  			newGuard.release();
 	  			}
   			}
 		}
@@ -393,8 +475,8 @@ void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 	if ((int) newlyCreatedPageId != 0) {
 	  	// Allocate a new page for this new root
 	  	PageId newPageId;
-		Page* newPage;
-		bufMgr->allocPage(file, newPageId, newPage);
+		PageGuard newGuard = bufMgr->allocPage(file, newPageId);
+		Page* newPage = newGuard.getPage();
 		memset(newPage, 0, Page::SIZE);
 		NonLeafNodeInt* newRoot = (NonLeafNodeInt *)newPage;
 		
@@ -411,16 +493,91 @@ void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 		rootIsLeaf = false;
 
 		// Update global variable and IndexMetaInfo page appropriately
-		Page *meta;
-		bufMgr->readPage(file, headerPageNum, meta);
-		IndexMetaInfo *metadata = (IndexMetaInfo *)meta;
+		PageGuard metaGuard = bufMgr->readPage(file, headerPageNum, GUARD_WRITE);
+		IndexMetaInfo *metadata = (IndexMetaInfo *)metaGuard.getPage();
 		metadata->rootPageNo = newPageId;
 		rootPageNum = newPageId;
 
 		// Unpin the root and the IndexMetaInfo page
-		bufMgr->unPinPage(file, newPageId, true);
-		bufMgr->unPinPage(file, headerPageNum, true);
+		newGuard.release();
+		metaGuard.release();
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setReadAhead
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::setReadAhead(const std::uint32_t maxPages)
+{
+	maxReadAhead = maxPages;
+	readAheadWindow = std::min(readAheadWindow, maxReadAhead);
+}
+
+/**
+* Hand the next leaves of the scan to the prefetcher once half of the read-ahead window has been consumed,
+* and widen the window for the next round. Leaves come from the parent of the first leaf of the scan; past
+* them the scan follows the sibling chain one leaf ahead.
+*/
+void BTreeIndex::readAheadLeaves()
+{
+	if (maxReadAhead == 0 || leavesAhead > readAheadWindow / 2) {
+		return;
+	}
+
+	std::vector<PageId> pageIds;
+	while (leavesAhead < readAheadWindow && nextReadAheadLeaf < scanLeafPages.size()) {
+		if (scanLeafPages[nextReadAheadLeaf] != currentPageNum) {
+			pageIds.push_back(scanLeafPages[nextReadAheadLeaf]);
+			leavesAhead++;
+		}
+		nextReadAheadLeaf++;
 	}
+
+	LeafNodeInt *leaf = (LeafNodeInt *)currentPageData;
+	if (pageIds.empty() && leavesAhead == 0 && nextReadAheadLeaf >= scanLeafPages.size()
+			&& leaf->size > 0 && leaf->rightSibPageNo != Page::INVALID_NUMBER) {
+		int lastKey = leaf->keyArray[leaf->size - 1];
+		if ((highOp == LT && lastKey < highValInt) || (highOp == LTE && lastKey <= highValInt)) {
+			pageIds.push_back(leaf->rightSibPageNo);
+		}
+	}
+
+	bufMgr->prefetch(file, pageIds);
+
+	// range scans walk the leaves sequentially, keep widening the window up to the maximum
+	readAheadWindow = std::min(std::max(readAheadWindow * 2, (std::uint32_t) 2), maxReadAhead);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::descendInner
+// -----------------------------------------------------------------------------
+
+PageId BTreeIndex::descendInner(const NonLeafNodeInt *inner, bool &leafParent)
+{
+	//find next index of int larger than lower bound
+	int size = std::max(0, std::min(inner->size, INTARRAYNONLEAFSIZE));
+	int index = 0;
+	while (index < INTARRAYNONLEAFSIZE && inner->keyArray[index] < lowValInt ){
+		index ++; 
+	}
+
+	leafParent = (inner->level == 1);
+
+	//the leaves right of the first one are the candidates for read-ahead,
+	//as long as their smallest key can still be in range
+	scanLeafPages.clear();
+	if(leafParent) {
+		for(int i = index + 1; i <= size; i++) {
+			int lowestKey = inner->keyArray[i - 1];
+			if((highOp == LT && lowestKey >= highValInt) || (highOp == LTE && lowestKey > highValInt)){
+				break;
+			}
+			scanLeafPages.push_back(inner->pageNoArray[i]);
+		}
+	}
+
+	return inner->pageNoArray[index];
 }
 
 // -----------------------------------------------------------------------------
@@ -454,30 +611,41 @@ void BTreeIndex::startScan(const void* lowValParm,
 	}
 
 	currentPageNum = rootPageNum;
-	bufMgr->readPage(file, currentPageNum,currentPageData);
-	//find leaf node 
+	scanLeafPages.clear();
+	//find leaf node, reading the inner nodes without pinning them unless they change underneath
 	if(!rootIsLeaf) {
 		while (true){
-			NonLeafNodeInt *inner = (NonLeafNodeInt*) currentPageData;
-			bufMgr -> unPinPage(file, currentPageNum,false);
-
-			//find next index of int larger than lower bound
-			int index = 0;
-			while (index < INTARRAYNONLEAFSIZE && inner->keyArray[index] < lowValInt ){
-				index ++; 
+			bool leafParent = false;
+			PageId childPageNum = Page::INVALID_NUMBER;
+
+			OptimisticRead read;
+			bool validated = bufMgr->beginOptimisticRead(file, currentPageNum, read);
+			if(validated) {
+				childPageNum = descendInner((const NonLeafNodeInt*) read.page, leafParent);
+				validated = bufMgr->validateOptimisticRead(read);
 			}
 
-			currentPageNum = inner->pageNoArray[index];
+			//fall back to pinning the node if it is not resident or has been replaced meanwhile
+			if(!validated) {
+				PageGuard innerGuard = bufMgr->readPage(file, currentPageNum);
+				childPageNum = descendInner((const NonLeafNodeInt*) innerGuard.getPage(), leafParent);
+			}
 
-			if(inner->level == 1) {
-				bufMgr->readPage(file, currentPageNum, currentPageData);
+			currentPageNum = childPageNum;
+			if(leafParent) {
 				break;
 			}
-
-			bufMgr->readPage(file, currentPageNum, currentPageData);
 		}
 	}
 
+	currentPageGuard = bufMgr->readPage(file, currentPageNum);
+	currentPageData = currentPageGuard.getPage();
+
+	nextReadAheadLeaf = 0;
+	leavesAhead = 0;
+	readAheadWindow = std::min((std::uint32_t) 2, maxReadAhead);
+	readAheadLeaves();
+
 	//find first record that fits the condition
 	
 	bool found = false;
@@ -503,7 +671,7 @@ void BTreeIndex::startScan(const void* lowValParm,
 
 			//if excess the range, throw exception
 			if((highOp == LT && key >= highValInt) || (highOp == LTE && key >highValInt)){
-				bufMgr->unPinPage(file, currentPageNum, false);
+				currentPageGuard.release();
 				throw NoSuchKeyFoundException();
 			}
 
@@ -523,16 +691,16 @@ void BTreeIndex::startScan(const void* lowValParm,
 			break;
 		}
 
-		//if not found in this node, unpin this page and go to the next leaf node
-		bufMgr->unPinPage(file, currentPageNum,false);
-		
 		//throw exception if no more right subling exist
 		if(leaf->rightSibPageNo == Page::INVALID_NUMBER){
+			currentPageGuard.release();
 			throw NoSuchKeyFoundException();
 		}
 
-		//currentPageNum = leaf->rightSibPageNo;
-		bufMgr->readPage(file,currentPageNum, currentPageData);
+		//if not found in this node, go to the next leaf node, which unpins this page
+		currentPageNum = leaf->rightSibPageNo;
+		currentPageGuard = bufMgr->readPage(file, currentPageNum);
+		currentPageData = currentPageGuard.getPage();
 	}
 }
 
@@ -564,15 +732,23 @@ void BTreeIndex::scanNext(RecordId& outRid)
 	nextEntry ++;
 	//if no more key in this node, get next node 
 	if(leaf->ridArray[nextEntry].page_number == Page::INVALID_NUMBER || nextEntry >= INTARRAYLEAFSIZE){
-		bufMgr -> unPinPage(file,currentPageNum,false);
 		//throw exception if no more node
 		if(leaf->rightSibPageNo == Page::INVALID_NUMBER){
+			currentPageGuard.release();
 			throw IndexScanCompletedException();
 		}
+		//reading the sibling unpins this page
 		currentPageNum = leaf->rightSibPageNo;
-		bufMgr->readPage(file, currentPageNum, currentPageData);
+		currentPageGuard = bufMgr->readPage(file, currentPageNum);
+		currentPageData = currentPageGuard.getPage();
 		//reset the entry for new node
 		nextEntry = 0;
+
+		//the new leaf was part of the read-ahead window
+		if(leavesAhead > 0) {
+			leavesAhead--;
+		}
+		readAheadLeaves();
 	}
 }
 
@@ -589,9 +765,7 @@ void BTreeIndex::endScan()
 	//set scan state to false
 	scanExecuting = false;
 	// Unpin page
-	if(currentPageNum != Page::INVALID_NUMBER) {
-		bufMgr->unPinPage(file, currentPageNum, false);
-	}
+	currentPageGuard.release();
 }
 
 }
@@ -11,11 +11,13 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <vector>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "catalog.h"
 
 namespace badgerdb
 {
@@ -213,6 +215,11 @@ class BTreeIndex {
    */
   BufMgr  *bufMgr;
 
+  /**
+   * Catalog recording the index, or NULL.
+   */
+  Catalog *catalog;
+
   /**
    * Page number of meta page.
    */
@@ -266,6 +273,11 @@ class BTreeIndex {
    */
   Page    *currentPageData;
 
+  /**
+   * Keeps the current page being scanned pinned.
+   */
+  PageGuard currentPageGuard;
+
   /**
    * Low INTEGER value for scan.
    */
@@ -306,6 +318,47 @@ class BTreeIndex {
    */
   Operator  highOp;
 
+  /**
+   * Leaves following the first leaf of the scan, taken from its parent, in key order.
+   */
+  std::vector<PageId> scanLeafPages;
+
+  /**
+   * Index into scanLeafPages of the first leaf not yet handed to the prefetcher.
+   */
+  std::uint32_t nextReadAheadLeaf;
+
+  /**
+   * Number of leaves requested ahead of the current one.
+   */
+  std::uint32_t leavesAhead;
+
+  /**
+   * Current read-ahead window in leaves.
+   */
+  std::uint32_t readAheadWindow;
+
+  /**
+   * Upper bound of the read-ahead window in leaves.
+   */
+  std::uint32_t maxReadAhead;
+
+  /**
+   * Hand the next leaves of the scan to the prefetcher and widen the read-ahead window.
+   */
+  void readAheadLeaves();
+
+  /**
+   * Finds the child of an inner node to descend into for the low end of the scan range. For a parent of
+   * leaves, also collects the leaves right of that child which can hold keys in range, for read-ahead.
+   * The node may be read optimistically, so its contents are not trusted to be in bounds.
+   *
+   * @param inner       inner node
+   * @param leafParent  returns whether the children of the node are leaves
+   * @return page number of the child
+   */
+  PageId descendInner(const NonLeafNodeInt *inner, bool &leafParent);
+
   /**
   * Insert a key and a record ID to the appropriate position and array of the given leaf node.
   *
@@ -349,23 +402,51 @@ class BTreeIndex {
             PageId* newlyCreatedPageId,
             bool isLeafBool);
 
+  /**
+  * Read the root page from the metadata page of an existing index, whose header page is known.
+  *
+  * @param relationName  name of the base relation
+  * @param indexName     name of the index file
+  * @throws BadIndexInfoException if the metadata page describes another index; the file is closed then
+  */
+  void readMetadata(const std::string & relationName, const std::string & indexName);
+
+  /**
+  * Record the index, with its current root page, in the catalog if there is one.
+  *
+  * @param relationName  name of the base relation
+  */
+  void recordInCatalog(const std::string & relationName);
+
   
  public:
 
+  /**
+   * Default maximum number of leaves an index scan reads ahead of the current leaf.
+   */
+  static const std::uint32_t DEFAULT_READ_AHEAD = 8;
+
   /**
    * BTreeIndex Constructor. 
    * Check to see if the corresponding index file exists. If so, open the file.
    * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+   * With a catalog, whether the index exists and where its header page is are looked up there instead of
+   * in the filesystem, and a new index is recorded in it. The root is always taken from the metadata page;
+   * the catalog's copy of it is brought up to date once the metadata page is flushed.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn            Buffer Manager Instance
    * @param attrByteOffset      Offset of attribute, over which index is to be built, in the record
    * @param attrType            Datatype of attribute over which index is built
+   * @param scanBufMgr          Buffer Manager Instance the base relation is read through while the index is built,
+   *                            e.g. a pool of its own so the scan does not evict index pages. bufMgrIn if NULL.
+   * @param catalogIn           Catalog of relations and indexes, or NULL.
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    */
   BTreeIndex(const std::string & relationName, std::string & outIndexName,
-            BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType);
+            BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType,
+            BufMgr *scanBufMgr = NULL, Catalog *catalogIn = NULL);
   
 
   /**
@@ -389,6 +470,14 @@ class BTreeIndex {
   void insertEntry(const void* key, const RecordId rid);
 
 
+  /**
+   * Set how many leaves a range scan may keep in flight ahead of the current leaf.
+   * The window starts small and doubles while the scan proceeds, up to this maximum.
+   * @param maxPages  Maximum read-ahead window in leaves, 0 disables read-ahead.
+  **/
+  void setReadAhead(const std::uint32_t maxPages);
+
+
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called 
    * using ("a",GT,"d",LTE) then we should seek all entries with a value 
@@ -17,14 +17,19 @@ namespace badgerdb {
 
 int BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  return hash(file, pageNo, HTSIZE);
+}
+
+int BufHashTbl::hash(const File* file, const PageId pageNo, const int size)
+{
+  unsigned int tmp, value;
+  tmp = (unsigned long)file;  // cast of pointer to the file object to an integer
+  value = (tmp + pageNo) % size;
   return value;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(htSize), OLDHTSIZE(0), oldHt(NULL), rehashIndex(0)
 {
   // allocate an array of pointers to hashBuckets
   ht = new hashBucket* [htSize];
@@ -34,6 +39,8 @@ BufHashTbl::BufHashTbl(int htSize)
 
 BufHashTbl::~BufHashTbl()
 {
+  rehashStep(OLDHTSIZE + 1);
+
   for(int i = 0; i < HTSIZE; i++) {
     hashBucket* tmpBuf = ht[i];
     while (ht[i]) {
@@ -45,17 +52,70 @@ BufHashTbl::~BufHashTbl()
   delete [] ht;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::rehashStep(int buckets)
 {
-  int index = hash(file, pageNo);
+  // bound the number of empty buckets skipped as well, so a step stays cheap
+  int emptyVisits = buckets * 10;
+
+  while (oldHt && buckets > 0 && emptyVisits > 0)
+  {
+    if (rehashIndex == OLDHTSIZE)
+    {
+      delete [] oldHt;
+      oldHt = NULL;
+      OLDHTSIZE = 0;
+      break;
+    }
+
+    hashBucket* tmpBuc = oldHt[rehashIndex];
+    if (tmpBuc)
+      buckets--;
+    else
+      emptyVisits--;
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+    while (tmpBuc)
+    {
+      hashBucket* next = tmpBuc->next;
+      int index = hash(tmpBuc->file, tmpBuc->pageNo);
+      tmpBuc->next = ht[index];
+      ht[index] = tmpBuc;
+      tmpBuc = next;
+    }
+    oldHt[rehashIndex++] = NULL;
+  }
+}
+
+hashBucket* BufHashTbl::find(const File* file, const PageId pageNo, hashBucket**& link)
+{
+  link = &ht[hash(file, pageNo)];
+  while (*link) {
+    if ((*link)->file == file && (*link)->pageNo == pageNo)
+      return *link;
+    link = &((*link)->next);
   }
 
+  if (oldHt) {
+    link = &oldHt[hash(file, pageNo, OLDHTSIZE)];
+    while (*link) {
+      if ((*link)->file == file && (*link)->pageNo == pageNo)
+        return *link;
+      link = &((*link)->next);
+    }
+  }
+
+  return NULL;
+}
+
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  rehashStep(1);
+
+  hashBucket** link;
+  hashBucket* tmpBuc = find(file, pageNo, link);
+  if (tmpBuc)
+  	throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
+
+  int index = hash(file, pageNo);
   tmpBuc = new hashBucket;
   if (!tmpBuc)
   	throw HashTableException();
@@ -69,15 +129,14 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
+  rehashStep(1);
+
+  hashBucket** link;
+  hashBucket* tmpBuc = find(file, pageNo, link);
+  if (tmpBuc)
+  {
+    frameNo = tmpBuc->frameNo; // return frameNo by reference
+    return;
   }
 
   throw HashNotFoundException(file->filename(), pageNo);
@@ -85,30 +144,33 @@ void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  rehashStep(1);
 
-  while (tmpBuc)
+  hashBucket** link;
+  hashBucket* tmpBuc = find(file, pageNo, link);
+  if (tmpBuc)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
+    *link = tmpBuc->next;
+    delete tmpBuc;
+    return;
   }
 
   throw HashNotFoundException(file->filename(), pageNo);
 }
 
+void BufHashTbl::resize(const int htSize)
+{
+  // finish a resize still in progress
+  rehashStep(OLDHTSIZE + 1);
+
+  oldHt = ht;
+  OLDHTSIZE = HTSIZE;
+  rehashIndex = 0;
+
+  HTSIZE = htSize;
+  ht = new hashBucket* [htSize];
+  for(int i=0; i < HTSIZE; i++)
+    ht[i] = NULL;
+}
+
 }
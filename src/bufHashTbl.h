@@ -54,6 +54,21 @@ class BufHashTbl
 	 */
   hashBucket**  ht;
 
+	/**
+	 *	Size of the table being migrated into ht while a resize is in progress
+	 */
+  int OLDHTSIZE;
+
+	/**
+	 * Table being migrated into ht while a resize is in progress, NULL otherwise
+	 */
+  hashBucket**  oldHt;
+
+	/**
+	 * Next bucket of oldHt to migrate
+	 */
+  int rehashIndex;
+
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
 	 *
@@ -63,6 +78,35 @@ class BufHashTbl
 	 */
   int	 hash(const File* file, const PageId pageNo);
 
+	/**
+	 * returns hash value between 0 and size-1 computed using file and pageNo
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param size    Size of the table
+	 * @return  			Hash value.
+	 */
+  static int hash(const File* file, const PageId pageNo, const int size);
+
+	/**
+	 * Moves the next few buckets of the old table into the current one while a
+	 * resize is in progress, so the cost of rehashing is spread over many operations.
+	 *
+	 * @param buckets Number of non-empty buckets to migrate
+	 */
+  void rehashStep(int buckets);
+
+	/**
+	 * Returns the bucket holding (file, pageNo) and the link pointing to it, searching
+	 * the old table as well while a resize is in progress.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param link    Pointer to the link referencing the bucket is returned via this variable
+	 * @return  			The bucket, NULL if not found
+	 */
+  hashBucket* find(const File* file, const PageId pageNo, hashBucket**& link);
+
  public:
 	/**
    * Constructor of BufHashTbl class
@@ -104,6 +148,15 @@ class BufHashTbl
    * @throws HashNotFoundException if the page entry is not found in the hash table 
 	 */
   void remove(const File* file, const PageId pageNo);  
+
+	/**
+   * Changes the number of buckets of the hash table. Entries are not moved right
+	 * away but a few buckets at a time by the following insert/lookup/remove calls;
+	 * until then both tables are searched. A resize still in progress is completed first.
+	 *
+	 * @param htSize 	New number of buckets
+	 */
+  void resize(const int htSize);
 };
 
 }
@@ -0,0 +1,89 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bufPoolGroup.h"
+#include "exceptions/pool_not_found_exception.h"
+
+namespace badgerdb { 
+
+BufPoolGroup::BufPoolGroup(const std::string& defaultName, std::uint32_t bufs, BufPoolPages pages)
+{
+  BufMgr* pool = new BufMgr(bufs, pages);
+  poolList.push_back(pool);
+  pools[defaultName] = pool;
+}
+
+
+BufPoolGroup::~BufPoolGroup()
+{
+  for (std::vector<BufMgr*>::reverse_iterator it = poolList.rbegin(); it != poolList.rend(); ++it)
+    delete *it;
+}
+
+
+BufMgr* BufPoolGroup::findPool(const std::string& name) const
+{
+  std::map<std::string, BufMgr*>::const_iterator it = pools.find(name);
+  if (it == pools.end())
+    throw PoolNotFoundException(name);
+
+  return it->second;
+}
+
+
+BufMgr* BufPoolGroup::addPool(const std::string& name, std::uint32_t bufs, BufPoolPages pages)
+{
+  std::lock_guard<std::mutex> lock(groupMutex);
+
+  std::map<std::string, BufMgr*>::const_iterator it = pools.find(name);
+  if (it != pools.end())
+    return it->second;
+
+  BufMgr* pool = new BufMgr(bufs, pages);
+  poolList.push_back(pool);
+  pools[name] = pool;
+  return pool;
+}
+
+
+BufMgr* BufPoolGroup::getPool(const std::string& name) const
+{
+  std::lock_guard<std::mutex> lock(groupMutex);
+
+  return findPool(name);
+}
+
+
+void BufPoolGroup::bindFile(const std::string& fileName, const std::string& poolName)
+{
+  std::lock_guard<std::mutex> lock(groupMutex);
+
+  findPool(poolName);
+  fileBindings[fileName] = poolName;
+}
+
+
+void BufPoolGroup::unbindFile(const std::string& fileName)
+{
+  std::lock_guard<std::mutex> lock(groupMutex);
+
+  fileBindings.erase(fileName);
+}
+
+
+BufMgr* BufPoolGroup::poolFor(const std::string& fileName) const
+{
+  std::lock_guard<std::mutex> lock(groupMutex);
+
+  std::map<std::string, std::string>::const_iterator it = fileBindings.find(fileName);
+  if (it == fileBindings.end())
+    return poolList.front();
+
+  return findPool(it->second);
+}
+
+}
@@ -0,0 +1,129 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief A group of named buffer pools, each with its own frames and clock, and the files bound to them.
+* Files not bound to any pool use the default pool, the one the group was created with.
+* Keeping for instance the index files in a pool of their own guarantees that relation scans
+* churning the default pool never evict index pages.
+*/
+class BufPoolGroup
+{
+ private:
+	/**
+   * Pools of the group in the order they were added, the default pool first
+	 */
+  std::vector<BufMgr*> poolList;
+
+	/**
+   * Pools of the group keyed by name
+	 */
+  std::map<std::string, BufMgr*> pools;
+
+	/**
+   * Pool names keyed by the names of the files bound to them
+	 */
+  std::map<std::string, std::string> fileBindings;
+
+	/**
+   * Latch protecting the maps above. The pools latch themselves.
+	 */
+  mutable std::mutex groupMutex;
+
+	/**
+   * Looks up a pool by name, assumes the latch is held.
+	 */
+  BufMgr* findPool(const std::string& name) const;
+
+ public:
+	/**
+   * Constructor of BufPoolGroup class
+	 *
+	 * @param defaultName	Name of the default pool
+	 * @param bufs   			Number of frames in the default pool
+	 * @param pages   		Kind of memory pages backing the default pool
+	 */
+  BufPoolGroup(const std::string& defaultName, std::uint32_t bufs, BufPoolPages pages = POOL_PAGES_DEFAULT);
+
+	/**
+   * Destructor of BufPoolGroup class. Destroys the pools in the reverse order they were added,
+	 * writing their dirty pages out.
+	 */
+  ~BufPoolGroup();
+
+	/**
+	 * Adds a pool to the group.
+	 *
+	 * @param name   	Name of the pool
+	 * @param bufs   	Number of frames in the pool
+	 * @param pages   Kind of memory pages backing the pool
+	 * @return The new pool, or the pool of that name if the group already has one; its size is left alone
+	 */
+  BufMgr* addPool(const std::string& name, std::uint32_t bufs, BufPoolPages pages = POOL_PAGES_DEFAULT);
+
+	/**
+	 * Returns the pool of the given name.
+	 *
+	 * @param name   	Name of the pool
+   * @throws  PoolNotFoundException If the group has no pool of that name
+	 */
+  BufMgr* getPool(const std::string& name) const;
+
+	/**
+	 * Returns the default pool.
+	 */
+  BufMgr* getDefaultPool() const
+  {
+		return poolList.front();
+  }
+
+	/**
+	 * Binds a file to a pool. Pages of the file already cached in another pool are not moved,
+	 * so files should be bound before they are used.
+	 *
+	 * @param fileName	Name of the file
+	 * @param poolName	Name of the pool
+   * @throws  PoolNotFoundException If the group has no pool of that name
+	 */
+  void bindFile(const std::string& fileName, const std::string& poolName);
+
+	/**
+	 * Binds a file back to the default pool.
+	 *
+	 * @param fileName	Name of the file
+	 */
+  void unbindFile(const std::string& fileName);
+
+	/**
+	 * Returns the pool the given file is bound to, the default pool for unbound files.
+	 *
+	 * @param fileName	Name of the file
+	 */
+  BufMgr* poolFor(const std::string& fileName) const;
+
+	/**
+	 * Returns the pool the given file is bound to, the default pool for unbound files.
+	 *
+	 * @param file   	File object
+	 */
+  BufMgr* poolFor(const File* file) const
+  {
+		return poolFor(file->filename());
+  }
+};
+
+}
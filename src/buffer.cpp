@@ -7,21 +7,176 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <sstream>
+#include <fstream>
+#include <sys/mman.h>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/file_not_found_exception.h"
 
 namespace badgerdb { 
 
+// frames are mapped page-aligned, so each one can be read and written with direct I/O as is
+static_assert(Page::SIZE % File::DIRECT_IO_ALIGNMENT == 0, "frames must stay aligned for direct I/O");
+
+static std::uint64_t elapsedMicros(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LatencyHistogram::record(const std::uint64_t micros)
+{
+  std::uint32_t bucket = 0;
+  while (bucket < NUM_BUCKETS - 1 && (std::uint64_t(1) << bucket) <= micros)
+    bucket++;
+
+  buckets[bucket]++;
+  count++;
+  totalMicros += micros;
+}
+
+void LatencyHistogram::clear()
+{
+  for (std::uint32_t i = 0; i < NUM_BUCKETS; i++)
+    buckets[i] = 0;
+  count = totalMicros = 0;
+}
+
+/**
+ * Keeps optimistic reads from beginning for a scope, once the reads under way have been validated.
+ */
+class OptimisticReadBarrier
+{
+ public:
+  OptimisticReadBarrier(std::atomic<std::uint32_t>& readersIn, std::atomic<bool>& closedIn)
+    : readers(readersIn), closed(closedIn)
+  {
+    closed.store(true);
+    while (readers.load() > 0)
+      std::this_thread::yield();
+  }
+
+  ~OptimisticReadBarrier()
+  {
+    closed.store(false);
+  }
+
+ private:
+  std::atomic<std::uint32_t>& readers;
+  std::atomic<bool>& closed;
+};
+
+static void histogramJson(std::ostream& out, const LatencyHistogram& hist)
+{
+  out << "{\"count\":" << hist.count << ",\"totalMicros\":" << hist.totalMicros << ",\"buckets\":[";
+  for (std::uint32_t i = 0; i < LatencyHistogram::NUM_BUCKETS; i++)
+    out << (i > 0 ? "," : "") << hist.buckets[i];
+  out << "]}";
+}
+
+static void histogramText(std::ostream& out, const char* name, const LatencyHistogram& hist)
+{
+  out << name << ": " << hist.count << " ops, " << hist.totalMicros << " us total\n";
+  for (std::uint32_t i = 0; i < LatencyHistogram::NUM_BUCKETS; i++)
+  {
+    if (hist.buckets[i] == 0)
+      continue;
+    if (i < LatencyHistogram::NUM_BUCKETS - 1)
+      out << "  < " << (std::uint64_t(1) << i) << " us: " << hist.buckets[i] << "\n";
+    else
+      out << "  >= " << (std::uint64_t(1) << (i - 1)) << " us: " << hist.buckets[i] << "\n";
+  }
+}
+
+static void jsonString(std::ostream& out, const std::string& str)
+{
+  out << '"';
+  for (std::string::size_type i = 0; i < str.size(); i++)
+  {
+    if (str[i] == '"' || str[i] == '\\')
+      out << '\\' << str[i];
+    else if ((unsigned char) str[i] < 0x20)
+      out << "\\u00" << "0123456789abcdef"[str[i] >> 4] << "0123456789abcdef"[str[i] & 0xf];
+    else
+      out << str[i];
+  }
+  out << '"';
+}
+
+std::string BufStats::toJson() const
+{
+  std::ostringstream out;
+  out << "{\"accesses\":" << accesses
+      << ",\"hits\":" << hits
+      << ",\"misses\":" << misses
+      << ",\"diskreads\":" << diskreads
+      << ",\"diskwrites\":" << diskwrites
+      << ",\"cleanEvictions\":" << cleanEvictions
+      << ",\"dirtyEvictions\":" << dirtyEvictions
+      << ",\"pinFailures\":" << pinFailures
+      << ",\"admissionWaits\":" << admissionWaits
+      << ",\"clockSweep\":" << clockSweep
+      << ",\"maxClockSweep\":" << maxClockSweep
+      << ",\"readLatency\":";
+  histogramJson(out, readLatency);
+  out << ",\"writeLatency\":";
+  histogramJson(out, writeLatency);
+  out << ",\"files\":{";
+  for (std::map<std::string, FileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+  {
+    if (it != files.begin())
+      out << ",";
+    jsonString(out, it->first);
+    out << ":{\"hits\":" << it->second.hits
+        << ",\"misses\":" << it->second.misses
+        << ",\"diskreads\":" << it->second.diskreads
+        << ",\"diskwrites\":" << it->second.diskwrites << "}";
+  }
+  out << "}}";
+  return out.str();
+}
+
+std::string BufStats::toText() const
+{
+  std::ostringstream out;
+  out << "accesses: " << accesses << "\n"
+      << "hits: " << hits << "\n"
+      << "misses: " << misses << "\n";
+  if (hits + misses > 0)
+    out << "hit ratio: " << (double) hits / (hits + misses) << "\n";
+  out << "diskreads: " << diskreads << "\n"
+      << "diskwrites: " << diskwrites << "\n"
+      << "clean evictions: " << cleanEvictions << "\n"
+      << "dirty evictions: " << dirtyEvictions << "\n"
+      << "pin failures: " << pinFailures << "\n"
+      << "admission waits: " << admissionWaits << "\n"
+      << "clock sweep: " << clockSweep << " frames, longest " << maxClockSweep << "\n";
+  histogramText(out, "read latency", readLatency);
+  histogramText(out, "write latency", writeLatency);
+  for (std::map<std::string, FileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+  {
+    out << "file " << it->first << ": " << it->second.hits << " hits, " << it->second.misses << " misses, "
+        << it->second.diskreads << " reads, " << it->second.diskwrites << " writes\n";
+  }
+  return out.str();
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, BufPoolPages pages, std::uint32_t maxBufs)
+	: numBufs(bufs), poolPages(pages), frameTags(NULL), frameHints(NULL), numHints(0), optimisticReaders(0),
+	  optimisticReadsClosed(false), frameWaiters(0),
+	  admissionWaitMs(0), victimCache(NULL), bgWriterRunning(false), prefetcherRunning(false) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -29,10 +184,11 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].frameNo = i;
   	bufDescTable[i].valid = false;
   }
+  allocTags(bufs);
 
-  bufPool = new Page[bufs];
+  bufPool = allocPoolMemory(std::max(bufs, maxBufs), poolPages, poolBytes);
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
+  int htsize = hashTableSize(bufs);
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
   clockHand = bufs - 1;
@@ -40,22 +196,250 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
 
 BufMgr::~BufMgr() {
-  //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  stopBgWriter();
+  stopPrefetcher();
+
+  if (!shutdownSnapshot.empty())
+    writeResidency(shutdownSnapshot);
+
+  //Flush out all unwritten pages, file by file
+  for (FileFrameMap::iterator iter = fileFrames.begin(); iter != fileFrames.end(); ++iter)
   {
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
-		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-  	}
+    writeDirtyPages(iter->second);
   }
 
 	delete hashTable;
+  delete victimCache;
+  delete [] bufDescTable;
+  delete [] frameTags;
+  delete [] frameHints;
+  freePoolMemory(bufPool, poolBytes);
+}
+
+Page* BufMgr::allocPoolMemory(const std::uint32_t bufs, BufPoolPages& pages, std::size_t& bytes)
+{
+  bytes = (std::size_t) bufs * Page::SIZE;
+  if (pages != POOL_PAGES_DEFAULT)
+    bytes = ((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+
+  void* pool = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (pages == POOL_PAGES_EXPLICIT_HUGE)
+    pool = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+  // no huge pages reserved, settle for transparent ones
+  if (pool == MAP_FAILED)
+  {
+    if (pages == POOL_PAGES_EXPLICIT_HUGE)
+      pages = POOL_PAGES_TRANSPARENT_HUGE;
+
+    pool = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pool == MAP_FAILED)
+      throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if (pages == POOL_PAGES_TRANSPARENT_HUGE)
+      madvise(pool, bytes, MADV_HUGEPAGE);
+#else
+    pages = POOL_PAGES_DEFAULT;
+#endif
+  }
+
+  return static_cast<Page*>(pool);
+}
+
+void BufMgr::freePoolMemory(Page* pool, const std::size_t bytes)
+{
+  munmap(pool, bytes);
+}
+
+int BufMgr::hashTableSize(const std::uint32_t bufs)
+{
+  return ((((int) (bufs * 1.2))*2)/2)+1;
+}
+
+void BufMgr::resize(std::uint32_t newBufs)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  // frames of prefetch reads in flight are pinned and the background writer marks the frames
+  // it wrote clean, let them finish first
+  waitForFileIo(NULL);
+
+  if (newBufs == 0)
+    newBufs = 1;
+  if (newBufs == numBufs)
+    return;
+
+  // optimistic reads use the frame tags and the pool without the latch, both of which may go away below
+  OptimisticReadBarrier barrier(optimisticReaders, optimisticReadsClosed);
+
+  if (newBufs < numBufs)
+  {
+    // pinned pages cannot be moved, so they must all lie below the new size
+    for (FrameId i = newBufs; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      if (tmpbuf->valid && tmpbuf->pinCnt > 0)
+        throw PagePinnedException(tmpbuf->file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+    }
+
+    // keep as many of the cut off pages cached as there are free frames left,
+    // and evict the rest
+    FrameId freeFrame = 0;
+    for (FrameId i = newBufs; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      if (!tmpbuf->valid)
+        continue;
+
+      while (freeFrame < newBufs && bufDescTable[freeFrame].valid)
+        freeFrame++;
+
+      if (freeFrame < newBufs)
+      {
+        unmapFrame(tmpbuf->file, tmpbuf->pageNo);
+        bufPool[freeFrame] = bufPool[i];
+        bufDescTable[freeFrame].Set(tmpbuf->file, tmpbuf->pageNo);
+        bufDescTable[freeFrame].pinCnt = 0;
+        bufDescTable[freeFrame].dirty = tmpbuf->dirty;
+        bufDescTable[freeFrame].refbit = tmpbuf->refbit;
+        mapFrame(tmpbuf->file, tmpbuf->pageNo, freeFrame);
+        tmpbuf->Clear();
+      }
+      else
+        evictFrame(tmpbuf);
+    }
+
+    // hand the memory of the cut off frames back, keeping the address space
+    madvise(&bufPool[newBufs], (std::size_t) (numBufs - newBufs) * Page::SIZE, MADV_DONTNEED);
+  }
+  else if ((std::size_t) newBufs * Page::SIZE > poolBytes)
+  {
+    // growing past the reserved address space may move the pool, which would
+    // invalidate the Page pointers handed out for pinned pages
+    for (FrameId i = 0; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      if (tmpbuf->valid && tmpbuf->pinCnt > 0)
+        throw PagePinnedException(tmpbuf->file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+    }
+
+    std::size_t bytes = (std::size_t) newBufs * Page::SIZE;
+    if (poolPages != POOL_PAGES_DEFAULT)
+      bytes = ((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+
+    void* pool = mremap(bufPool, poolBytes, bytes, MREMAP_MAYMOVE);
+    if (pool == MAP_FAILED)
+      throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if (poolPages == POOL_PAGES_TRANSPARENT_HUGE)
+      madvise(pool, bytes, MADV_HUGEPAGE);
+#endif
+    bufPool = static_cast<Page*>(pool);
+    poolBytes = bytes;
+  }
+
+  // carry the descriptors of the remaining frames over
+  BufDesc* newDescTable = new BufDesc[newBufs];
+  for (FrameId i = 0; i < newBufs; i++)
+  {
+    if (i < numBufs)
+      newDescTable[i] = bufDescTable[i];
+    newDescTable[i].frameNo = i;
+  }
   delete [] bufDescTable;
-  delete [] bufPool;
+  bufDescTable = newDescTable;
+
+  allocTags(newBufs);
+
+  numBufs = newBufs;
+  if (clockHand >= numBufs)
+    clockHand = numBufs - 1;
+
+  // the page table follows, migrating its entries a few at a time
+  hashTable->resize(hashTableSize(newBufs));
+  notifyFrameFree();
+}
+
+void BufMgr::allocTags(const std::uint32_t bufs)
+{
+  // frames carried over keep their page under a newer version
+  FrameTag* tags = new FrameTag[bufs];
+  for (FrameId i = 0; i < bufs; i++)
+  {
+    const bool kept = frameTags != NULL && i < numBufs;
+    tags[i].file.store(kept ? frameTags[i].file.load() : NULL);
+    tags[i].pageNo.store(kept ? frameTags[i].pageNo.load() : Page::INVALID_NUMBER);
+    tags[i].version.store(kept ? frameTags[i].version.load() + 2 : 1);
+  }
+  delete [] frameTags;
+  frameTags = tags;
+
+  delete [] frameHints;
+  numHints = 2 * bufs;
+  frameHints = new std::atomic<FrameId>[numHints];
+  for (std::uint32_t i = 0; i < numHints; i++)
+    frameHints[i].store(0);
+  for (FrameId i = 0; i < bufs; i++)
+  {
+    if (tags[i].file.load() != NULL)
+      frameHints[hintSlot(tags[i].file.load(), tags[i].pageNo.load())].store(i + 1);
+  }
+}
+
+void BufMgr::syncVersion(const FrameId frameNo)
+{
+  FrameTag& tag = frameTags[frameNo];
+  const bool inFlux = tag.file.load(std::memory_order_relaxed) == NULL || bufDescTable[frameNo].writeCnt > 0;
+  const std::uint32_t version = tag.version.load(std::memory_order_relaxed);
+  if ((version % 2 == 1) == inFlux)
+    return;
+
+  tag.version.store(version + 1, std::memory_order_release);
+  // the page may only change once the odd version can be seen
+  if (inFlux)
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void BufMgr::beginWrite(const FrameId frameNo)
+{
+  bufDescTable[frameNo].writeCnt++;
+  syncVersion(frameNo);
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::endWrite(const FrameId frameNo)
+{
+  if (bufDescTable[frameNo].writeCnt > 0)
+    bufDescTable[frameNo].writeCnt--;
+  syncVersion(frameNo);
+}
+
+void BufMgr::tagFrame(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  frameTags[frameNo].file.store(file, std::memory_order_relaxed);
+  frameTags[frameNo].pageNo.store(pageNo, std::memory_order_relaxed);
+  syncVersion(frameNo);
+  frameHints[hintSlot(file, pageNo)].store(frameNo + 1, std::memory_order_release);
+}
+
+void BufMgr::untagFrame(const FrameId frameNo)
+{
+  FrameTag& tag = frameTags[frameNo];
+  const File* file = tag.file.load(std::memory_order_relaxed);
+  if (file == NULL)
+    return;
+
+  std::atomic<FrameId>& hint = frameHints[hintSlot(file, tag.pageNo.load(std::memory_order_relaxed))];
+  if (hint.load(std::memory_order_relaxed) == frameNo + 1)
+    hint.store(0, std::memory_order_relaxed);
+  tag.file.store(NULL, std::memory_order_relaxed);
+  syncVersion(frameNo);
+}
+
+bool BufMgr::runClock()
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
@@ -82,8 +466,6 @@ void BufMgr::allocBuf(FrameId & frame)
       if (bufDescTable[clockHand].pinCnt == 0)
       {
         // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
         found = true;
         break;
       }
@@ -91,74 +473,296 @@ void BufMgr::allocBuf(FrameId & frame)
     else
     {
       // has been referenced, clear the bit
-      bufStats.accesses++;
       bufDescTable[clockHand].refbit = false;
     }
   }
+
+  bufStats.clockSweep += numScanned;
+  if (numScanned > bufStats.maxClockSweep)
+    bufStats.maxClockSweep = numScanned;
   
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  return found || numScanned < 2*numBufs;
+}
+
+bool BufMgr::allocBuf(FrameId & frame, BufAccessStrategy* strategy, bool mayWait) 
+{
+  // a full ring recycles its oldest frame, provided it is not pinned and
+  // nobody outside the strategy has referenced it in the meantime
+  // (frames cut off by a shrinking pool are replaced from the clock)
+  if (strategy != NULL && strategy->ring.size() == strategy->ringSize
+      && strategy->ring[strategy->current] < numBufs)
   {
-    throw BufferExceededException();
+    FrameId ringFrame = strategy->ring[strategy->current];
+    BufDesc* ringBuf = &(bufDescTable[ringFrame]);
+
+    if (! ringBuf->valid || (ringBuf->pinCnt == 0 && ! ringBuf->refbit))
+    {
+      if (ringBuf->valid)
+        evictFrame(ringBuf);
+      else
+        ringBuf->Clear();
+      strategy->current = (strategy->current + 1) % strategy->ringSize;
+      frame = ringFrame;
+      return false;
+    }
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  // every frame pinned: wait for a pin to be released, as long as admission control allows
+  bool waited = false;
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(admissionWaitMs);
+  while (!runClock())
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    if (!mayWait || admissionWaitMs == 0 || std::chrono::steady_clock::now() >= deadline)
+    {
+      bufStats.pinFailures++;
+      throw BufferExceededException();
+    }
+
+    bufStats.admissionWaits++;
+    frameWaiters++;
+    frameFreed.wait_until(bufMutex, deadline);
+    frameWaiters--;
+    waited = true;
   }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  // flush any existing changes to disk if necessary and
+	// reset all the BufDesc entry for the frame before returning the frame
+  if (bufDescTable[clockHand].valid)
+    evictFrame(&bufDescTable[clockHand]);
+  else
+    bufDescTable[clockHand].Clear();
+
+  // a frame taken from the clock replaces the ring slot that could not be recycled
+  if (strategy != NULL)
+  {
+    if (strategy->ring.size() < strategy->ringSize)
+      strategy->ring.push_back(clockHand);
+    else
+      strategy->ring[strategy->current] = clockHand;
+
+    strategy->current = (strategy->current + 1) % strategy->ringSize;
+  }
 
   // return new frame number
   frame = clockHand;
+  return waited;
 } // end allocBuf
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+
+bool BufMgr::allocQuotaBuf(const File* file, FrameId& frame)
+{
+  if (fileQuotas.empty())
+    return false;
+
+  std::map<std::string, std::uint32_t>::const_iterator quota = fileQuotas.find(file->filename());
+  if (quota == fileQuotas.end())
+    return false;
+
+  FileFrameMap::iterator fileIter = fileFrames.find(file);
+  if (fileIter == fileFrames.end() || fileIter->second.size() < quota->second)
+    return false;
+
+  // second chance among the pages of the file only
+  PageFrameMap& pages = fileIter->second;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (PageFrameMap::iterator it = pages.begin(); it != pages.end(); ++it)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[it->second]);
+      if (tmpbuf->pinCnt > 0)
+        continue;
+
+      if (tmpbuf->refbit)
+      {
+        tmpbuf->refbit = false;
+        continue;
+      }
+
+      frame = tmpbuf->frameNo;
+      evictFrame(tmpbuf);
+      return true;
+    }
+  }
+
+  bufStats.pinFailures++;
+  throw BufferExceededException();
+}
+
+void BufMgr::setFileQuota(const std::string& fileName, const std::uint32_t frames)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  if (frames == 0)
+    fileQuotas.erase(fileName);
+  else
+    fileQuotas[fileName] = frames;
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  // the caller may modify the page through the pointer
+  FrameId frameNo = pinPage(file, pageNo, strategy);
+  beginWrite(frameNo);
+  page = &bufPool[frameNo];
+}
+
+PageGuard BufMgr::readPage(File* file, const PageId pageNo, const PageGuardMode mode, BufAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  FrameId frameNo = pinPage(file, pageNo, strategy);
+  if (mode == GUARD_WRITE)
+    beginWrite(frameNo);
+  return PageGuard(this, frameNo, pageNo, &bufPool[frameNo], mode, strategy);
+}
+
+FrameId BufMgr::pinPage(File* file, const PageId pageNo, BufAccessStrategy* strategy)
 {
+  // a caller over its pin budget has to unpin some pages first
+  if (strategy != NULL && strategy->pinBudget > 0 && strategy->pins >= strategy->pinBudget)
+  {
+    bufStats.pinFailures++;
+    throw BufferExceededException();
+  }
+
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
+  bufStats.accesses++;
 	try
 	{
   	hashTable->lookup(file, pageNo, frameNo);
+    bufStats.hits++;
+    fileStats[file].hits++;
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
+    // set the referenced bit, unless the page is only passing through a ring
+    if (strategy == NULL)
+      bufDescTable[frameNo].refbit = true;
     bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
   }
   catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    bufStats.misses++;
+    fileStats[file].misses++;
+    loadPage(file, pageNo, frameNo, strategy);
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  if (strategy != NULL)
+    strategy->pins++;
+  return frameNo;
+}
+
+
+bool BufMgr::beginOptimisticRead(File* file, const PageId pageNo, OptimisticRead& read)
+{
+  // registered before the check, so that resize() either sees the read or the read sees resize()
+  read.active = false;
+  optimisticReaders.fetch_add(1);
+  if (optimisticReadsClosed.load())
+  {
+    optimisticReaders.fetch_sub(1);
+    return false;
+  }
+
+  // no latch: the hint names the frame the page was last seen in, whose tag is checked under its version
+  const FrameId hint = frameHints[hintSlot(file, pageNo)].load(std::memory_order_acquire);
+  bool found = hint != 0;
+  if (found)
+  {
+    read.frameNo = hint - 1;
+    const FrameTag& tag = frameTags[read.frameNo];
+    read.version = tag.version.load(std::memory_order_acquire);
+    found = read.version % 2 == 0 && tag.file.load(std::memory_order_relaxed) == file
+            && tag.pageNo.load(std::memory_order_relaxed) == pageNo;
+  }
+  if (!found)
+  {
+    optimisticReaders.fetch_sub(1);
+    return false;
+  }
+
+  read.page = &bufPool[read.frameNo];
+  read.active = true;
+  return true;
+}
+
+void BufMgr::loadPage(File* file, const PageId pageNo, FrameId& frameNo, BufAccessStrategy* strategy)
+{
+  // the prefetcher may be reading the page already, take its frame once the read is in
+  if (waitForPrefetchedPage(file, pageNo))
+  {
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
+      if (strategy == NULL)
+        bufDescTable[frameNo].refbit = true;
+      bufDescTable[frameNo].pinCnt++;
+      return;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+  }
+
+  // alloc a new frame
+  bool waited = false;
+  if (! allocQuotaBuf(file, frameNo))
+    waited = allocBuf(frameNo, strategy);
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  // another thread may have loaded the page while this one was waiting for a frame
+  if (waited)
+  {
+    FrameId residentFrame = 0;
+    try
+    {
+      hashTable->lookup(file, pageNo, residentFrame);
+      bufDescTable[residentFrame].pinCnt++;
+      frameNo = residentFrame;
+      notifyFrameFree();
+      return;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+  }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+  // read the page into the new frame, from the victim cache if it is there
+  if (victimCache == NULL || !victimCache->take(file, pageNo, bufPool[frameNo]))
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    file->readPageInto(pageNo, bufPool[frameNo]);
+    bufStats.readLatency.record(elapsedMicros(start));
+    bufStats.diskreads++;
+    fileStats[file].diskreads++;
   }
+
+  // set up the entry properly
+  bufDescTable[frameNo].Set(file, pageNo);
+  if (strategy != NULL)
+    bufDescTable[frameNo].refbit = false;
+
+  // insert in the hash table
+  mapFrame(file, pageNo, frameNo);
 }
 
 
-void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
+void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty, BufAccessStrategy* strategy) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
+
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true)
+  {
+    bufDescTable[frameNo].dirty = dirty;
+    bumpVersion(frameNo);
+  }
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
@@ -166,70 +770,319 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
   	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   }
   else bufDescTable[frameNo].pinCnt--;
+  endWrite(frameNo);
+
+  if (strategy != NULL && strategy->pins > 0)
+    strategy->pins--;
+  if (bufDescTable[frameNo].pinCnt == 0)
+    notifyFrameFree();
 }
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  FrameId frameNo = pinNewPage(file, pageNo);
+  beginWrite(frameNo);
+  page = &bufPool[frameNo];
+}
+
+PageGuard BufMgr::allocPage(File* file, PageId &pageNo)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  FrameId frameNo = pinNewPage(file, pageNo);
+  beginWrite(frameNo);
+  return PageGuard(this, frameNo, pageNo, &bufPool[frameNo], GUARD_WRITE, NULL);
+}
+
+FrameId BufMgr::pinNewPage(File* file, PageId &pageNo)
 {
   FrameId frameNo;
+  bufStats.accesses++;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  if (! allocQuotaBuf(file, frameNo))
+    allocBuf(frameNo);
 
-  // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  // allocate a new page in the file; a page number can be reused after the page was deleted
+  file->allocatePageInto(pageNo, bufPool[frameNo]);
+  if (victimCache != NULL)
+    victimCache->drop(file, pageNo);
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  mapFrame(file, pageNo, frameNo);
+  return frameNo;
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty, const bool writing, BufAccessStrategy* strategy)
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
-
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
-
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  if (dirty)
+  {
+    bufDescTable[frameNo].dirty = true;
+    bumpVersion(frameNo);
   }
+  if (bufDescTable[frameNo].pinCnt > 0)
+    bufDescTable[frameNo].pinCnt--;
+  if (writing)
+    endWrite(frameNo);
+
+  if (strategy != NULL && strategy->pins > 0)
+    strategy->pins--;
+  if (bufDescTable[frameNo].pinCnt == 0)
+    notifyFrameFree();
 }
 
-void BufMgr::disposePage(File* file, const PageId pageNo)
+PageGuard::PageGuard()
+	: bufMgr(NULL), frameNo(0), pageNo(Page::INVALID_NUMBER), page(NULL), dirty(false), writing(false), strategy(NULL)
 {
-	//Deallocate from file altogether
-  //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+}
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+PageGuard::PageGuard(BufMgr* bufMgr, const FrameId frameNo, const PageId pageNo, Page* page,
+										 const PageGuardMode mode, BufAccessStrategy* strategy)
+	: bufMgr(bufMgr), frameNo(frameNo), pageNo(pageNo), page(page), dirty(mode == GUARD_WRITE),
+	  writing(mode == GUARD_WRITE), strategy(strategy)
+{
+}
 
-	hashTable->remove(file, pageNo);
+PageGuard::PageGuard(PageGuard&& other)
+	: bufMgr(other.bufMgr), frameNo(other.frameNo), pageNo(other.pageNo), page(other.page), dirty(other.dirty),
+		writing(other.writing), strategy(other.strategy)
+{
+  other.bufMgr = NULL;
+  other.page = NULL;
+}
 
-  // deallocate it in the file	
-  file->deletePage(pageNo);
+PageGuard& PageGuard::operator=(PageGuard&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    frameNo = other.frameNo;
+    pageNo = other.pageNo;
+    page = other.page;
+    dirty = other.dirty;
+    writing = other.writing;
+    strategy = other.strategy;
+    other.bufMgr = NULL;
+    other.page = NULL;
+  }
+  return *this;
 }
 
-void BufMgr::printSelf(void) 
+PageGuard::~PageGuard()
 {
+  release();
+}
+
+void PageGuard::markDirty()
+{
+  dirty = true;
+  if (bufMgr == NULL || writing)
+    return;
+
+  std::lock_guard<std::mutex> lock(bufMgr->bufMutex);
+  bufMgr->beginWrite(frameNo);
+  writing = true;
+}
+
+void PageGuard::release(const bool modified)
+{
+  if (bufMgr == NULL)
+    return;
+
+  bufMgr->unPinFrame(frameNo, dirty || modified, writing, strategy);
+  bufMgr = NULL;
+  page = NULL;
+}
+
+void BufMgr::flushFile(const File* file) 
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  // the file may go away after this, forget about pages still queued or cached for it
+  cancelPrefetch(file);
+  if (victimCache != NULL)
+    victimCache->dropFile(file);
+
+  FileFrameMap::iterator fileIter = fileFrames.find(file);
+  if (fileIter == fileFrames.end())
+  {
+    file->flushHeader();
+    retireFileStats(file);
+    return;
+  }
+
+  // nothing is written unless every page of the file can be flushed
+  PageFrameMap& pages = fileIter->second;
+  for (PageFrameMap::iterator iter = pages.begin(); iter != pages.end(); ++iter)
+  {
+  	BufDesc* tmpbuf = &(bufDescTable[iter->second]);
+    if (tmpbuf->valid == false || tmpbuf->file != file)
+  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+
+    if (tmpbuf->pinCnt > 0)
+  		throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  }
+
+  writeDirtyPages(pages);
+  // the file keeps its header in memory, it goes out along with the pages
+  file->flushHeader();
+
+  for (PageFrameMap::iterator iter = pages.begin(); iter != pages.end(); ++iter)
+  {
+    hashTable->remove(file, iter->first);
+    untagFrame(iter->second);
+    bufDescTable[iter->second].Clear();
+  }
+  fileFrames.erase(fileIter);
+  retireFileStats(file);
+  notifyFrameFree();
+}
+
+void BufMgr::retireFileStats(const File* file)
+{
+  std::map<const File*, FileStats>::iterator statIter = fileStats.find(file);
+  if (statIter == fileStats.end())
+    return;
+
+  FileStats& total = bufStats.files[file->filename()];
+  total.hits += statIter->second.hits;
+  total.misses += statIter->second.misses;
+  total.diskreads += statIter->second.diskreads;
+  total.diskwrites += statIter->second.diskwrites;
+  fileStats.erase(statIter);
+}
+
+void BufMgr::writeDirtyPages(const PageFrameMap& pages)
+{
+  File* runFile = NULL;
+  PageId runStart = Page::INVALID_NUMBER;
+  std::vector<const Page*> run;
+
+  for (PageFrameMap::const_iterator iter = pages.begin(); iter != pages.end(); ++iter)
+  {
+  	BufDesc* tmpbuf = &(bufDescTable[iter->second]);
+    if (!tmpbuf->dirty)
+      continue;
+
+    // a page not adjacent to the current run starts a new one
+    if (!run.empty() && tmpbuf->pageNo != runStart + run.size())
+    {
+      writeRun(runFile, runStart, run);
+      run.clear();
+    }
+
+    if (run.empty())
+    {
+      runFile = tmpbuf->file;
+      runStart = tmpbuf->pageNo;
+    }
+    run.push_back(&bufPool[iter->second]);
+    tmpbuf->dirty = false;
+  }
+
+  if (!run.empty())
+    writeRun(runFile, runStart, run);
+}
+
+void BufMgr::writeRun(File* file, const PageId first, const std::vector<const Page*>& pages)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  file->writePages(first, pages);
+  bufStats.writeLatency.record(elapsedMicros(start));
+  bufStats.diskwrites += pages.size();
+  fileStats[file].diskwrites += pages.size();
+}
+
+void BufMgr::writeFrame(BufDesc* buf)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  buf->file->writePage(buf->pageNo, bufPool[buf->frameNo]);
+  bufStats.writeLatency.record(elapsedMicros(start));
+  bufStats.diskwrites++;
+  fileStats[buf->file].diskwrites++;
+  buf->dirty = false;
+}
+
+void BufMgr::evictFrame(BufDesc* buf)
+{
+  if (buf->dirty)
+  {
+    writeFrame(buf);
+    bufStats.dirtyEvictions++;
+  }
+  else
+    bufStats.cleanEvictions++;
+
+  // the page is clean now, keep a compressed copy around
+  if (victimCache != NULL)
+    victimCache->put(buf->file, buf->pageNo, bufPool[buf->frameNo]);
+
+  unmapFrame(buf->file, buf->pageNo);
+  buf->Clear();
+}
+
+void BufMgr::mapFrame(File* file, const PageId pageNo, const FrameId frameNo)
+{
+  hashTable->insert(file, pageNo, frameNo);
+  fileFrames[file][pageNo] = frameNo;
+  tagFrame(file, pageNo, frameNo);
+}
+
+void BufMgr::unmapFrame(const File* file, const PageId pageNo)
+{
+  hashTable->remove(file, pageNo);
+
+  FileFrameMap::iterator fileIter = fileFrames.find(file);
+  if (fileIter != fileFrames.end())
+  {
+    PageFrameMap::iterator pageIter = fileIter->second.find(pageNo);
+    if (pageIter != fileIter->second.end())
+    {
+      untagFrame(pageIter->second);
+      fileIter->second.erase(pageIter);
+    }
+    if (fileIter->second.empty())
+      fileFrames.erase(fileIter);
+  }
+}
+
+void BufMgr::disposePage(File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  // a read or a background write of the page still in flight would land after the delete
+  cancelPrefetch(file);
+
+	//Deallocate from file altogether
+  if (victimCache != NULL)
+    victimCache->drop(file, pageNo);
+
+  //See if it is in the buffer pool
+  FrameId frameNo = 0;
+  hashTable->lookup(file, pageNo, frameNo);
+
+	// clear the page
+	bufDescTable[frameNo].Clear();
+
+	unmapFrame(file, pageNo);
+
+  // deallocate it in the file	
+  file->deletePage(pageNo);
+  notifyFrameFree();
+}
+
+void BufMgr::printSelf(void) 
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
@@ -246,4 +1099,546 @@ void BufMgr::printSelf(void)
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
 }
 
+BufStats BufMgr::getBufStatsSnapshot()
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  BufStats snapshot = bufStats;
+  for (std::map<const File*, FileStats>::const_iterator it = fileStats.begin(); it != fileStats.end(); ++it)
+  {
+    FileStats& total = snapshot.files[it->first->filename()];
+    total.hits += it->second.hits;
+    total.misses += it->second.misses;
+    total.diskreads += it->second.diskreads;
+    total.diskwrites += it->second.diskwrites;
+  }
+  return snapshot;
+}
+
+void BufMgr::clearBufStats()
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  bufStats.clear();
+  fileStats.clear();
+}
+
+std::uint32_t BufMgr::saveResidency(const std::string& snapshotName)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  return writeResidency(snapshotName);
+}
+
+void BufMgr::saveResidencyOnShutdown(const std::string& snapshotName)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  shutdownSnapshot = snapshotName;
+}
+
+// Snapshot layout: the number of file names, the names (length followed by the characters), the number
+// of pages, then every page as the index of its file name followed by its page number, hottest first.
+std::uint32_t BufMgr::writeResidency(const std::string& snapshotName)
+{
+  std::vector<std::string> names;
+  std::map<const File*, std::uint32_t> nameIndex;
+  std::vector<std::uint32_t> entries;
+
+  // walk the frames backwards from the clock hand: referenced ones in the first round, the rest in the second
+  for (int round = 0; round < 2; round++)
+  {
+    for (std::uint32_t i = 0; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[(clockHand + numBufs - i) % numBufs]);
+      if (!tmpbuf->valid || tmpbuf->refbit != (round == 0))
+        continue;
+
+      std::map<const File*, std::uint32_t>::iterator it = nameIndex.find(tmpbuf->file);
+      if (it == nameIndex.end())
+      {
+        it = nameIndex.insert(std::make_pair(tmpbuf->file, (std::uint32_t) names.size())).first;
+        names.push_back(tmpbuf->file->filename());
+      }
+      entries.push_back(it->second);
+      entries.push_back(tmpbuf->pageNo);
+    }
+  }
+
+  std::ofstream out(snapshotName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  std::uint32_t count = names.size();
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (std::uint32_t i = 0; i < names.size(); i++)
+  {
+    std::uint32_t length = names[i].size();
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(names[i].data(), length);
+  }
+  count = entries.size() / 2;
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  if (!entries.empty())
+    out.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(std::uint32_t));
+
+  return count;
+}
+
+std::uint32_t BufMgr::warmUp(const std::string& snapshotName, const std::vector<File*>& files, const bool background)
+{
+  std::ifstream in(snapshotName.c_str(), std::ios::in | std::ios::binary);
+  if (!in)
+    throw FileNotFoundException(snapshotName);
+
+  // map the file names of the snapshot to the open files; pages of other files are skipped
+  std::uint32_t count = 0;
+  in.read(reinterpret_cast<char*>(&count), sizeof(count));
+  std::vector<File*> snapshotFiles;
+  for (std::uint32_t i = 0; i < count && in; i++)
+  {
+    std::uint32_t length = 0;
+    in.read(reinterpret_cast<char*>(&length), sizeof(length));
+    std::string name(length, '\0');
+    if (length > 0)
+      in.read(&name[0], length);
+
+    File* match = NULL;
+    for (std::uint32_t j = 0; j < files.size(); j++)
+    {
+      if (files[j]->filename() == name)
+        match = files[j];
+    }
+    snapshotFiles.push_back(match);
+  }
+
+  // take the hottest pages that fit, then sort them by file and page number
+  count = 0;
+  in.read(reinterpret_cast<char*>(&count), sizeof(count));
+  std::map<File*, std::vector<PageId> > pages;
+  std::uint32_t numPages = 0;
+  for (std::uint32_t i = 0; i < count && numPages < numBufs; i++)
+  {
+    std::uint32_t entry[2];
+    if (!in.read(reinterpret_cast<char*>(entry), sizeof(entry)))
+      break;
+    if (entry[0] >= snapshotFiles.size() || snapshotFiles[entry[0]] == NULL)
+      continue;
+
+    pages[snapshotFiles[entry[0]]].push_back(entry[1]);
+    numPages++;
+  }
+
+  for (std::map<File*, std::vector<PageId> >::iterator it = pages.begin(); it != pages.end(); ++it)
+    std::sort(it->second.begin(), it->second.end());
+
+  if (background)
+  {
+    for (std::map<File*, std::vector<PageId> >::iterator it = pages.begin(); it != pages.end(); ++it)
+      prefetch(it->first, it->second);
+    return numPages;
+  }
+
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  std::uint32_t loaded = 0;
+  for (std::map<File*, std::vector<PageId> >::iterator it = pages.begin(); it != pages.end(); ++it)
+  {
+    for (std::uint32_t i = 0; i < it->second.size(); i++)
+    {
+      FrameId frameNo = 0;
+      try
+      {
+        hashTable->lookup(it->first, it->second[i], frameNo);
+        continue;
+      }
+      catch(const HashNotFoundException &e)
+      {
+      }
+
+      // pages deleted since the snapshot was taken are simply not loaded
+      try
+      {
+        loadPage(it->first, it->second[i], frameNo, NULL);
+        // loadPage may hand back a frame another thread loaded meanwhile, which may be pinned by others
+        bufDescTable[frameNo].pinCnt--;
+        if (bufDescTable[frameNo].pinCnt == 0)
+          notifyFrameFree();
+        loaded++;
+      }
+      catch(const BadgerDbException &e)
+      {
+      }
+    }
+  }
+
+  return loaded;
+}
+
+void BufMgr::setVictimCache(const std::size_t budgetBytes)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  delete victimCache;
+  victimCache = budgetBytes > 0 ? new VictimCache(budgetBytes) : NULL;
+}
+
+VictimCacheStats BufMgr::getVictimCacheStats()
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  return victimCache != NULL ? victimCache->getStats() : VictimCacheStats();
+}
+
+void BufMgr::setAdmissionControl(const std::uint32_t waitMs)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  admissionWaitMs = waitMs;
+}
+
+void BufMgr::notifyFrameFree()
+{
+  if (frameWaiters > 0)
+    frameFreed.notify_all();
+}
+
+void BufMgr::startBgWriter(const BgWriterConfig& config)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+
+  if (bgWriter.joinable())
+    return;
+
+  bgWriterConfig = config;
+  bgWriterRunning = true;
+  bgWriter = std::thread(&BufMgr::bgWriterLoop, this);
+}
+
+void BufMgr::stopBgWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(bufMutex);
+    if (!bgWriter.joinable())
+      return;
+    bgWriterRunning = false;
+  }
+
+  bgWriterCond.notify_all();
+  bgWriter.join();
+}
+
+void BufMgr::bgWriterLoop()
+{
+  std::unique_lock<std::mutex> lock(bufMutex);
+
+  while (bgWriterRunning)
+  {
+    cleanAheadOfClock(lock);
+
+    // sleeping releases the lock so the foreground can make progress
+    bgWriterCond.wait_for(lock, std::chrono::milliseconds(bgWriterConfig.delayMs));
+  }
+}
+
+std::uint32_t BufMgr::cleanAheadOfClock(std::unique_lock<std::mutex>& lock)
+{
+  // collect dirty victims in the order the clock is going to reach them
+  std::vector<FrameId> victims;
+  std::uint32_t scanAhead = std::min(bgWriterConfig.scanAhead, numBufs);
+
+  for (std::uint32_t i = 1; i <= scanAhead && victims.size() < bgWriterConfig.maxPagesPerRound; i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[(clockHand + i) % numBufs]);
+    if (tmpbuf->valid && tmpbuf->dirty && tmpbuf->pinCnt == 0)
+      victims.push_back(tmpbuf->frameNo);
+  }
+
+  if (victims.empty())
+    return 0;
+
+  // write them file by file in page-number order
+  std::sort(victims.begin(), victims.end(), [this](FrameId a, FrameId b) {
+    const BufDesc& bufA = bufDescTable[a];
+    const BufDesc& bufB = bufDescTable[b];
+    if (bufA.file != bufB.file)
+      return std::less<File*>()(bufA.file, bufB.file);
+    return bufA.pageNo < bufB.pageNo;
+  });
+
+  // copy the pages, so that the latch need not be held while they are written
+  std::vector<Page> copies(victims.size());
+  std::vector<File*> files(victims.size());
+  std::vector<PageId> pageNos(victims.size());
+  std::vector<std::uint32_t> versions(victims.size());
+  for (std::uint32_t i = 0; i < victims.size(); i++)
+  {
+    copies[i] = bufPool[victims[i]];
+    files[i] = bufDescTable[victims[i]].file;
+    pageNos[i] = bufDescTable[victims[i]].pageNo;
+    versions[i] = frameTags[victims[i]].version.load(std::memory_order_relaxed);
+    fileIo[files[i]]++;
+  }
+
+  // every run of consecutive pages of a file goes out with one call
+  lock.unlock();
+  std::vector<bool> ok(victims.size(), false);
+  std::vector<std::uint64_t> runMicros;
+  std::uint32_t runStart = 0;
+  while (runStart < victims.size())
+  {
+    std::vector<const Page*> run(1, &copies[runStart]);
+    while (runStart + run.size() < victims.size()
+           && files[runStart + run.size()] == files[runStart]
+           && pageNos[runStart + run.size()] == pageNos[runStart] + run.size())
+      run.push_back(&copies[runStart + run.size()]);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try
+    {
+      files[runStart]->writePages(pageNos[runStart], run);
+      runMicros.push_back(elapsedMicros(start));
+      for (std::uint32_t i = runStart; i < runStart + run.size(); i++)
+        ok[i] = true;
+    }
+    catch(const BadgerDbException &e)
+    {
+      // the pages stay dirty and are written when they are evicted
+    }
+    runStart += run.size();
+  }
+  lock.lock();
+
+  for (std::uint32_t i = 0; i < runMicros.size(); i++)
+    bufStats.writeLatency.record(runMicros[i]);
+
+  // a frame is clean unless its page was replaced or dirtied again meanwhile
+  std::uint32_t count = 0;
+  for (std::uint32_t i = 0; i < victims.size(); i++)
+  {
+    File* file = files[i];
+    if (--fileIo[file] == 0)
+      fileIo.erase(file);
+    if (!ok[i])
+      continue;
+
+    bufStats.diskwrites++;
+    fileStats[file].diskwrites++;
+    count++;
+
+    BufDesc* tmpbuf = &(bufDescTable[victims[i]]);
+    if (tmpbuf->valid && tmpbuf->file == file && tmpbuf->pageNo == pageNos[i]
+        && frameTags[victims[i]].version.load(std::memory_order_relaxed) == versions[i])
+      tmpbuf->dirty = false;
+  }
+  fileIoDone.notify_all();
+
+  return count;
+}
+
+void BufMgr::prefetch(File* file, const std::vector<PageId>& pageIds, BufAccessStrategy* strategy)
+{
+  if (pageIds.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(bufMutex);
+
+    for (std::uint32_t i = 0; i < pageIds.size(); i++)
+    {
+      PrefetchRequest request = {file, pageIds[i], strategy};
+      prefetchQueue.push_back(request);
+    }
+
+    if (!prefetcher.joinable())
+    {
+      prefetcherRunning = true;
+      prefetcher = std::thread(&BufMgr::prefetcherLoop, this);
+    }
+  }
+
+  prefetchCond.notify_one();
+}
+
+void BufMgr::stopPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(bufMutex);
+    if (!prefetcher.joinable())
+      return;
+    prefetcherRunning = false;
+    prefetchQueue.clear();
+  }
+
+  prefetchCond.notify_all();
+  prefetcher.join();
+}
+
+void BufMgr::cancelPrefetch(const File* file)
+{
+  std::deque<PrefetchRequest>::iterator iter = prefetchQueue.begin();
+  while (iter != prefetchQueue.end())
+  {
+    if (iter->file == file)
+      iter = prefetchQueue.erase(iter);
+    else
+      ++iter;
+  }
+
+  waitForFileIo(file);
+}
+
+void BufMgr::waitForFileIo(const File* file)
+{
+  while (file == NULL ? !fileIo.empty() : fileIo.count(file) > 0)
+    fileIoDone.wait(bufMutex);
+}
+
+bool BufMgr::waitForPrefetchedPage(const File* file, const PageId pageNo)
+{
+  if (prefetchPages.empty())
+    return false;
+
+  bool waited = false;
+  while (prefetchPages.count(std::make_pair(file, pageNo)) > 0)
+  {
+    fileIoDone.wait(bufMutex);
+    waited = true;
+  }
+  return waited;
+}
+
+void BufMgr::prefetcherLoop()
+{
+  AsyncIo io;
+  std::unique_lock<std::mutex> lock(bufMutex);
+
+  while (prefetcherRunning)
+  {
+    if (prefetchQueue.empty())
+    {
+      prefetchCond.wait(lock);
+      continue;
+    }
+
+    prefetchBatch(io, lock);
+
+    // give the foreground a chance to get in between two batches
+    lock.unlock();
+    std::this_thread::yield();
+    lock.lock();
+  }
+}
+
+void BufMgr::prefetchBatch(AsyncIo& io, std::unique_lock<std::mutex>& lock)
+{
+  // frames taken for the batch stay pinned and unmapped until their page is in,
+  // so nobody else touches them while the latch is released for the reads
+  std::map<std::uint64_t, PrefetchRequest> reads;
+  std::map<std::uint64_t, FrameId> readFrames;
+  while (!prefetchQueue.empty() && reads.size() < PREFETCH_BATCH)
+  {
+    PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+
+    FrameId frameNo = 0;
+    try
+    {
+      hashTable->lookup(request.file, request.pageNo, frameNo);
+      continue;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+
+    bool queuedTwice = false;
+    for (std::map<std::uint64_t, PrefetchRequest>::iterator it = reads.begin(); it != reads.end(); ++it)
+    {
+      if (it->second.file == request.file && it->second.pageNo == request.pageNo)
+        queuedTwice = true;
+    }
+    if (queuedTwice)
+      continue;
+
+    // a page that cannot be loaded right now is simply not prefetched;
+    // the reader will run into the error itself if it asks for the page
+    try
+    {
+      if (! allocQuotaBuf(request.file, frameNo))
+        allocBuf(frameNo, request.strategy, false /* mayWait */);
+    }
+    catch(const BadgerDbException &e)
+    {
+      break;
+    }
+    // pinned, so that the clock passes it over for the rest of the batch
+    bufDescTable[frameNo].Set(request.file, request.pageNo);
+
+    if (victimCache != NULL && victimCache->take(request.file, request.pageNo, bufPool[frameNo]))
+    {
+      bufDescTable[frameNo].pinCnt = 0;
+      if (request.strategy != NULL)
+        bufDescTable[frameNo].refbit = false;
+      mapFrame(request.file, request.pageNo, frameNo);
+      continue;
+    }
+
+    std::uint64_t ticket = io.submitRead(request.file, request.pageNo, bufPool[frameNo]);
+    reads[ticket] = request;
+    readFrames[ticket] = frameNo;
+    fileIo[request.file]++;
+    prefetchPages[std::make_pair((const File*) request.file, request.pageNo)] = frameNo;
+  }
+
+  // publish the pages as their reads complete, so a reader waiting for one of them
+  // does not wait for the whole batch
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t pending = reads.size();
+  while (pending > 0)
+  {
+    std::vector<IoCompletion> done;
+    lock.unlock();
+    io.complete(done, 1);
+    std::uint64_t micros = elapsedMicros(start);
+    lock.lock();
+
+    for (std::size_t i = 0; i < done.size(); i++)
+    {
+      const PrefetchRequest& request = reads[done[i].ticket];
+      FrameId frameNo = readFrames[done[i].ticket];
+      prefetchPages.erase(std::make_pair((const File*) request.file, request.pageNo));
+      if (--fileIo[request.file] == 0)
+        fileIo.erase(request.file);
+
+      if (!done[i].ok)
+      {
+        bufDescTable[frameNo].Clear();
+        continue;
+      }
+
+      bufStats.readLatency.record(micros);
+      bufStats.diskreads++;
+      fileStats[request.file].diskreads++;
+
+      // a reader may have loaded the page itself while the latch was released
+      FrameId residentFrame = 0;
+      try
+      {
+        hashTable->lookup(request.file, request.pageNo, residentFrame);
+        bufDescTable[frameNo].Clear();
+        continue;
+      }
+      catch(const HashNotFoundException &e)
+      {
+      }
+
+      bufDescTable[frameNo].pinCnt = 0;
+      if (request.strategy != NULL)
+        bufDescTable[frameNo].refbit = false;
+      mapFrame(request.file, request.pageNo, frameNo);
+    }
+    pending -= std::min(pending, done.size());
+
+    fileIoDone.notify_all();
+    notifyFrameFree();
+  }
+}
+
 }
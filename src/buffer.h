@@ -9,10 +9,30 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "victimCache.h"
+#include "asyncIo.h"
 #include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 namespace badgerdb {
 
+/**
+* @brief Kind of memory pages backing the buffer pool
+*/
+enum BufPoolPages
+{
+  POOL_PAGES_DEFAULT = 0,          /* Regular pages of the operating system */
+  POOL_PAGES_TRANSPARENT_HUGE = 1, /* Regular mapping advised to use transparent huge pages */
+  POOL_PAGES_EXPLICIT_HUGE = 2     /* Mapping from the reserved 2 MB huge page pool, falls back to transparent huge pages */
+};
+
 /**
 * forward declaration of BufMgr class 
 */
@@ -46,6 +66,11 @@ class BufDesc {
 	 */
   int pinCnt;
 
+	/**
+   * Number of the pins which may modify the page, i.e. raw pins and GUARD_WRITE guards
+	 */
+  int writeCnt;
+
 	/**
    * True if page is dirty;  false otherwise
 	 */
@@ -67,6 +92,7 @@ class BufDesc {
   void Clear()
 	{
     pinCnt = 0;
+    writeCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
@@ -86,6 +112,7 @@ class BufDesc {
 		file = filePtr;
     pageNo = pageNum;
     pinCnt = 1;
+    writeCnt = 0;
     dirty = false;
     valid = true;
     refbit = true;
@@ -117,18 +144,101 @@ class BufDesc {
 };
 
 
+/**
+* @brief Histogram of I/O latencies with power-of-two microsecond buckets
+*/
+struct LatencyHistogram
+{
+	/**
+   * Number of buckets. Bucket i counts the operations that took less than 2^i microseconds
+	 * (and at least 2^(i-1)), the last one everything slower.
+	 */
+  static const std::uint32_t NUM_BUCKETS = 24;
+
+	/**
+   * Operation counts per latency bucket
+	 */
+  std::uint64_t buckets[NUM_BUCKETS];
+
+	/**
+   * Number of operations recorded
+	 */
+  std::uint64_t count;
+
+	/**
+   * Sum of the latencies recorded, in microseconds
+	 */
+  std::uint64_t totalMicros;
+
+	/**
+   * Records one operation
+	 *
+	 * @param micros	Latency of the operation in microseconds
+	 */
+  void record(const std::uint64_t micros);
+
+	/**
+   * Clear all values 
+	 */
+  void clear();
+
+	/**
+   * Constructor of LatencyHistogram class 
+	 */
+  LatencyHistogram()
+  {
+		clear();
+  }
+};
+
+
+/**
+* @brief Buffer pool statistics of one file
+*/
+struct FileStats
+{
+	/**
+   * Number of page requests served from the buffer pool
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Number of page requests that had to read the page from disk
+	 */
+  std::uint64_t misses;
+
+	/**
+   * Number of pages read from disk, including prefetched ones
+	 */
+  std::uint64_t diskreads;
+
+	/**
+   * Number of pages written back to disk
+	 */
+  std::uint64_t diskwrites;
+
+	/**
+   * Constructor of FileStats class 
+	 */
+  FileStats()
+		: hits(0), misses(0), diskreads(0), diskwrites(0)
+  {
+  }
+};
+
+
 /**
 * @brief Class to maintain statistics of buffer usage 
 */
 struct BufStats
 {
 	/**
-   * Total number of accesses to buffer pool
+   * Total number of accesses to buffer pool (page reads and allocations)
 	 */
   int accesses;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Number of pages read from disk (including prefetched ones)
 	 */
   int diskreads;
 
@@ -137,13 +247,86 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of page reads served from the buffer pool
+	 */
+  int hits;
+
+	/**
+   * Number of page reads that had to go to disk
+	 */
+  int misses;
+
+	/**
+   * Number of pages evicted without having to be written
+	 */
+  int cleanEvictions;
+
+	/**
+   * Number of pages written back in order to be evicted
+	 */
+  int dirtyEvictions;
+
+	/**
+   * Number of requests that failed because every candidate frame was pinned or the caller was over its pin budget
+	 */
+  int pinFailures;
+
+	/**
+   * Number of times a request waited for a pin to be released, see BufMgr::setAdmissionControl()
+	 */
+  int admissionWaits;
+
+	/**
+   * Total number of frames the clock hand passed looking for victims
+	 */
+  std::uint64_t clockSweep;
+
+	/**
+   * Largest number of frames the clock hand passed to find a single victim
+	 */
+  std::uint32_t maxClockSweep;
+
+	/**
+   * Latencies of page reads
+	 */
+  LatencyHistogram readLatency;
+
+	/**
+   * Latencies of write calls, one sample per call however many consecutive pages it wrote
+	 */
+  LatencyHistogram writeLatency;
+
+	/**
+   * Statistics per file name. Only filled in by BufMgr::getBufStatsSnapshot() and for files
+	 * that have been flushed.
+	 */
+  std::map<std::string, FileStats> files;
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
 		accesses = diskreads = diskwrites = 0;
+		hits = misses = 0;
+		cleanEvictions = dirtyEvictions = pinFailures = admissionWaits = 0;
+		clockSweep = 0;
+		maxClockSweep = 0;
+		readLatency.clear();
+		writeLatency.clear();
+		files.clear();
   }
+
+	/**
+   * Returns the statistics as a JSON object
+	 */
+  std::string toJson() const;
+
+	/**
+   * Returns the statistics as human readable text, one value per line
+	 */
+  std::string toText() const;
       
 	/**
    * Constructor of BufStats class 
@@ -156,139 +339,1083 @@ struct BufStats
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief Settings of the background writer which pre-cleans dirty frames ahead of the clock hand
 */
-class BufMgr 
+struct BgWriterConfig
 {
- private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Milliseconds the writer sleeps between two rounds
 	 */
-  FrameId clockHand;
+  std::uint32_t delayMs;
 
 	/**
-   * Number of frames in the buffer pool
+   * Maximum number of pages written per round. Together with delayMs this bounds the write rate.
 	 */
-  std::uint32_t numBufs;
-	
+  std::uint32_t maxPagesPerRound;
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Number of frames ahead of the clock hand that are inspected every round
 	 */
-  BufHashTbl *hashTable;
+  std::uint32_t scanAhead;
 
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+   * Constructor of BgWriterConfig class
 	 */
-  BufDesc *bufDescTable;
+  BgWriterConfig()
+		: delayMs(200), maxPagesPerRound(100), scanAhead(1024)
+  {
+  }
+};
+
+
+/**
+* @brief Access strategy which confines a large sequential scan to a small private ring of frames
+*
+* A scan reading through a BufAccessStrategy recycles the frames of its own ring instead of
+* pulling fresh victims off the clock for every page, so a full-relation scan does not evict
+* the rest of the buffer pool. A ring frame is only recycled if it is unpinned and nobody else
+* has referenced it since; otherwise a new frame is taken from the clock and joins the ring.
+*/
+class BufAccessStrategy
+{
+	friend class BufMgr;
 
+ public:
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Default number of frames in the ring of a bulk-read strategy
 	 */
-  BufStats bufStats;
+  static const std::uint32_t BULKREAD_RING_SIZE = 16;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Constructor of BufAccessStrategy class
+	 *
+	 * @param ringSize	Number of frames the strategy may cycle through
+	 * @param pinBudget	Most pages the caller may have pinned through the strategy at a time, 0 for no limit.
+	 *									Keeps a single scan from pinning the whole pool.
 	 */
-  void advanceClock()
+  BufAccessStrategy(std::uint32_t ringSize = BULKREAD_RING_SIZE, std::uint32_t pinBudget = 0)
+		: ringSize(ringSize > 0 ? ringSize : 1), current(0), pinBudget(pinBudget), pins(0)
   {
-		clockHand = (clockHand + 1) % numBufs;
   }
 
 	/**
-	 * Allocate a free frame.  
-	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
-	 * @throws BufferExceededException If no such buffer is found which can be allocated
+   * Get the number of pages currently pinned through the strategy
 	 */
-  void allocBuf(FrameId & frame);
+  std::uint32_t getPins() const
+  {
+		return pins;
+  }
 
- public:
+ private:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Maximum number of frames in the ring
 	 */
-  Page* bufPool;
+  std::uint32_t ringSize;
 
 	/**
-   * Constructor of BufMgr class
+   * Frames currently belonging to the ring
 	 */
-  BufMgr(std::uint32_t bufs);
-	
+  std::vector<FrameId> ring;
+
 	/**
-   * Destructor of BufMgr class
+   * Position in the ring of the next frame to recycle
 	 */
-  ~BufMgr();
+  std::uint32_t current;
 
 	/**
-	 * Reads the given page from the file into a frame and returns the pointer to page.
-	 * If the requested page is already present in the buffer pool pointer to that frame is returned
-	 * otherwise a new frame is allocated from the buffer pool for reading the page.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number in the file to be read
-	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * Most pages that may be pinned through the strategy at a time, 0 for no limit
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  std::uint32_t pinBudget;
 
 	/**
-	 * Unpin a page from memory since it is no longer required for it to remain in memory.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
-	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
-   * @throws  PageNotPinnedException If the page is not already pinned
+   * Pages currently pinned through the strategy; pages must be unpinned with the strategy they were read with
 	 */
-  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+  std::uint32_t pins;
+};
 
+
+/**
+* @brief A page queued for the background prefetcher
+*/
+struct PrefetchRequest
+{
 	/**
-	 * Allocates a new, empty page in the file and returns the Page object.
-	 * The newly allocated page is also assigned a frame in the buffer pool.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
-	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+   * File the page belongs to
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  File* file;
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
-	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
-	 *
-	 * @param file   	File object
-   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
-   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * Page number in the file
 	 */
-  void flushFile(const File* file);
+  PageId pageNo;
 
 	/**
-	 * Delete page from file and also from buffer pool if present.
-	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
+   * Access strategy the page is to be loaded with, NULL for the shared pool
 	 */
-  void disposePage(File* file, const PageId PageNo);
+  BufAccessStrategy* strategy;
+};
 
+
+/**
+* @brief State of an optimistic read of a page, see BufMgr::beginOptimisticRead()
+*/
+struct OptimisticRead
+{
 	/**
-   * Print member variable values. 
+   * Frame holding the page
 	 */
-  void  printSelf();
+  FrameId frameNo;
 
 	/**
-   * Get buffer pool usage statistics
+   * Version of the frame when the read began
 	 */
-  BufStats & getBufStats()
-  {
-		return bufStats;
-  }
+  std::uint32_t version;
 
 	/**
-   * Clear buffer pool usage statistics
+   * The page in the buffer pool; its contents are only to be trusted once the read has been validated
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  const Page* page;
+
+	/**
+   * True from a successful BufMgr::beginOptimisticRead() until the read is validated
+	 */
+  bool active;
+};
+
+
+/**
+* @brief Page held by a frame and version of the frame, as seen by optimistic reads without the latch
+*
+* The version is odd while the frame is in flux, i.e. while it holds no page or is pinned by someone who
+* may modify the page, and grows whenever the frame gets another page or its page may have changed.
+* The tag is written under the latch before the version turns even.
+*/
+struct FrameTag
+{
+	/**
+   * Version of the frame
+	 */
+  std::atomic<std::uint32_t> version;
+
+	/**
+   * File of the page held, NULL for none
+	 */
+  std::atomic<const File*> file;
+
+	/**
+   * Page number of the page held
+	 */
+  std::atomic<PageId> pageNo;
+};
+
+
+/**
+* @brief How a page held by a PageGuard is going to be used
+*/
+enum PageGuardMode
+{
+	/**
+   * The page is only read, it is unpinned clean unless marked dirty
+	 */
+  GUARD_READ,
+
+	/**
+   * The page is modified, it is unpinned dirty
+	 */
+  GUARD_WRITE
+};
+
+
+/**
+* @brief Keeps a page pinned in the buffer pool for as long as the guard lives.
+* The guard remembers the frame of the page, so unpinning needs no hash table lookup, and it unpins the
+* page when it goes out of scope, so error paths cannot leak pins. Guards can be moved but not copied.
+*/
+class PageGuard
+{
+	friend class BufMgr;
+
+ private:
+	/**
+   * Buffer manager the page is pinned in, NULL for an empty guard
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Frame holding the page
+	 */
+  FrameId frameNo;
+
+	/**
+   * Page number in the file
+	 */
+  PageId pageNo;
+
+	/**
+   * The page in the buffer pool
+	 */
+  Page* page;
+
+	/**
+   * True if the page is to be unpinned dirty
+	 */
+  bool dirty;
+
+	/**
+   * True if the page may be modified through the guard, which keeps optimistic reads of it from validating
+	 */
+  bool writing;
+
+	/**
+   * Access strategy the page was pinned through, NULL for none
+	 */
+  BufAccessStrategy* strategy;
+
+	/**
+   * Constructor used by BufMgr for a page it has just pinned
+	 */
+  PageGuard(BufMgr* bufMgr, const FrameId frameNo, const PageId pageNo, Page* page, const PageGuardMode mode,
+						BufAccessStrategy* strategy);
+
+  PageGuard(const PageGuard&) = delete;
+  PageGuard& operator=(const PageGuard&) = delete;
+
+ public:
+	/**
+   * Constructs an empty guard holding no page
+	 */
+  PageGuard();
+
+	/**
+   * Takes over the page of another guard, which is left empty
+	 */
+  PageGuard(PageGuard&& other);
+
+	/**
+   * Unpins the page held so far and takes over the page of another guard, which is left empty
+	 */
+  PageGuard& operator=(PageGuard&& other);
+
+	/**
+   * Unpins the page, if the guard still holds one
+	 */
+  ~PageGuard();
+
+	/**
+   * Get the page held by the guard, NULL for an empty guard
+	 */
+  Page* getPage() const
+  {
+		return page;
+  }
+
+	/**
+   * Get the page number of the page held by the guard
+	 */
+  PageId getPageNo() const
+  {
+		return pageNo;
+  }
+
+	/**
+   * Returns true if the guard holds a page
+	 */
+  bool holdsPage() const
+  {
+		return bufMgr != NULL;
+  }
+
+	/**
+   * Makes the page be unpinned dirty, for a page read with GUARD_READ that is going to be modified after all.
+	 * Called before the page is modified, so that optimistic reads of it fail meanwhile.
+	 */
+  void markDirty();
+
+	/**
+	 * Unpins the page now instead of when the guard goes out of scope. Does nothing for an empty guard.
+	 *
+	 * @param modified	True to unpin the page dirty whatever the mode of the guard
+	 */
+  void release(const bool modified = false);
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*/
+class BufMgr 
+{
+ private:
+	/**
+   * Current position of clockhand in our buffer pool
+	 */
+  FrameId clockHand;
+
+	/**
+   * Number of frames in the buffer pool
+	 */
+  std::uint32_t numBufs;
+	
+	/**
+   * Size in bytes of the memory mapping holding the buffer pool
+	 */
+  std::size_t poolBytes;
+
+	/**
+   * Kind of pages actually backing the buffer pool
+	 */
+  BufPoolPages poolPages;
+
+	/**
+	 * Maps an anonymous, page-aligned memory region large enough for the given number of frames.
+	 * The frames are not initialized; the kernel hands out zeroed memory on first touch and a frame
+	 * is only filled when a page is read into it or allocated in it.
+	 *
+	 * @param bufs   	Number of frames
+	 * @param pages   Kind of pages requested; the kind actually used is returned via this variable
+	 * @param bytes   Size of the mapping is returned via this variable
+	 * @return 				Start of the mapping
+	 * @throws std::bad_alloc If the memory cannot be mapped
+	 */
+  static Page* allocPoolMemory(const std::uint32_t bufs, BufPoolPages& pages, std::size_t& bytes);
+
+	/**
+	 * Unmaps memory obtained from allocPoolMemory().
+	 *
+	 * @param pool   	Start of the mapping
+	 * @param bytes   Size of the mapping
+	 */
+  static void freePoolMemory(Page* pool, const std::size_t bytes);
+
+	/**
+	 * Returns the number of buckets of the hash table for a pool of the given size.
+	 *
+	 * @param bufs   	Number of frames
+	 */
+  static int hashTableSize(const std::uint32_t bufs);
+
+	/**
+   * Hash table mapping (File, page) to frame
+	 */
+  BufHashTbl *hashTable;
+
+	/**
+   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+	 */
+  BufDesc *bufDescTable;
+
+	/**
+   * Page and version of every frame, read without the latch by optimistic reads
+	 */
+  FrameTag *frameTags;
+
+	/**
+   * Frame most recently given to each page hashing to a slot plus one, 0 for none. Lets optimistic reads
+	 * find a page without the hash table; a page whose slot has been taken over by another one is just not
+	 * found.
+	 */
+  std::atomic<FrameId> *frameHints;
+
+	/**
+   * Number of slots of frameHints
+	 */
+  std::uint32_t numHints;
+
+	/**
+   * Number of optimistic reads begun and not validated yet
+	 */
+  std::atomic<std::uint32_t> optimisticReaders;
+
+	/**
+   * True while resize() frees the frame tags or moves the pool, which keeps new optimistic reads from
+	 * beginning
+	 */
+  std::atomic<bool> optimisticReadsClosed;
+
+	/**
+   * Returns the slot of frameHints of the given page.
+	 */
+  std::uint32_t hintSlot(const File* file, const PageId pageNo) const
+  {
+		return (reinterpret_cast<std::uintptr_t>(file) ^ ((std::uintptr_t) pageNo * 0x9e3779b1u)) % numHints;
+  }
+
+	/**
+   * Bumps the version of a frame, keeping it odd or even, invalidating optimistic reads of it. Assumes the
+	 * latch is held.
+	 */
+  void bumpVersion(const FrameId frameNo)
+  {
+		frameTags[frameNo].version.fetch_add(2, std::memory_order_release);
+  }
+
+	/**
+   * Turns the version of a frame odd if the frame is in flux and even, and newer, if it is not.
+	 * Assumes the latch is held.
+	 */
+  void syncVersion(const FrameId frameNo);
+
+	/**
+   * Records a pin of the frame which may modify the page. Assumes the latch is held.
+	 */
+  void beginWrite(const FrameId frameNo);
+
+	/**
+   * Records the end of a pin of the frame which may have modified the page. Assumes the latch is held.
+	 */
+  void endWrite(const FrameId frameNo);
+
+	/**
+   * Publishes the page a frame holds to optimistic reads. Assumes the latch is held.
+	 */
+  void tagFrame(const File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+   * Withdraws the page a frame holds from optimistic reads. Assumes the latch is held.
+	 */
+  void untagFrame(const FrameId frameNo);
+
+	/**
+   * Allocates the tags and hints of a pool of the given size, carrying over those of the first frames.
+	 * Assumes the latch is held.
+	 */
+  void allocTags(const std::uint32_t bufs);
+
+  typedef std::map<PageId, FrameId> PageFrameMap;
+  typedef std::map<const File*, PageFrameMap> FileFrameMap;
+
+	/**
+   * Frames assigned to every file, keyed by page number, so that a file can be flushed
+	 * without walking the whole frame table
+	 */
+  FileFrameMap fileFrames;
+
+	/**
+   * Registers a frame as holding the given page, in the hash table and in the frames of the file.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame holding the page
+	 */
+  void mapFrame(File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+   * Forgets the frame holding the given page, in the hash table and in the frames of the file.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+   * @throws HashNotFoundException if the page is not in the buffer pool
+	 */
+  void unmapFrame(const File* file, const PageId pageNo);
+
+	/**
+   * Frame quotas of files, keyed by file name
+	 */
+  std::map<std::string, std::uint32_t> fileQuotas;
+
+	/**
+	 * Takes a frame for a new page of the given file from the file's own frames if the file has used up
+	 * its quota, picking the victim with the clock's second-chance rule among the file's pages.
+	 *
+	 * @param file   	File the new page belongs to
+	 * @param frame   Frame reference, frame ID of the freed frame returned via this variable
+	 * @return true if a frame of the file was freed, false if the file is within its quota
+	 * @throws BufferExceededException If all frames of the file are pinned
+	 */
+  bool allocQuotaBuf(const File* file, FrameId& frame);
+
+	/**
+	 * Pins the given page, reading it into a frame if it is not resident. Assumes the latch is held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param strategy	Access strategy to read the page with
+	 * @return Frame holding the page
+	 */
+  FrameId pinPage(File* file, const PageId pageNo, BufAccessStrategy* strategy);
+
+	/**
+	 * Allocates a new page in the file into a frame and pins it. Assumes the latch is held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  The number assigned to the page in the file is returned via this reference
+	 * @return Frame holding the page
+	 */
+  FrameId pinNewPage(File* file, PageId& pageNo);
+
+	/**
+	 * Unpins the page held by a frame, as done by PageGuard. Pages stay in their frame while they are
+	 * pinned, so no lookup is needed.
+	 *
+	 * @param frameNo Frame holding the page
+	 * @param dirty		True if the page is to be marked dirty
+	 * @param writing	True if the pin may have modified the page
+	 * @param strategy	Access strategy the page was pinned through, NULL for none
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty, const bool writing, BufAccessStrategy* strategy);
+
+	/**
+	 * Wakes up the requests waiting for a frame, after a frame may have become available.
+	 */
+  void notifyFrameFree();
+
+	/**
+   * Signalled when a pin is released while requests are waiting for a frame. Waits on bufMutex itself,
+	 * which the public methods hold through a lock_guard.
+	 */
+  std::condition_variable_any frameFreed;
+
+	/**
+   * Number of requests waiting for a frame
+	 */
+  std::uint32_t frameWaiters;
+
+	/**
+   * Milliseconds a request waits for a frame when every frame is pinned, 0 to fail right away
+	 */
+  std::uint32_t admissionWaitMs;
+
+	/**
+	 * Runs the clock to find a frame to replace, leaving the clock hand on it.
+	 *
+	 * @return false if every frame is pinned
+	 */
+  bool runClock();
+
+	friend class PageGuard;
+
+	/**
+   * Writes out the dirty ones among the given frames of a file in page-number order, every run of
+	 * consecutive page numbers with a single File::writePages() call, and marks them clean.
+	 *
+	 * @param pages   Frames of the file keyed by page number
+	 */
+  void writeDirtyPages(const PageFrameMap& pages);
+
+	/**
+   * Writes a run of consecutive pages of a file with a single call, timing and counting the write.
+	 *
+	 * @param file   	File object
+	 * @param first  	Page number of the first page of the run
+	 * @param pages  	Pages of the run
+	 */
+  void writeRun(File* file, const PageId first, const std::vector<const Page*>& pages);
+
+	/**
+   * Writes the page held by a frame back to disk, timing and counting the write, and marks it clean.
+	 *
+	 * @param buf   	Descriptor of the frame
+	 */
+  void writeFrame(BufDesc* buf);
+
+	/**
+   * Evicts the page held by a valid, unpinned frame, writing it back first if it is dirty.
+	 *
+	 * @param buf   	Descriptor of the frame
+	 */
+  void evictFrame(BufDesc* buf);
+
+	/**
+   * Writes the resident pages to a snapshot file, assumes the latch is held.
+	 */
+  std::uint32_t writeResidency(const std::string& snapshotName);
+
+	/**
+   * Name of the snapshot file the destructor saves the resident pages to, empty for none
+	 */
+  std::string shutdownSnapshot;
+
+	/**
+   * Compressed copies of evicted pages, NULL if the victim cache is disabled
+	 */
+  VictimCache* victimCache;
+
+	/**
+   * Maintains Buffer pool usage statistics 
+	 */
+  BufStats bufStats;
+
+	/**
+   * Statistics of the files currently open in the buffer pool. They move into bufStats.files,
+	 * keyed by file name, when the file is flushed.
+	 */
+  std::map<const File*, FileStats> fileStats;
+
+	/**
+   * Moves the statistics of a file being flushed into bufStats.files, as the file object may go away.
+	 *
+	 * @param file   	File object
+	 */
+  void retireFileStats(const File* file);
+
+	/**
+   * Serializes access to the frame table, the hash table and the file I/O they trigger,
+	 * between the callers of the public interface and the background threads. The prefetcher
+	 * and the background writer release it while their I/O is in flight.
+	 */
+  std::mutex bufMutex;
+
+	/**
+   * Background writer thread, only joinable while the writer is running
+	 */
+  std::thread bgWriter;
+
+	/**
+   * Settings the background writer was started with
+	 */
+  BgWriterConfig bgWriterConfig;
+
+	/**
+   * True until the background writer is asked to stop
+	 */
+  bool bgWriterRunning;
+
+	/**
+   * Wakes the background writer up early when it has to stop
+	 */
+  std::condition_variable bgWriterCond;
+
+	/**
+   * Main loop of the background writer thread
+	 */
+  void bgWriterLoop();
+
+	/**
+   * Writes out dirty, unpinned frames lying ahead of the clock hand so that allocBuf finds
+	 * clean victims. Frames are written in file and page-number order, from copies taken under
+	 * the latch, which is released for the writes. A frame is marked clean afterwards only if it
+	 * still holds the same page and has not been dirtied again meanwhile.
+	 * Must be called with bufMutex held.
+	 *
+	 * @param lock  Lock the background writer holds on bufMutex
+	 * @return 				Number of pages written
+	 */
+  std::uint32_t cleanAheadOfClock(std::unique_lock<std::mutex>& lock);
+
+	/**
+   * Pages waiting to be loaded by the prefetcher, in request order
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Prefetcher thread, started by the first call to prefetch()
+	 */
+  std::thread prefetcher;
+
+	/**
+   * True until the prefetcher is asked to stop
+	 */
+  bool prefetcherRunning;
+
+	/**
+   * Wakes the prefetcher up when requests are queued or when it has to stop
+	 */
+  std::condition_variable prefetchCond;
+
+	/**
+   * Main loop of the prefetcher thread
+	 */
+  void prefetcherLoop();
+
+	/**
+   * Loads a batch of queued prefetch requests, reading the pages that are neither resident nor in the
+	 * victim cache with one submission to the I/O engine. Frames are claimed under the latch, which is
+	 * released while the reads are in flight and taken again to publish each page as its read completes.
+	 *
+	 * @param io   	I/O engine of the prefetcher
+	 * @param lock  Lock the prefetcher holds on bufMutex
+	 */
+  void prefetchBatch(AsyncIo& io, std::unique_lock<std::mutex>& lock);
+
+	/**
+   * Number of reads of the prefetcher and writes of the background writer in flight for every file,
+	 * which run without the latch. Frames being read are pinned and not in the hash table yet, so
+	 * nobody but the prefetcher touches them; pages being written are copies.
+	 */
+  std::map<const File*, std::uint32_t> fileIo;
+
+	/**
+   * Pages whose prefetch read is in flight, so that a reader asking for one waits for it instead of
+	 * reading it a second time
+	 */
+  std::map<std::pair<const File*, PageId>, FrameId> prefetchPages;
+
+	/**
+   * Signalled when the prefetcher has published pages or the background writer has finished a round.
+	 * Waits on bufMutex itself.
+	 */
+  std::condition_variable_any fileIoDone;
+
+	/**
+   * Waits until no read or write running without the latch is in flight for the given file, or for
+	 * any file if NULL. Must be called with bufMutex held, which is released while waiting.
+	 *
+	 * @param file   	File object, NULL for all files
+	 */
+  void waitForFileIo(const File* file);
+
+	/**
+   * Waits for the prefetch read of the given page if one is in flight.
+	 * Must be called with bufMutex held, which is released while waiting.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return true if the page was being prefetched
+	 */
+  bool waitForPrefetchedPage(const File* file, const PageId pageNo);
+
+	/**
+   * Stops the prefetcher thread, dropping all queued requests
+	 */
+  void stopPrefetcher();
+
+	/**
+   * Drops all queued prefetch requests for the given file and waits for its reads and writes in flight.
+	 * Must be called with bufMutex held.
+	 *
+	 * @param file   	File object
+	 */
+  void cancelPrefetch(const File* file);
+
+	/**
+	 * Allocates a frame for a page which is not in the buffer pool, reads the page into it and
+	 * registers it in the hash table. The page is returned pinned once.
+	 * Must be called with bufMutex held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame the page was loaded into is returned via this variable
+	 * @param strategy	Access strategy of the caller, NULL for normal access
+	 */
+  void loadPage(File* file, const PageId pageNo, FrameId& frameNo, BufAccessStrategy* strategy);
+
+	/**
+   * Advance clock to next frame in the buffer pool
+	 */
+  void advanceClock()
+  {
+		clockHand = (clockHand + 1) % numBufs;
+  }
+
+	/**
+	 * Allocate a free frame.  
+	 * If an access strategy is given, the oldest frame of its ring is recycled when possible and
+	 * any frame taken from the clock is added to the ring.
+	 * If every frame is pinned, waits for a pin to be released as long as admission control allows,
+	 * releasing the latch meanwhile.
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param strategy	Access strategy of the caller, NULL for normal access
+	 * @param mayWait		False to fail right away instead of waiting, for callers that must keep the latch
+	 * @return true if the latch was released while waiting, so the pool may have changed meanwhile
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  bool allocBuf(FrameId & frame, BufAccessStrategy* strategy = NULL, bool mayWait = true);
+
+ public:
+	/**
+   * Actual buffer pool from which frames are allocated
+	 */
+  Page* bufPool;
+
+	/**
+   * Size of a huge page used to back the buffer pool
+	 */
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	/**
+   * Largest number of pages the prefetcher reads with one submission
+	 */
+  static const std::uint32_t PREFETCH_BATCH = 16;
+
+	/**
+   * Constructor of BufMgr class.
+	 * The pool is a single page-aligned memory mapping whose frames are initialized lazily, so
+	 * start-up time does not grow with the pool size.
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param pages   Kind of memory pages backing the pool. Huge pages cut TLB misses for large pools.
+	 * @param maxBufs Number of frames to reserve address space for, so that resize() can grow the pool
+	 *								up to this size in place. Reserved frames take no memory until they are used.
+	 */
+  BufMgr(std::uint32_t bufs, BufPoolPages pages = POOL_PAGES_DEFAULT, std::uint32_t maxBufs = 0);
+	
+	/**
+   * Destructor of BufMgr class
+	 */
+  ~BufMgr();
+
+	/**
+	 * Reads the given page from the file into a frame and returns the pointer to page.
+	 * If the requested page is already present in the buffer pool pointer to that frame is returned
+	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy	Access strategy to read the page with. NULL reads through the shared pool; a bulk-read
+	 *									strategy keeps the page within the ring of the strategy and does not mark it as referenced.
+	 *									The page counts against the pin budget of the strategy until it is unpinned with it.
+   * @throws  BufferExceededException If no frame can be had, or the strategy is over its pin budget
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Reads the given page from the file into a frame like readPage() above, and returns a guard which
+	 * keeps it pinned until the guard goes out of scope or is released.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param mode   	GUARD_WRITE if the page is going to be modified, so that it is unpinned dirty
+	 * @param strategy	Access strategy to read the page with, as for readPage() above
+	 * @return Guard holding the pinned page
+	 */
+  PageGuard readPage(File* file, const PageId PageNo, const PageGuardMode mode = GUARD_READ,
+										 BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Begins reading the given page without pinning it. The page can be read through read.page as long as
+	 * it stays resident, which validateOptimisticRead() checks afterwards: whatever was read is only valid
+	 * if the validation succeeds, and must be discarded otherwise. Takes no latch and writes no shared
+	 * state, so read-mostly paths such as index descents skip the pin count updates and hash table lookups
+	 * of readPage() and unPinPage(); optimistic reads are neither counted in the statistics nor mark the page
+	 * as referenced. A page pinned with readPage() or allocPage() returning a Page pointer or with a
+	 * GUARD_WRITE guard is in flux until it is unpinned, and cannot be read optimistically meanwhile.
+	 * A read begun successfully must be ended by validateOptimisticRead(); resize() waits for the reads
+	 * under way and no read begins while it runs, so a thread must not resize the pool in the middle of a
+	 * read of its own.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param read   	Filled in with the state of the read
+	 * @return false if the page is not resident, or not found without the latch, or in flux; the caller
+	 *				 reads it with readPage() instead
+	 */
+  bool beginOptimisticRead(File* file, const PageId pageNo, OptimisticRead& read);
+
+	/**
+	 * Checks that the page of an optimistic read has been neither replaced nor modified, nor pinned for
+	 * writing, since the read began, and ends the read. Does not take the buffer pool latch.
+	 *
+	 * @param read   	State of the read
+	 * @return true if what was read is valid; false for a read that has ended already
+	 */
+  bool validateOptimisticRead(OptimisticRead& read)
+  {
+		if (!read.active)
+			return false;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const bool valid = frameTags[read.frameNo].version.load(std::memory_order_relaxed) == read.version;
+		read.active = false;
+		optimisticReaders.fetch_sub(1, std::memory_order_release);
+		return valid;
+  }
+
+	/**
+	 * Asks for the given pages to be loaded into the buffer pool in the background, in the given order.
+	 * The call returns immediately; a background thread reads every page that is not yet resident into
+	 * an unpinned frame, so that a later readPage() finds it in the pool. Pages that cannot be loaded
+	 * (e.g. because every frame is pinned) are silently skipped. Requests still queued for a file are
+	 * dropped by flushFile().
+	 *
+	 * @param file   	File object
+	 * @param pageIds Page numbers in the file to load
+	 * @param strategy	Access strategy to load the pages with, NULL for the shared pool. The strategy
+	 *									must stay alive until the file has been flushed.
+	 */
+  void prefetch(File* file, const std::vector<PageId>& pageIds, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
+	 * @param strategy	Access strategy the page was read with, so that it counts against its pin budget no more
+   * @throws  PageNotPinnedException If the page is not already pinned
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Allocates a new, empty page in the file and returns the Page object.
+	 * The newly allocated page is also assigned a frame in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page); 
+
+	/**
+	 * Allocates a new, empty page in the file like allocPage() above, and returns a GUARD_WRITE guard
+	 * which keeps it pinned until the guard goes out of scope or is released.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @return Guard holding the pinned page
+	 */
+  PageGuard allocPage(File* file, PageId &PageNo);
+
+	/**
+	 * Writes out all dirty pages of the file to disk and evicts the file from the buffer pool.
+	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
+	 * Otherwise Error returned and nothing is written.
+	 * Only the frames of this file are visited; dirty pages are written in page-number order and
+	 * consecutive pages are written together. The file header cached by the file is written as well.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Delete page from file and also from buffer pool if present.
+	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 * Reads and background writes of the file still in flight are waited for first, so none of them
+	 * lands after the delete.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Grows or shrinks the buffer pool while it is in use.
+	 * Growing adds empty frames; beyond the address space reserved at construction the pool may have to
+	 * move, which is only done if no page is pinned. Shrinking moves the pages of the cut off frames into
+	 * free frames below the new size as long as there are any, and evicts the rest, writing dirty pages out;
+	 * their memory is returned to the operating system. The hash table is resized along and rehashed
+	 * incrementally by later operations.
+	 *
+	 * @param newBufs	New number of frames
+   * @throws  PagePinnedException If a page that would have to be moved or evicted is pinned. The pool is left unchanged.
+   * @throws  std::bad_alloc If the pool cannot grow
+	 */
+  void resize(std::uint32_t newBufs);
+
+	/**
+	 * Limits the number of frames pages of the given file may occupy. Once the file has used up its quota
+	 * its new pages replace its own pages instead of those of other files, so a file scanned or written
+	 * in bulk cannot push everybody else out of the pool.
+	 * Frames already held beyond a lowered quota are given back as the file loads new pages.
+	 *
+	 * @param fileName	Name of the file
+	 * @param frames		Most frames the file may occupy, 0 to remove the quota
+	 */
+  void setFileQuota(const std::string& fileName, const std::uint32_t frames);
+
+	/**
+   * Get the number of frames in the buffer pool
+	 */
+  std::uint32_t getNumBufs() const
+  {
+		return numBufs;
+  }
+
+	/**
+   * Print member variable values. 
+	 */
+  void  printSelf();
+
+	/**
+	 * Turns admission control on or off. With admission control on, a request finding every frame pinned
+	 * waits up to the given time for a pin to be released instead of failing right away, so that
+	 * concurrent scans slow down rather than fail when the pool is momentarily full.
+	 *
+	 * @param waitMs	Most milliseconds to wait for a frame before throwing BufferExceededException, 0 to turn
+	 *								admission control off
+	 */
+  void setAdmissionControl(const std::uint32_t waitMs);
+
+	/**
+	 * Starts the background writer thread. It wakes up every config.delayMs milliseconds and writes up
+	 * to config.maxPagesPerRound dirty, unpinned frames found within config.scanAhead frames ahead of
+	 * the clock hand, so that page misses rarely have to write out a dirty victim themselves.
+	 * Does nothing if the writer is already running.
+	 *
+	 * @param config	Settings of the writer
+	 */
+  void startBgWriter(const BgWriterConfig& config = BgWriterConfig());
+
+	/**
+	 * Stops the background writer thread and waits for it to finish its current round.
+	 * Does nothing if the writer is not running.
+	 */
+  void stopBgWriter();
+
+	/**
+	 * Saves the list of pages resident in the buffer pool to a snapshot file, so that a later buffer manager
+	 * can warm up from it with warmUp(). Pages are listed hottest first: referenced pages before the others,
+	 * each group in the order the clock hand last allocated them, most recent first.
+	 *
+	 * @param snapshotName	Name of the snapshot file, overwritten if it exists
+	 * @return Number of pages saved
+	 */
+  std::uint32_t saveResidency(const std::string& snapshotName);
+
+	/**
+	 * Makes the destructor save the resident pages to a snapshot file with saveResidency() before the pool
+	 * goes away.
+	 *
+	 * @param snapshotName	Name of the snapshot file, empty to save nothing
+	 */
+  void saveResidencyOnShutdown(const std::string& snapshotName);
+
+	/**
+	 * Loads the pages listed in a snapshot file written by saveResidency() into the buffer pool. Only pages
+	 * of the given files are loaded, and no more than fit into the pool, hottest first. They are read file
+	 * by file in page-number order, so that the reads are sequential, into unpinned frames.
+	 *
+	 * @param snapshotName	Name of the snapshot file
+	 * @param files   			Open files to load pages of, matched by file name
+	 * @param background   	True to hand the pages to the prefetcher and return right away
+	 * @return Number of pages loaded, or queued for loading
+   * @throws  FileNotFoundException If the snapshot file does not exist
+	 */
+  std::uint32_t warmUp(const std::string& snapshotName, const std::vector<File*>& files, const bool background = false);
+
+	/**
+   * Get buffer pool usage statistics. The counters are updated under the buffer pool latch, so
+	 * only the thread using the buffer manager should read them here; see getBufStatsSnapshot().
+	 */
+  BufStats & getBufStats()
+  {
+		return bufStats;
+  }
+
+	/**
+   * Get a consistent copy of the buffer pool usage statistics, including those of every file.
+	 * Safe to call from a monitoring thread while the buffer manager is in use.
+	 */
+  BufStats getBufStatsSnapshot();
+
+	/**
+	 * Enables, resizes or disables the compressed victim cache. Pages evicted from the pool are then kept
+	 * compressed in memory, up to the given budget, and a miss of the pool takes them from there instead
+	 * of reading them from disk. Resizing or disabling the cache drops its contents.
+	 *
+	 * @param budgetBytes	Most bytes of compressed pages to keep, 0 to disable the cache
+	 */
+  void setVictimCache(const std::size_t budgetBytes);
+
+	/**
+   * Get the statistics of the victim cache, all zero if it is disabled
+	 */
+  VictimCacheStats getVictimCacheStats();
+
+	/**
+   * Get the kind of memory pages actually backing the buffer pool
+	 */
+  BufPoolPages getPoolPages() const
+  {
+		return poolPages;
+  }
+
+	/**
+   * Clear buffer pool usage statistics
+	 */
+  void clearBufStats();
 };
 
 }
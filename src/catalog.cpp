@@ -0,0 +1,217 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "catalog.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+const std::uint32_t Catalog::MAGIC;
+const std::size_t Catalog::MAX_NAME_BYTES;
+
+namespace {
+
+/**
+ * On-disk form of a catalog entry.
+ */
+struct CatalogRecord {
+  char name[Catalog::MAX_NAME_BYTES + 1];
+  std::uint32_t type;
+  char relation_name[Catalog::MAX_NAME_BYTES + 1];
+  std::int32_t attr_byte_offset;
+  std::int32_t attr_type;
+  PageId header_page;
+  PageId root_page;
+};
+
+/**
+ * Number of entries a slot page holds.
+ */
+const std::size_t ENTRIES_PER_PAGE = Page::SIZE / sizeof(CatalogRecord);
+
+/**
+ * Page holding the magic number and the number of slot pages.
+ */
+const PageId HEADER_PAGE = 1;
+
+/**
+ * Returns the page holding the given slot page.
+ */
+PageId slotPage(const std::size_t slot_page) {
+  return HEADER_PAGE + 1 + slot_page;
+}
+
+}
+
+Catalog::Catalog(const std::string& name, const bool create_new)
+    : file_(name, create_new),
+      num_slot_pages_(0) {
+  if (create_new) {
+    PageId page_number;
+    file_.allocatePage(page_number);
+    assert(page_number == HEADER_PAGE);
+    writeHeaderPage();
+  } else {
+    load();
+  }
+}
+
+bool Catalog::lookup(const std::string& file_name, CatalogEntry& entry) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::map<std::string, std::size_t>::const_iterator it = names_.find(file_name);
+  if (it == names_.end()) {
+    return false;
+  }
+  entry = slots_[it->second];
+  return true;
+}
+
+bool Catalog::contains(const std::string& file_name) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return names_.find(file_name) != names_.end();
+}
+
+void Catalog::put(const CatalogEntry& entry) {
+  if (entry.name.size() > MAX_NAME_BYTES ||
+      entry.relation_name.size() > MAX_NAME_BYTES) {
+    throw FileIOException(name(), "catalog name too long: " + entry.name);
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::size_t slot;
+  std::map<std::string, std::size_t>::const_iterator it = names_.find(entry.name);
+  if (it != names_.end()) {
+    slot = it->second;
+  } else {
+    // Take the first free slot, or a new one at the end.
+    for (slot = 0; slot < slots_.size(); ++slot) {
+      if (slots_[slot].type == CATALOG_FREE) {
+        break;
+      }
+    }
+    if (slot == slots_.size()) {
+      CatalogEntry free_entry = CatalogEntry();
+      free_entry.type = CATALOG_FREE;
+      slots_.push_back(free_entry);
+    }
+    names_[entry.name] = slot;
+  }
+  slots_[slot] = entry;
+  writeSlotPage(slot);
+}
+
+void Catalog::remove(const std::string& file_name) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::map<std::string, std::size_t>::iterator it = names_.find(file_name);
+  if (it == names_.end()) {
+    throw FileNotFoundException(file_name);
+  }
+  const std::size_t slot = it->second;
+  names_.erase(it);
+  slots_[slot] = CatalogEntry();
+  slots_[slot].type = CATALOG_FREE;
+  writeSlotPage(slot);
+}
+
+void Catalog::removeFile(const std::string& file_name) {
+  File::remove(file_name);
+  if (contains(file_name)) {
+    remove(file_name);
+  }
+}
+
+std::vector<CatalogEntry> Catalog::entries() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::vector<CatalogEntry> result;
+  for (std::map<std::string, std::size_t>::const_iterator it = names_.begin();
+       it != names_.end(); ++it) {
+    result.push_back(slots_[it->second]);
+  }
+  return result;
+}
+
+void Catalog::writeSlotPage(const std::size_t slot) {
+  const std::size_t slot_page = slot / ENTRIES_PER_PAGE;
+  if (slot_page >= num_slot_pages_) {
+    PageId page_number;
+    file_.allocatePage(page_number);
+    assert(page_number == slotPage(slot_page));
+    ++num_slot_pages_;
+    writeHeaderPage();
+  }
+
+  Page page;
+  char* bytes = reinterpret_cast<char*>(&page);
+  std::memset(bytes, 0, Page::SIZE);
+  const std::size_t first = slot_page * ENTRIES_PER_PAGE;
+  for (std::size_t i = first;
+       i < slots_.size() && i < first + ENTRIES_PER_PAGE; ++i) {
+    CatalogRecord record;
+    std::memset(&record, 0, sizeof(record));
+    std::strncpy(record.name, slots_[i].name.c_str(), MAX_NAME_BYTES);
+    record.type = slots_[i].type;
+    std::strncpy(record.relation_name, slots_[i].relation_name.c_str(),
+                 MAX_NAME_BYTES);
+    record.attr_byte_offset = slots_[i].attr_byte_offset;
+    record.attr_type = slots_[i].attr_type;
+    record.header_page = slots_[i].header_page;
+    record.root_page = slots_[i].root_page;
+    std::memcpy(bytes + (i - first) * sizeof(record), &record, sizeof(record));
+  }
+  file_.writePage(slotPage(slot_page), page);
+}
+
+void Catalog::writeHeaderPage() {
+  Page page;
+  char* bytes = reinterpret_cast<char*>(&page);
+  std::memset(bytes, 0, Page::SIZE);
+  const std::uint32_t magic = MAGIC;
+  std::memcpy(bytes, &magic, sizeof(magic));
+  std::memcpy(bytes + sizeof(magic), &num_slot_pages_, sizeof(num_slot_pages_));
+  file_.writePage(HEADER_PAGE, page);
+}
+
+void Catalog::load() {
+  const Page header = file_.readPage(HEADER_PAGE);
+  const char* header_bytes = reinterpret_cast<const char*>(&header);
+  std::uint32_t magic;
+  std::memcpy(&magic, header_bytes, sizeof(magic));
+  if (magic != MAGIC) {
+    throw FileIOException(name(), "not a catalog");
+  }
+  std::memcpy(&num_slot_pages_, header_bytes + sizeof(magic),
+              sizeof(num_slot_pages_));
+
+  for (std::uint32_t slot_page = 0; slot_page < num_slot_pages_; ++slot_page) {
+    const Page page = file_.readPage(slotPage(slot_page));
+    const char* bytes = reinterpret_cast<const char*>(&page);
+    for (std::size_t i = 0; i < ENTRIES_PER_PAGE; ++i) {
+      CatalogRecord record;
+      std::memcpy(&record, bytes + i * sizeof(record), sizeof(record));
+      record.name[MAX_NAME_BYTES] = '\0';
+      record.relation_name[MAX_NAME_BYTES] = '\0';
+      CatalogEntry entry = CatalogEntry();
+      entry.type = static_cast<CatalogEntryType>(record.type);
+      if (entry.type != CATALOG_FREE) {
+        entry.name = record.name;
+        entry.relation_name = record.relation_name;
+        entry.attr_byte_offset = record.attr_byte_offset;
+        entry.attr_type = record.attr_type;
+        entry.header_page = record.header_page;
+        entry.root_page = record.root_page;
+        names_[entry.name] = slots_.size();
+      }
+      slots_.push_back(entry);
+    }
+  }
+}
+
+}
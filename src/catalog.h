@@ -0,0 +1,207 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Kind of file a catalog entry describes.
+ */
+enum CatalogEntryType {
+  CATALOG_FREE = 0,       // on disk only: an unused slot
+  CATALOG_RELATION = 1,
+  CATALOG_INDEX = 2
+};
+
+/**
+ * @brief What the catalog records about a relation or an index.
+ */
+struct CatalogEntry {
+  /**
+   * Name of the file, at most Catalog::MAX_NAME_BYTES bytes.
+   */
+  std::string name;
+
+  /**
+   * Kind of file.
+   */
+  CatalogEntryType type;
+
+  /**
+   * Name of the base relation of an index, at most Catalog::MAX_NAME_BYTES
+   * bytes; empty for a relation.
+   */
+  std::string relation_name;
+
+  /**
+   * Offset of the key inside the records of the base relation of an index.
+   */
+  int attr_byte_offset;
+
+  /**
+   * Datatype of the key of an index.
+   */
+  int attr_type;
+
+  /**
+   * Page of the file holding its own metadata, e.g. the IndexMetaInfo page.
+   */
+  PageId header_page;
+
+  /**
+   * Root page of an index as of when it was last closed; the metadata page
+   * of the index has the final say.
+   */
+  PageId root_page;
+};
+
+/**
+ * @brief Persisted catalog of the relations and indexes of a database.
+ *
+ * Opening an index through the catalog is one lookup in memory: whether the
+ * index exists and where its metadata page is are known without probing the
+ * filesystem.  The catalog file is a
+ * BlobFile whose page 1 holds a magic number and the number of slot pages
+ * that follow it; each slot page holds fixed-size entries.  Changes are
+ * written to the slot page of the entry at once, so the catalog file stays
+ * up to date without a separate flush.
+ *
+ * All methods may be called from several threads at once.
+ */
+class Catalog {
+ public:
+  /**
+   * Value page 1 of a catalog file starts with.
+   */
+  static const std::uint32_t MAGIC = 0x43415431;  // "CAT1"
+
+  /**
+   * Longest name of a file or of a base relation, in bytes.
+   */
+  static const std::size_t MAX_NAME_BYTES = 63;
+
+  /**
+   * Opens or creates a catalog.
+   *
+   * @param name        Name of the catalog file.
+   * @param create_new  Whether to create a new catalog.
+   * @throws  FileExistsException     If the file exists and create_new is
+   *                                  true.
+   * @throws  FileNotFoundException   If the file doesn't exist and create_new
+   *                                  is false.
+   * @throws  FileIOException         If the file is not a catalog.
+   */
+  Catalog(const std::string& name, const bool create_new);
+
+  /**
+   * Returns the name of the catalog file.
+   */
+  const std::string& name() const { return file_.filename(); }
+
+  /**
+   * Looks a file up.
+   *
+   * @param file_name   Name of the file.
+   * @param entry       Receives the entry of the file if there is one.
+   * @return  True if the catalog has the file.
+   */
+  bool lookup(const std::string& file_name, CatalogEntry& entry) const;
+
+  /**
+   * Returns true if the catalog has the given file.
+   *
+   * @param file_name   Name of the file.
+   */
+  bool contains(const std::string& file_name) const;
+
+  /**
+   * Adds an entry, or replaces the entry of the same name, and writes it out.
+   *
+   * @param entry   Entry to record.
+   * @throws  FileIOException  If a name is too long or the entry can not be
+   *                           written.
+   */
+  void put(const CatalogEntry& entry);
+
+  /**
+   * Drops the entry of a file and writes the change out.
+   *
+   * @param file_name   Name of the file.
+   * @throws  FileNotFoundException   If the catalog has no such file.
+   */
+  void remove(const std::string& file_name);
+
+  /**
+   * Deletes a file and drops its entry, if it has one, so the catalog never
+   * lists a file that is gone.
+   *
+   * @param file_name   Name of the file.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   * @throws  FileOpenException       If the file is currently open.
+   */
+  void removeFile(const std::string& file_name);
+
+  /**
+   * Returns all entries, in name order.
+   */
+  std::vector<CatalogEntry> entries() const;
+
+ private:
+  Catalog(const Catalog&);
+  Catalog& operator=(const Catalog&);
+
+  /**
+   * Writes the slot page holding the given slot.
+   */
+  void writeSlotPage(const std::size_t slot);
+
+  /**
+   * Writes page 1.
+   */
+  void writeHeaderPage();
+
+  /**
+   * Reads all slot pages.
+   */
+  void load();
+
+  /**
+   * File holding the catalog.
+   */
+  BlobFile file_;
+
+  /**
+   * Entry in each slot; free slots have type CATALOG_FREE.
+   */
+  std::vector<CatalogEntry> slots_;
+
+  /**
+   * Slot of each file, by name.
+   */
+  std::map<std::string, std::size_t> names_;
+
+  /**
+   * Number of slot pages in the file.
+   */
+  std::uint32_t num_slot_pages_;
+
+  /**
+   * Latch guarding the entries and the writes of the file.
+   */
+  mutable std::mutex mutex_;
+};
+
+}
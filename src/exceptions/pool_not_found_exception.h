@@ -0,0 +1,33 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a buffer pool is looked up by a name no pool of the group has.
+ */
+class PoolNotFoundException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a pool not found exception for the given pool name.
+   */
+  explicit PoolNotFoundException(const std::string& nameIn);
+
+ protected:
+  /**
+   * Name of the pool that was looked up.
+   */
+  const std::string name;
+};
+
+}
@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "shared_pool_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+SharedPoolException::SharedPoolException(const std::string& nameIn, const std::string& reasonIn)
+    : BadgerDbException(""), name(nameIn) {
+  std::stringstream ss;
+  ss << "Shared buffer pool segment " << name << ": " << reasonIn;
+  message_.assign(ss.str());
+}
+
+}
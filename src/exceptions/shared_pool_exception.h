@@ -0,0 +1,33 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a shared buffer pool segment can not be set up or used.
+ */
+class SharedPoolException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a shared pool exception for the given segment and reason.
+   */
+  explicit SharedPoolException(const std::string& nameIn, const std::string& reasonIn);
+
+ protected:
+  /**
+   * Name of the shared memory segment.
+   */
+  const std::string name;
+};
+
+}
@@ -7,142 +7,553 @@
 
 #include "file.h"
 
-#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
 #include <cassert>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "catalog.h"
 #include "file_iterator.h"
 #include "page.h"
+#include "pageCodec.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+namespace {
+
+/**
+ * Buffer aligned for direct I/O, released with free().
+ */
+typedef std::unique_ptr<char, void (*)(void*)> AlignedBuffer;
+
+AlignedBuffer allocateAligned(const std::string& filename,
+                              const std::size_t length) {
+  void* memory = NULL;
+  const int rc = posix_memalign(&memory, File::DIRECT_IO_ALIGNMENT, length);
+  if (rc != 0) {
+    throw FileIOException(filename, std::strerror(rc));
+  }
+  return AlignedBuffer(static_cast<char*>(memory), &std::free);
+}
+
+bool isAligned(const std::size_t value) {
+  return value % File::DIRECT_IO_ALIGNMENT == 0;
+}
+
+bool isAligned(const off_t position, const void* buffer,
+               const std::size_t length) {
+  return isAligned(position) && isAligned(length) &&
+         isAligned(reinterpret_cast<std::size_t>(buffer));
+}
+
+}
+
+File::HandleMap File::open_files_;
 File::CountMap File::open_counts_;
+File::LatchMap File::open_latches_;
+File::HeaderMap File::open_headers_;
+std::mutex File::open_files_latch_;
+Catalog* File::catalog_ = NULL;
 
 void File::remove(const std::string& filename) {
-  if (!exists(filename)) {
-    throw FileNotFoundException(filename);
-  }
   if (isOpen(filename)) {
     throw FileOpenException(filename);
   }
-  std::remove(filename.c_str());
+  const int rc = ::unlink(filename.c_str());
+  const int error = errno;
+  // An entry of a file that is gone goes too, whoever removed the file.
+  Catalog* files = catalog();
+  if ((rc == 0 || error == ENOENT) && files != NULL &&
+      files->contains(filename)) {
+    files->remove(filename);
+  }
+  if (rc != 0) {
+    if (error == ENOENT) {
+      throw FileNotFoundException(filename);
+    }
+    throw FileIOException(filename, std::strerror(error));
+  }
 }
 
-bool File::isOpen(const std::string& filename) {
-  if (!exists(filename)) {
-    return false;
+void File::setCatalog(Catalog* catalog) {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
+  catalog_ = catalog;
+}
+
+Catalog* File::catalog() {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
+  return catalog_;
+}
+
+void File::recordRelation() const {
+  Catalog* files = catalog();
+  if (files == NULL || files->contains(filename_)) {
+    return;
   }
+  CatalogEntry entry = CatalogEntry();
+  entry.name = filename_;
+  entry.type = CATALOG_RELATION;
+  files->put(entry);
+}
+
+bool File::isOpen(const std::string& filename) {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
+  struct stat info;
+  return ::stat(filename.c_str(), &info) == 0;
+}
 
-	return false;
+FileDescriptor::~FileDescriptor() {
+  ::close(fd_);
 }
 
 File::~File() {
-  close();
+  try {
+    close();
+  } catch (const FileIOException& e) {
+    // Destructors may not throw; callers that need the header on disk call
+    // sync() before letting go of the file.
+    std::cerr << e.message() << std::endl;
+  }
 }
 
 
+void File::writePages(const PageId first_page_number,
+                      const std::vector<const Page*>& pages) {
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    writePage(first_page_number + i, *pages[i]);
+  }
+}
+
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new,
+           const FileIoMode mode) : filename_(name) {
+  openIfNeeded(create_new, mode);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
                          0 /* num_free_pages */, 0 /* first_free_page */};
-    writeHeader(header);
+    if (handle_->aligned()) {
+      // The header takes a whole page so that page 1 starts on a page
+      // boundary.
+      AlignedBuffer block = allocateAligned(filename_, Page::SIZE);
+      std::memset(block.get(), 0, Page::SIZE);
+      std::memcpy(block.get(), &header, sizeof(FileHeader));
+      writeAt(0 /* pos */, block.get(), Page::SIZE);
+    } else {
+      writeAt(0 /* pos */, reinterpret_cast<const char*>(&header),
+              sizeof(FileHeader));
+    }
+    cached_header_->header = header;
+    cached_header_->loaded = true;
+    cached_header_->last_used_known = true;
+    cached_header_->last_used_page = Page::INVALID_NUMBER;
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
-  if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
-    ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
-  } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
-    const bool already_exists = exists(filename_);
+File::File(const std::string& name,
+           const std::shared_ptr<FileDescriptor>& handle,
+           const FileHeader& header) : filename_(name) {
+  openAttached(handle, header);
+}
+
+void File::openIfNeeded(const bool create_new, const FileIoMode mode) {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
+  if (!shareIfOpen()) {
+    // open() itself tells whether the file exists, so there is no separate
+    // probe: O_EXCL fails on an existing file, a plain open on a missing one.
+    int flags = O_RDWR;
     if (create_new) {
-      // Error if we try to overwrite an existing file.
-      if (already_exists) {
+      flags = flags | O_CREAT | O_EXCL;
+    }
+    bool direct = mode == FILE_IO_DIRECT;
+    int fd = ::open(filename_.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0 && direct && errno == EINVAL) {
+      // The filesystem does not support direct I/O; go through the page cache.
+      // The failed open may have created the file already.
+      direct = false;
+      if (create_new) {
+        flags = (flags & ~O_EXCL) | O_TRUNC;
+      }
+      fd = ::open(filename_.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+      if (create_new && errno == EEXIST) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
-    } else {
-      // Error if we try to open a file that doesn't exist.
-      if (!already_exists) {
+      if (!create_new && errno == ENOENT) {
         throw FileNotFoundException(filename_);
       }
+      throw FileIOException(filename_, std::strerror(errno));
+    }
+    // New files get the page-aligned layout.  Files in the original layout
+    // have a FileHeader followed by whole pages, so their size is never a
+    // multiple of the page size.
+    bool aligned = true;
+    if (!create_new) {
+      struct stat info;
+      if (::fstat(fd, &info) != 0) {
+        const int error = errno;
+        ::close(fd);
+        throw FileIOException(filename_, std::strerror(error));
+      }
+      aligned = info.st_size > 0 && info.st_size % Page::SIZE == 0;
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
-    open_counts_[filename_] = 1;
+    handle_.reset(new FileDescriptor(fd, direct, aligned));
+    registerOpen();
   }
 }
 
+void File::openAttached(const std::shared_ptr<FileDescriptor>& handle,
+                        const FileHeader& header) {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
+  if (!shareIfOpen()) {
+    handle_ = handle;
+    registerOpen();
+    cached_header_->header = header;
+    cached_header_->loaded = true;
+  }
+}
+
+bool File::shareIfOpen() {
+  if (open_counts_.find(filename_) == open_counts_.end()) {
+    return false;
+  }
+  ++open_counts_[filename_];
+  handle_ = open_files_[filename_];
+  latch_ = open_latches_[filename_];
+  cached_header_ = open_headers_[filename_];
+  return true;
+}
+
+void File::registerOpen() {
+  latch_.reset(new std::recursive_mutex());
+  cached_header_.reset(new CachedFileHeader());
+  cached_header_->loaded = false;
+  cached_header_->dirty = false;
+  cached_header_->last_used_known = false;
+  cached_header_->last_used_page = Page::INVALID_NUMBER;
+  cached_header_->map_loaded = false;
+  cached_header_->extent_pages = DEFAULT_EXTENT_PAGES;
+  cached_header_->extent_end = Page::INVALID_NUMBER;
+  cached_header_->table_loaded = false;
+  cached_header_->shared = false;
+  open_files_[filename_] = handle_;
+  open_latches_[filename_] = latch_;
+  open_headers_[filename_] = cached_header_;
+  open_counts_[filename_] = 1;
+}
+
 void File::close() {
+  // The last File object of the file takes the cached header to disk.  A
+  // failure is reported only once the file is closed.
+  if (!handle_) {
+    return;
+  }
+  bool last;
+  {
+    std::lock_guard<std::mutex> guard(open_files_latch_);
+    last = open_counts_[filename_] == 1;
+  }
+  std::unique_ptr<FileIOException> failure;
+  if (last) {
+    try {
+      flushHeader();
+    } catch (const FileIOException& e) {
+      failure.reset(new FileIOException(e));
+    }
+  }
+
+  std::unique_lock<std::mutex> guard(open_files_latch_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  handle_.reset();
+  latch_.reset();
+  cached_header_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_files_.erase(filename_);
+    open_latches_.erase(filename_);
+    open_headers_.erase(filename_);
     open_counts_.erase(filename_);
   }
+  guard.unlock();
+
+  if (failure) {
+    throw *failure;
+  }
 }
 
 FileHeader File::readHeader() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (!cached_header_->loaded) {
+    // In the page-aligned layout a free-space map or a page mapping table is
+    // announced right after the header.
+    char bytes[sizeof(FileHeader) + sizeof(std::uint32_t)];
+    readAt(0 /* pos */, bytes,
+           handle_->aligned() ? sizeof(bytes) : sizeof(FileHeader));
+    std::memcpy(&cached_header_->header, bytes, sizeof(FileHeader));
+    std::uint32_t magic = 0;
+    if (handle_->aligned()) {
+      std::memcpy(&magic, bytes + sizeof(FileHeader), sizeof(magic));
+    }
+    if (magic == FreeSpaceMap::MAGIC && !cached_header_->free_space_map) {
+      cached_header_->free_space_map.reset(new FreeSpaceMap());
+    }
+    if (magic == PageMappingTable::MAGIC && !cached_header_->page_table) {
+      cached_header_->page_table.reset(new PageMappingTable());
+    }
+    cached_header_->loaded = true;
+  }
+  return cached_header_->header;
+}
+
+bool File::reloadHeader() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  const FreeSpaceMap* map = cached_header_->free_space_map.get();
+  const PageMappingTable* table = cached_header_->page_table.get();
+  if (!cached_header_->shared || !cached_header_->loaded ||
+      cached_header_->dirty ||
+      (map != NULL && !map->dirtyMapPages().empty()) ||
+      (table != NULL && (!table->dirtyChunks().empty() ||
+                         table->directoryDirty()))) {
+    return false;
+  }
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  readAt(0 /* pos */, reinterpret_cast<char*>(&header), sizeof(header));
+  if (header == cached_header_->header) {
+    return false;
+  }
+  cached_header_->loaded = false;
+  cached_header_->last_used_known = false;
+  cached_header_->map_loaded = false;
+  cached_header_->extent_end = Page::INVALID_NUMBER;
+  cached_header_->table_loaded = false;
+  return true;
+}
+
+void File::markShared() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  cached_header_->shared = true;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  cached_header_->header = header;
+  cached_header_->loaded = true;
+  cached_header_->dirty = true;
+}
+
+void File::flushHeader() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = cached_header_->free_space_map.get();
+  if (map != NULL && !map->dirtyMapPages().empty()) {
+    AlignedBuffer block = allocateAligned(filename_, Page::SIZE);
+    const std::set<PageId>& dirty = map->dirtyMapPages();
+    for (std::set<PageId>::const_iterator it = dirty.begin();
+         it != dirty.end(); ++it) {
+      map->store(*it, block.get());
+      writeAt(pagePosition(*it), block.get(), Page::SIZE);
+    }
+    map->clean();
+  }
+  PageMappingTable* table = cached_header_->page_table.get();
+  if (table != NULL && (!table->dirtyChunks().empty() ||
+                        table->directoryDirty())) {
+    AlignedBuffer block = allocateAligned(filename_, Page::SIZE);
+    const std::set<std::size_t>& dirty = table->dirtyChunks();
+    for (std::set<std::size_t>::const_iterator it = dirty.begin();
+         it != dirty.end(); ++it) {
+      table->storeChunk(*it, block.get());
+      writeAt(PageMappingTable::sectorPosition(table->chunkSector(*it)),
+              block.get(), Page::SIZE);
+    }
+    if (table->directoryDirty()) {
+      table->storeDirectory(block.get());
+      writeAt(PageMappingTable::DIRECTORY_OFFSET, block.get(),
+              PageMappingTable::DIRECTORY_BYTES);
+    }
+    // Sectors end anywhere, but the file has to end on a page boundary to be
+    // told apart from the original layout when it is opened again.
+    const off_t end = PageMappingTable::sectorPosition(table->endSector());
+    const off_t size = (end + Page::SIZE - 1) / Page::SIZE * Page::SIZE;
+    struct stat info;
+    if (::fstat(handle_->fd(), &info) != 0 ||
+        (info.st_size < size && ::ftruncate(handle_->fd(), size) != 0)) {
+      throw FileIOException(filename_, std::strerror(errno));
+    }
+    table->clean();
+  }
+  if (!cached_header_->dirty) {
+    return;
+  }
+  storeHeader(cached_header_->header);
+  cached_header_->dirty = false;
+}
+
+void File::storeHeader(const FileHeader& header) const {
+  writeAt(0 /* pos */, reinterpret_cast<const char*>(&header),
+          sizeof(FileHeader));
+}
+
+void File::readAt(const off_t position, char* buffer,
+                  const std::size_t length) const {
+  if (handle_->direct() && !isAligned(position, buffer, length)) {
+    const off_t start = position - position % DIRECT_IO_ALIGNMENT;
+    const off_t stop = position + length + DIRECT_IO_ALIGNMENT - 1 -
+                       (position + length - 1) % DIRECT_IO_ALIGNMENT;
+    AlignedBuffer bounce = allocateAligned(filename_, stop - start);
+    readAt(start, bounce.get(), stop - start);
+    std::memcpy(buffer, bounce.get() + (position - start), length);
+    return;
+  }
+
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t n = ::pread(handle_->fd(), buffer + done, length - done,
+                              position + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, std::strerror(errno));
+    }
+    if (n == 0) {
+      // Past the end of the file.
+      std::memset(buffer + done, 0, length - done);
+      return;
+    }
+    done += n;
+  }
+}
+
+void File::writeAt(const off_t position, const char* buffer,
+                   const std::size_t length) const {
+  if (handle_->direct() && !isAligned(position, buffer, length)) {
+    const off_t start = position - position % DIRECT_IO_ALIGNMENT;
+    const off_t stop = position + length + DIRECT_IO_ALIGNMENT - 1 -
+                       (position + length - 1) % DIRECT_IO_ALIGNMENT;
+    AlignedBuffer bounce = allocateAligned(filename_, stop - start);
+    // Keep the bytes of the first and last block that are not overwritten.
+    const off_t last = stop - DIRECT_IO_ALIGNMENT;
+    if (start != position) {
+      readAt(start, bounce.get(), DIRECT_IO_ALIGNMENT);
+    }
+    if (stop != (off_t) (position + length) &&
+        (last != start || start == position)) {
+      readAt(last, bounce.get() + (last - start), DIRECT_IO_ALIGNMENT);
+    }
+    std::memcpy(bounce.get() + (position - start), buffer, length);
+    writeAt(start, bounce.get(), stop - start);
+    return;
+  }
+
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t n = ::pwrite(handle_->fd(), buffer + done, length - done,
+                               position + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, std::strerror(errno));
+    }
+    done += n;
+  }
 }
 
+void File::setExtentPages(const PageId pages) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  cached_header_->extent_pages = pages > 0 ? pages : 1;
+}
 
+PageId File::extentPages() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  return cached_header_->extent_pages;
+}
 
+void File::prepareNewPage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (page_number < cached_header_->extent_end) {
+    return;
+  }
+  // Pages past the header count of a file opened just now may hold anything,
+  // so the extent always starts at the page asked for.
+  const PageId count = cached_header_->extent_pages;
+  const off_t position = pagePosition(page_number);
+  const std::size_t length = (std::size_t) count * Page::SIZE;
+  // Reserving the blocks first keeps the extent in one piece on disk; a
+  // filesystem without fallocate() gets the plain write below.
+  ::fallocate(handle_->fd(), 0, position, length);
+  AlignedBuffer images = allocateAligned(filename_, length);
+  for (PageId i = 0; i < count; ++i) {
+    newPageImage(page_number + i, images.get() + (std::size_t) i * Page::SIZE);
+  }
+  writeAt(position, images.get(), length);
+  cached_header_->extent_end = page_number + count;
+}
 
+void File::newPageImage(const PageId page_number, char* image) const {
+  std::memset(image, 0, Page::SIZE);
+}
 
-PageFile PageFile::create(const std::string& filename) {
-  return PageFile(filename, true /* create_new */);
+void File::sync() {
+  flushHeader();
+  if (::fdatasync(handle_->fd()) != 0) {
+    throw FileIOException(filename_, std::strerror(errno));
+  }
 }
 
-PageFile PageFile::open(const std::string& filename) {
-  return PageFile(filename, false /* create_new */);
+
+
+
+
+PageFile PageFile::create(const std::string& filename,
+                          const FileIoMode mode) {
+  return PageFile(filename, true /* create_new */, mode);
+}
+
+PageFile PageFile::open(const std::string& filename, const FileIoMode mode) {
+  return PageFile(filename, false /* create_new */, mode);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const FileIoMode mode)
+: File(name, create_new, mode)
 {
+  if (create_new) {
+    // New files keep a free-space map, announced after the header.
+    const std::uint32_t magic = FreeSpaceMap::MAGIC;
+    writeAt(sizeof(FileHeader), reinterpret_cast<const char*>(&magic),
+            sizeof(magic));
+    cached_header_->free_space_map.reset(new FreeSpaceMap());
+    cached_header_->map_loaded = true;
+  }
+  // Relations are PageFiles; opening one records it as well, so relations
+  // created before the catalog was set are found.
+  recordRelation();
 }
 
 PageFile::~PageFile() {
@@ -163,14 +574,28 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    allocateMappedPage(*map, new_page_number, new_page);
+    return;
+  }
+  FileHeader header = readHeader();
   Page existing_page;
-  if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+  PageId previous_tail = Page::INVALID_NUMBER;
+  const bool fresh = header.num_free_pages == 0;
+  if (!fresh) {
+    readPageInto(header.first_free_page, new_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
 		new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
+    new_page.set_next_page_number(Page::INVALID_NUMBER);
     --header.num_free_pages;
 
     if (header.first_used_page == Page::INVALID_NUMBER ||
@@ -202,6 +627,7 @@ Page PageFile::allocatePage(PageId &new_page_number) {
   }
 	else
 	{
+    new_page.initialize();
     new_page.set_page_number(header.num_pages);
 		new_page_number = new_page.page_number();
 
@@ -213,51 +639,82 @@ Page PageFile::allocatePage(PageId &new_page_number) {
 		{
       // If we have pages allocated, we need to add the new page to the tail
       // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      previous_tail = lastUsedPage();
+      assert(previous_tail != Page::INVALID_NUMBER);
     }
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
+  if (fresh) {
+    // A page new to the file is already on disk as part of an extent.
+    prepareNewPage(new_page_number);
+  } else {
+    writePage(new_page_number, new_page.header_, new_page);
+  }
   if (existing_page.page_number() != Page::INVALID_NUMBER) {
     // If we updated an existing page by inserting the new page into the
     // used list, we need to write it out.
     writePage(existing_page.page_number(), existing_page.header_, existing_page);
   }
+  if (previous_tail != Page::INVALID_NUMBER) {
+    // Only the next page pointer of the old tail changes.
+    PageHeader tail_header = readPageHeader(previous_tail);
+    tail_header.next_page_number = new_page_number;
+    writePageHeader(previous_tail, tail_header);
+  }
+  if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+    setLastUsedPage(new_page_number);
+  }
   writeHeader(header);
-
-  return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
+  // A page past the end may have been added by another process.
+  if (page_number >= header.num_pages && reloadHeader()) {
+    header = readHeader();
+  }
 
-	if (page_number >= header.num_pages)
+	if (page_number >= header.num_pages || isMapPage(page_number))
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPageInto(page_number, page, false /* allow_free */);
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+  readPageInto(page_number, page, allow_free);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page,
+                            const bool allow_free) const {
+  // The header and the data are laid out back to back, as on disk.
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&page.header_),
+         Page::SIZE);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    // The map knows whether the page was deleted, and the used pages are not
+    // linked through their headers.
+    if (!map->isUsed(new_page_number)) {
+      throw InvalidPageException(new_page_number, filename_);
+    }
+    writePage(new_page_number, new_page.header_, new_page);
+    return;
+  }
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
@@ -273,7 +730,56 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	writePage(new_page_number, header, new_page);
 }
 
+void PageFile::writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages) {
+  if (pages.empty()) {
+    return;
+  }
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = spaceMap();
+  // Keep the next page pointers found on disk, as writePage() does.
+  std::vector<PageHeader> headers;
+  headers.reserve(pages.size());
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    const PageId page_number = first_page_number + i;
+    PageHeader header = pages[i]->header_;
+    if (map != NULL) {
+      if (!map->isUsed(page_number)) {
+        throw InvalidPageException(page_number, filename_);
+      }
+      headers.push_back(header);
+      continue;
+    }
+    const PageHeader disk_header = readPageHeader(page_number);
+    if (disk_header.current_page_number == Page::INVALID_NUMBER) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    header.next_page_number = disk_header.next_page_number;
+    headers.push_back(header);
+  }
+
+  AlignedBuffer run = allocateAligned(filename_, pages.size() * Page::SIZE);
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    char* slot = run.get() + i * Page::SIZE;
+    std::memcpy(slot, &headers[i], sizeof(PageHeader));
+    std::memcpy(slot + sizeof(PageHeader), &pages[i]->data_[0],
+                Page::DATA_SIZE);
+  }
+  writeAt(pagePosition(first_page_number), run.get(), pages.size() * Page::SIZE);
+  if (map != NULL) {
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+      map->setUsed(first_page_number + i, pages[i]->getFreeSpace());
+    }
+  }
+}
+
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    deleteMappedPage(*map, page_number);
+    return;
+  }
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
@@ -292,6 +798,11 @@ void PageFile::deletePage(const PageId page_number) {
       }
     }
   }
+  if (existing_page.next_page_number() == Page::INVALID_NUMBER) {
+    // The page was the tail of the used list.
+    setLastUsedPage(previous_page.isUsed() ? previous_page.page_number()
+                                           : Page::INVALID_NUMBER);
+  }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
@@ -313,34 +824,203 @@ FileIterator PageFile::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
+bool PageFile::hasFreeSpaceMap() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  readHeader();
+  return cached_header_->free_space_map != NULL;
+}
+
+PageId PageFile::findPageWithSpace(const std::size_t record_bytes) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  // A new slot may be needed as well.
+  const std::size_t needed = record_bytes + sizeof(PageSlot);
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    return map->findSpace(needed);
+  }
+  for (PageId page_number = readHeader().first_used_page;
+       page_number != Page::INVALID_NUMBER;) {
+    const PageHeader header = readPageHeader(page_number);
+    if (header.free_space_upper_bound - header.free_space_lower_bound >=
+        (int) needed) {
+      return page_number;
+    }
+    page_number = header.next_page_number;
+  }
+  return Page::INVALID_NUMBER;
+}
+
+bool PageFile::isMapPage(const PageId page_number) const {
+  return hasFreeSpaceMap() && FreeSpaceMap::isMapPage(page_number);
+}
+
+FreeSpaceMap* PageFile::spaceMap() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  const FileHeader header = readHeader();
+  FreeSpaceMap* map = cached_header_->free_space_map.get();
+  if (map != NULL && !cached_header_->map_loaded) {
+    map->grow(header.num_pages);
+    AlignedBuffer block = allocateAligned(filename_, Page::SIZE);
+    for (PageId map_page = 1; map_page < header.num_pages;
+         map_page += FreeSpaceMap::ENTRIES_PER_MAP_PAGE + 1) {
+      readAt(pagePosition(map_page), block.get(), Page::SIZE);
+      map->load(map_page, block.get());
+    }
+    cached_header_->map_loaded = true;
+  }
+  return map;
+}
+
+void PageFile::newPageImage(const PageId page_number, char* image) const {
+  if (isMapPage(page_number)) {
+    std::memset(image, 0, Page::SIZE);
+    return;
+  }
+  Page empty;
+  empty.set_page_number(page_number);
+  std::memcpy(image, &empty, Page::SIZE);
+}
+
+PageId PageFile::nextUsedPage(const PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    return map->nextUsed(page_number);
+  }
+  return readPageHeader(page_number).next_page_number;
+}
+
+void PageFile::allocateMappedPage(FreeSpaceMap& map, PageId &new_page_number,
+                                  Page& new_page) {
+  FileHeader header = readHeader();
+  new_page_number = map.findFree();
+  const bool fresh = new_page_number == Page::INVALID_NUMBER;
+  if (!fresh) {
+    --header.num_free_pages;
+  } else {
+    // Grow the file, stepping over the next map page when it is due.
+    if (FreeSpaceMap::isMapPage(header.num_pages)) {
+      ++header.num_pages;
+    }
+    new_page_number = header.num_pages;
+    ++header.num_pages;
+    map.grow(header.num_pages);
+  }
+
+  new_page.initialize();
+  new_page.set_page_number(new_page_number);
+  if (header.first_used_page == Page::INVALID_NUMBER ||
+      header.first_used_page > new_page_number) {
+    header.first_used_page = new_page_number;
+  }
+  if (fresh) {
+    // A page new to the file is already on disk as part of an extent.
+    prepareNewPage(new_page_number);
+    map.setUsed(new_page_number, new_page.getFreeSpace());
+  } else {
+    writePage(new_page_number, new_page.header_, new_page);
+  }
+  writeHeader(header);
+}
+
+void PageFile::deleteMappedPage(FreeSpaceMap& map, const PageId page_number) {
+  FileHeader header = readHeader();
+  if (page_number >= header.num_pages || !map.isUsed(page_number)) {
+    throw InvalidPageException(page_number, filename_);
+  }
+
+  // Clear the page so that reading it fails, and hand it back to the map.
+  Page existing_page;
+  existing_page.initialize();
+  writePage(page_number, existing_page.header_, existing_page);
+  map.setFree(page_number);
+  ++header.num_free_pages;
+  if (header.first_used_page == page_number) {
+    header.first_used_page = map.nextUsed(page_number);
+  }
+  writeHeader(header);
+}
+
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  // Put the page together first so that it goes out in one aligned write.
+  alignas(DIRECT_IO_ALIGNMENT) char block[Page::SIZE];
+  std::memcpy(block, &header, sizeof(PageHeader));
+  std::memcpy(block + sizeof(PageHeader), &new_page.data_[0], Page::DATA_SIZE);
+  writeAt(pagePosition(page_number), block, Page::SIZE);
+
+  FreeSpaceMap* map = spaceMap();
+  if (map != NULL) {
+    if (header.current_page_number == Page::INVALID_NUMBER) {
+      map->setFree(page_number);
+    } else {
+      map->setUsed(page_number,
+                   header.free_space_upper_bound - header.free_space_lower_bound);
+    }
+  }
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&header),
+         sizeof(PageHeader));
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  writeAt(pagePosition(page_number), reinterpret_cast<const char*>(&header),
+          sizeof(PageHeader));
+}
 
+PageId PageFile::lastUsedPage() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (!cached_header_->last_used_known) {
+    // Only the page headers are needed to follow the list.
+    PageId page_number = readHeader().first_used_page;
+    PageId last = Page::INVALID_NUMBER;
+    while (page_number != Page::INVALID_NUMBER) {
+      last = page_number;
+      page_number = readPageHeader(page_number).next_page_number;
+    }
+    cached_header_->last_used_page = last;
+    cached_header_->last_used_known = true;
+  }
+  return cached_header_->last_used_page;
+}
 
+void PageFile::setLastUsedPage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  cached_header_->last_used_page = page_number;
+  cached_header_->last_used_known = true;
+}
 
-BlobFile BlobFile::create(const std::string& filename) {
-  return BlobFile(filename, true /* create_new */);
+
+
+
+BlobFile BlobFile::create(const std::string& filename,
+                          const FileIoMode mode,
+                          const PageCompression compression) {
+  return BlobFile(filename, true /* create_new */, mode, compression);
 }
 
-BlobFile BlobFile::open(const std::string& filename) {
-  return BlobFile(filename, false /* create_new */);
+BlobFile BlobFile::open(const std::string& filename, const FileIoMode mode) {
+  return BlobFile(filename, false /* create_new */, mode);
 }
 
-BlobFile::BlobFile(const std::string& name, const bool create_new)
-: File(name, create_new) {
+BlobFile::BlobFile(const std::string& name, const bool create_new,
+                   const FileIoMode mode, const PageCompression compression)
+: File(name, create_new, mode) {
+  if (create_new && compression == PAGE_COMPRESSION_AUTO) {
+    // The page mapping table is announced after the header; its directory
+    // follows and is written with the header.
+    const std::uint32_t magic = PageMappingTable::MAGIC;
+    writeAt(sizeof(FileHeader), reinterpret_cast<const char*>(&magic),
+            sizeof(magic));
+    cached_header_->page_table.reset(new PageMappingTable());
+    cached_header_->page_table->grow(readHeader().num_pages);
+    cached_header_->table_loaded = true;
+  }
 }
 
 BlobFile::~BlobFile() {
@@ -361,8 +1041,15 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePageInto(new_page_number, new_page);
+	return new_page;
+}
+
+void BlobFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+	std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+	new_page.initialize();
 
 	new_page_number = header.num_pages;
 
@@ -372,23 +1059,152 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 	++header.num_pages;
 
-	writePage(new_page_number, new_page);
+	PageMappingTable* table = pageTable();
+	if (table != NULL) {
+		// A compressed page takes no space until it is first written.
+		if (!table->grow(header.num_pages)) {
+			throw FileIOException(filename_, "page mapping table is full");
+		}
+	} else {
+		// The empty page is already on disk as part of an extent.
+		prepareNewPage(new_page_number);
+	}
 	writeHeader(header);
+}
 
-	return new_page;
+void BlobFile::newPageImage(const PageId page_number, char* image) const {
+	const Page empty;
+	std::memcpy(image, &empty, Page::SIZE);
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPageInto(page_number, page);
 	return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page& page) const {
+	std::lock_guard<std::recursive_mutex> guard(*latch_);
+	const PageMappingTable* table = pageTable();
+	if (table == NULL) {
+		readAt(pagePosition(page_number), reinterpret_cast<char*>(&page), Page::SIZE);
+		return;
+	}
+	// A page past the end may have been added by another process.
+	if (page_number >= table->size() && reloadHeader()) {
+		table = pageTable();
+	}
+	if (page_number >= table->size()) {
+		throw InvalidPageException(page_number, filename_);
+	}
+	const PageMappingTable::Entry entry = table->entry(page_number);
+	char* bytes = reinterpret_cast<char*>(&page);
+	const off_t position = PageMappingTable::sectorPosition(entry.sector);
+	switch (entry.encoding) {
+		case ENCODING_EMPTY:
+			newPageImage(page_number, bytes);
+			return;
+		case ENCODING_RAW:
+			readAt(position, bytes, Page::SIZE);
+			return;
+		default:
+			break;
+	}
+	std::vector<char> stored(entry.bytes);
+	readAt(position, stored.data(), stored.size());
+	const bool decoded = entry.encoding == ENCODING_DELTA_LZ
+	    ? PageCodec::decompressDelta(stored.data(), stored.size(), bytes, Page::SIZE)
+	    : PageCodec::decompress(stored.data(), stored.size(), bytes, Page::SIZE);
+	if (!decoded) {
+		throw FileIOException(filename_, "corrupt compressed page");
+	}
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	std::lock_guard<std::recursive_mutex> guard(*latch_);
+	PageMappingTable* table = pageTable();
+	if (table == NULL) {
+		writeAt(pagePosition(new_page_number),
+		        reinterpret_cast<const char*>(&new_page), Page::SIZE);
+		return;
+	}
+	if (new_page_number >= table->size()) {
+		throw InvalidPageException(new_page_number, filename_);
+	}
+
+	// Keep whichever encoding is smaller; index nodes of sorted keys usually
+	// favour the delta one, anything else plain LZ.
+	const char* bytes = reinterpret_cast<const char*>(&new_page);
+	std::string lz;
+	std::string delta;
+	PageCodec::compress(bytes, Page::SIZE, lz);
+	PageCodec::compressDelta(bytes, Page::SIZE, delta);
+	PageEncoding encoding = ENCODING_LZ;
+	const std::string* smallest = &lz;
+	if (delta.size() < lz.size()) {
+		encoding = ENCODING_DELTA_LZ;
+		smallest = &delta;
+	}
+	const char* stored = smallest->data();
+	std::size_t length = smallest->size();
+	if (length >= Page::SIZE) {
+		encoding = ENCODING_RAW;
+		stored = bytes;
+		length = Page::SIZE;
+	}
+
+	const std::uint32_t sector = table->place(new_page_number, length, encoding);
+	const std::size_t padded =
+	    PageMappingTable::sectorsFor(length) * PageMappingTable::SECTOR_BYTES;
+	AlignedBuffer block = allocateAligned(filename_, padded);
+	std::memcpy(block.get(), stored, length);
+	std::memset(block.get() + length, 0, padded - length);
+	writeAt(PageMappingTable::sectorPosition(sector), block.get(), padded);
+}
+
+void BlobFile::writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages) {
+	if (pages.empty()) {
+		return;
+	}
+	if (compressed()) {
+		// Pages take varying space, so each one goes where the table puts it.
+		for (std::size_t i = 0; i < pages.size(); ++i) {
+			writePage(first_page_number + i, *pages[i]);
+		}
+		return;
+	}
+	AlignedBuffer run = allocateAligned(filename_, pages.size() * Page::SIZE);
+	for (std::size_t i = 0; i < pages.size(); ++i) {
+		std::memcpy(run.get() + i * Page::SIZE, pages[i], Page::SIZE);
+	}
+	writeAt(pagePosition(first_page_number), run.get(), pages.size() * Page::SIZE);
+}
+
+bool BlobFile::compressed() const {
+	std::lock_guard<std::recursive_mutex> guard(*latch_);
+	readHeader();
+	return cached_header_->page_table != NULL;
+}
+
+PageMappingTable* BlobFile::pageTable() const {
+	std::lock_guard<std::recursive_mutex> guard(*latch_);
+	const FileHeader header = readHeader();
+	PageMappingTable* table = cached_header_->page_table.get();
+	if (table != NULL && !cached_header_->table_loaded) {
+		AlignedBuffer block = allocateAligned(filename_, Page::SIZE);
+		readAt(PageMappingTable::DIRECTORY_OFFSET, block.get(),
+		       PageMappingTable::DIRECTORY_BYTES);
+		table->loadDirectory(block.get());
+		for (std::size_t chunk = 0; chunk < table->numChunks(); ++chunk) {
+			readAt(PageMappingTable::sectorPosition(table->chunkSector(chunk)),
+			       block.get(), Page::SIZE);
+			table->loadChunk(chunk, block.get());
+		}
+		table->finishLoad(header.num_pages);
+		cached_header_->table_loaded = true;
+	}
+	return table;
 }
 
 //delePage should not be called for a blob_file, not supported
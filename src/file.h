@@ -7,15 +7,20 @@
 
 #pragma once
 
-#include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
 
+#include "freeSpaceMap.h"
 #include "page.h"
+#include "pageMapping.h"
 
 namespace badgerdb {
 
+class Catalog;
 class FileIterator;
 
 /**
@@ -56,39 +61,219 @@ struct FileHeader {
   }
 };
 
+/**
+ * @brief In-memory copy of the header of an open file, shared by all File
+ *        objects of the file in this process.
+ */
+struct CachedFileHeader {
+  /**
+   * The header, valid once loaded is set.
+   */
+  FileHeader header;
+
+  /**
+   * Whether the header has been read from disk.
+   */
+  bool loaded;
+
+  /**
+   * Whether the header changed since it was last written to disk.
+   */
+  bool dirty;
+
+  /**
+   * Whether last_used_page is known.  It is found by walking the used list
+   * the first time it is needed.
+   */
+  bool last_used_known;
+
+  /**
+   * Page number of the last page in the used list of a PageFile, or
+   * Page::INVALID_NUMBER if the list is empty.
+   */
+  PageId last_used_page;
+
+  /**
+   * Free-space map of a PageFile that has one, NULL otherwise.
+   */
+  std::shared_ptr<FreeSpaceMap> free_space_map;
+
+  /**
+   * Whether the map pages of free_space_map have been read from disk.
+   */
+  bool map_loaded;
+
+  /**
+   * Number of pages the file grows by at a time.
+   */
+  PageId extent_pages;
+
+  /**
+   * End of the extent preallocated last.  Pages from header.num_pages up to
+   * it are on disk and hold the image of a newly allocated page.
+   */
+  PageId extent_end;
+
+  /**
+   * Page mapping table of a compressed BlobFile, NULL otherwise.
+   */
+  std::shared_ptr<PageMappingTable> page_table;
+
+  /**
+   * Whether the chunks of page_table have been read from disk.
+   */
+  bool table_loaded;
+
+  /**
+   * Whether other processes may add pages to the file, as they do through a
+   * SharedBufMgr.
+   */
+  bool shared;
+};
+
+/**
+ * @brief How the pages of a file are read and written.
+ */
+enum FileIoMode {
+  /**
+   * Through the kernel page cache.
+   */
+  FILE_IO_BUFFERED,
+
+  /**
+   * Bypassing the kernel page cache (O_DIRECT), so that the buffer pool is the
+   * only cache of the pages.
+   */
+  FILE_IO_DIRECT
+};
+
+/**
+ * @brief Whether the pages of a new BlobFile are compressed on disk.
+ */
+enum PageCompression {
+  /**
+   * Pages are stored as they are, Page::SIZE bytes each.
+   */
+  PAGE_COMPRESSION_NONE,
+
+  /**
+   * Each page is stored with whichever built-in encoding makes it smallest,
+   * in as many sectors as that takes (see PageMappingTable).
+   */
+  PAGE_COMPRESSION_AUTO
+};
+
+/**
+ * @brief Descriptor of an open file on disk, closed when the last File object
+ *        using it goes away.
+ */
+class FileDescriptor {
+ public:
+  /**
+   * Takes ownership of the given descriptor.
+   *
+   * @param fd        Open file descriptor.
+   * @param direct    Whether the descriptor was opened with O_DIRECT.
+   * @param aligned   Whether the file has the page-aligned layout.
+   */
+  FileDescriptor(const int fd, const bool direct, const bool aligned)
+      : fd_(fd), direct_(direct), aligned_(aligned) {}
+
+  /**
+   * Closes the descriptor.
+   */
+  ~FileDescriptor();
+
+  /**
+   * Returns the descriptor.
+   */
+  int fd() const { return fd_; }
+
+  /**
+   * Returns true if I/O on the descriptor bypasses the page cache.
+   */
+  bool direct() const { return direct_; }
+
+  /**
+   * Returns true if the file has the page-aligned layout.
+   */
+  bool aligned() const { return aligned_; }
+
+ private:
+  FileDescriptor(const FileDescriptor&);
+  FileDescriptor& operator=(const FileDescriptor&);
+
+  /**
+   * The descriptor.
+   */
+  const int fd_;
+
+  /**
+   * Whether the descriptor was opened with O_DIRECT.
+   */
+  const bool direct_;
+
+  /**
+   * Whether the file has the page-aligned layout: the header takes a whole
+   * page and page n starts at n * Page::SIZE.
+   */
+  const bool aligned_;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a descriptor of an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_files_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * Pages are read and written with positional I/O (pread/pwrite), so there is no
+ * shared file position and reads and writes of different pages may run
+ * concurrently, e.g. from a background thread of the buffer manager.  Writes
+ * are not flushed to the disk one by one; sync() makes them durable.
+ * All File objects of the same file share a latch which serializes the updates
+ * of the file header and of the page lists.
+ * Files may be opened and closed from several threads at once; the table of
+ * open files has a latch of its own.
  */
 
 
 class File {
  public:
 
+  /**
+   * Alignment of buffers, positions and lengths of direct I/O.
+   */
+  static const std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+  /**
+   * Default number of pages a file grows by at a time.
+   */
+  static const PageId DEFAULT_EXTENT_PAGES = 64;
+
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param mode        How pages are read and written.  If the file is open
+   *                    already, the mode it was first opened with is kept.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const FileIoMode mode = FILE_IO_BUFFERED);
 
   /**
-   * Deletes an existing file.
+   * Deletes an existing file, and drops its entry from the catalog set with
+   * setCatalog() if there is one.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the file doesn't exist.
@@ -97,7 +282,22 @@ class File {
   static void remove(const std::string& filename);
 
   /**
-   * Returns true if the file exists and is open.
+   * Sets the catalog relations are recorded in as PageFiles are created or
+   * opened, and files are dropped from as they are removed.
+   *
+   * @param catalog   Catalog to keep up to date, or NULL for none.  It has to
+   *                  outlive its use here.
+   */
+  static void setCatalog(Catalog* catalog);
+
+  /**
+   * Returns the catalog set with setCatalog(), or NULL.
+   */
+  static Catalog* catalog();
+
+  /**
+   * Returns true if the file is open.  Only the table of open files is
+   * looked at.
    *
    * @param filename  Name of the file.
    */
@@ -105,7 +305,7 @@ class File {
 
 
   /**
-   * Returns true if the file exists and is open.
+   * Returns true if the file exists, with a single stat() call.
    *
    * @param filename  Name of the file.
    */
@@ -124,6 +324,15 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, building it directly in the given page
+   * object (e.g. a buffer pool frame) instead of returning a copy.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page& new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +343,17 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page object
+   * (e.g. a buffer pool frame), without a temporary copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPageInto(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -143,6 +363,18 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes a run of pages with consecutive page numbers into the file,
+   * starting at the given page number.  The default implementation writes
+   * the pages one by one; subclasses write the run with a single write
+   * call.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the first page of the run.
+   * @param pages             Pages to write, in page-number order.
+   */
+  virtual void writePages(const PageId first_page_number,
+                          const std::vector<const Page*>& pages);
+
   /**
    * Deletes a page from the file.
    *
@@ -157,6 +389,75 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns true if pages are stored on disk exactly as they are in memory,
+   * so that they may be read and written at pageOffset() through
+   * descriptor() without going through this object, e.g. by asynchronous
+   * I/O.  Files that keep bookkeeping in their pages on disk return false.
+   */
+  virtual bool rawPages() const { return false; }
+
+  /**
+   * Returns the descriptor of the underlying file.
+   */
+  int descriptor() const { return handle_->fd(); }
+
+  /**
+   * Returns true if the pages of the file bypass the kernel page cache.
+   * This is false for a file opened in FILE_IO_DIRECT mode on a filesystem
+   * that does not support direct I/O.
+   */
+  bool directIo() const { return handle_->direct(); }
+
+  /**
+   * Returns the position of the page with the given number in the file.
+   *
+   * @param page_number   Number of page.
+   * @return  Position of page in file.
+   */
+  off_t pageOffset(const PageId page_number) const {
+    return pagePosition(page_number);
+  }
+
+  /**
+   * Forces the pages and the header written so far to the disk.
+   *
+   * @throws  FileIOException  If the data can not be synced.
+   */
+  void sync();
+
+  /**
+   * Writes the header, and the free-space map pages of a PageFile, to the file
+   * if they changed since they were last written.  Changes are otherwise kept
+   * in memory until sync() or until the last File object of the file is
+   * closed.
+   *
+   * @throws  FileIOException  If the header can not be written.
+   */
+  void flushHeader() const;
+
+  /**
+   * Tells the file that other processes may add pages to it, e.g. through a
+   * SharedBufMgr, so that a page past the end of the cached header is looked
+   * for on disk before it is rejected.
+   */
+  void markShared() const;
+
+  /**
+   * Sets the number of pages the file grows by at a time.  Pages of an extent
+   * are reserved with fallocate() where the filesystem supports it and
+   * written out once, so pages allocated from the extent later cost no I/O.
+   * The setting lasts while the file is open.
+   *
+   * @param pages   Number of pages per extent, at least 1.
+   */
+  void setExtentPages(const PageId pages);
+
+  /**
+   * Returns the number of pages the file grows by at a time.
+   */
+  PageId extentPages() const;
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -165,6 +466,19 @@ class File {
 	PageId getFirstPageNo();
 
  protected:
+  /**
+   * Constructs a file object for a file that lives inside another file on
+   * disk, sharing its descriptor, e.g. a file of a Tablespace.  The header is
+   * kept by the caller, not at the start of the descriptor's file, so
+   * subclasses override pagePosition() and storeHeader().
+   *
+   * @param name    Name the file is known by among open files.
+   * @param handle  Descriptor of the file on disk holding the pages.
+   * @param header  Header of the file.
+   */
+  File(const std::string& name, const std::shared_ptr<FileDescriptor>& handle,
+       const FileHeader& header);
+
   /**
    * Returns the position of the page with the given number in the file (as an
    * offset from the beginning of the file).
@@ -172,68 +486,208 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  virtual off_t pagePosition(const PageId page_number) const {
+    if (handle_->aligned()) {
+      return (off_t) page_number * Page::SIZE;
+    }
+    return sizeof(FileHeader) + ((off_t) (page_number - 1) * Page::SIZE);
   }
 
+  /**
+   * Reads bytes at the given position of the file.  Bytes past the end of the
+   * file read as zeros.  With direct I/O, ranges or buffers that are not
+   * aligned go through an aligned copy.
+   *
+   * @param position  Position in the file to read from.
+   * @param buffer    Buffer receiving the bytes.
+   * @param length    Number of bytes to read.
+   * @throws  FileIOException  If the read fails.
+   */
+  void readAt(const off_t position, char* buffer, const std::size_t length) const;
+
+  /**
+   * Writes bytes at the given position of the file.  With direct I/O, ranges
+   * or buffers that are not aligned go through an aligned copy, reading the
+   * partly written blocks first.
+   *
+   * @param position  Position in the file to write to.
+   * @param buffer    Bytes to write.
+   * @param length    Number of bytes to write.
+   * @throws  FileIOException  If the write fails.
+   */
+  void writeAt(const off_t position, const char* buffer,
+               const std::size_t length) const;
+
+  /**
+   * Makes sure the given page, which is past the used part of the file,
+   * holds the image of a newly allocated page on disk, preallocating a new
+   * extent that starts at it if needed.
+   *
+   * @param page_number   Number of the page about to be allocated.
+   * @throws  FileIOException  If the extent can not be written.
+   */
+  void prepareNewPage(const PageId page_number);
+
+  /**
+   * Builds the on-disk image of a newly allocated page.
+   *
+   * @param page_number   Number of the page.
+   * @param image         Receives Page::SIZE bytes.
+   */
+  virtual void newPageImage(const PageId page_number, char* image) const;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
+   * @param mode        How pages are read and written if the file is opened.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const bool create_new,
+                    const FileIoMode mode = FILE_IO_BUFFERED);
+
+  /**
+   * Opens the file named in filename_ on the given descriptor of another file,
+   * unless File objects of it exist already.
+   *
+   * @param handle  Descriptor of the file on disk holding the pages.
+   * @param header  Header of the file.
+   */
+  void openAttached(const std::shared_ptr<FileDescriptor>& handle,
+                    const FileHeader& header);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <handle_>.
    * This method only closes the file if no other File objects exist that access
-   * the same file.
+   * the same file, writing out the header first if it changed.
+   *
+   * @throws  FileIOException  If the header can not be written.  The file is
+   *                           closed anyway.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, reading it from disk the first time.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Drops the cached header, and the map or table read with it, if the file
+   * is shared and its header on disk changed since it was cached, e.g.
+   * because a worker of a SharedBufMgr added pages.  Nothing is dropped if
+   * this process has changes not written yet.
+   *
+   * @return  True if the header will be read again.
+   */
+  bool reloadHeader() const;
+
+  /**
+   * Replaces the header for this file.  The header goes to disk with
+   * flushHeader().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Stores the header where it is kept for good, called by flushHeader().
+   * Files write it at the start of the file on disk.
+   *
+   * @param header  File header to store.
+   * @throws  FileIOException  If the header can not be written.
+   */
+  virtual void storeHeader(const FileHeader& header) const;
+
+  typedef std::map<std::string, std::shared_ptr<FileDescriptor> > HandleMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<std::recursive_mutex> > LatchMap;
+  typedef std::map<std::string, std::shared_ptr<CachedFileHeader> > HeaderMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors of opened files.
    */
-  static StreamMap open_streams_;
+  static HandleMap open_files_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Latches guarding the headers and page lists of opened files.
+   */
+  static LatchMap open_latches_;
+
+  /**
+   * Cached headers of opened files.
+   */
+  static HeaderMap open_headers_;
+
+  /**
+   * Latch guarding the tables of opened files above.
+   */
+  static std::mutex open_files_latch_;
+
+  /**
+   * Catalog of relations kept up to date, or NULL; guarded by
+   * open_files_latch_.
+   */
+  static Catalog* catalog_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object.
+   */
+  std::shared_ptr<FileDescriptor> handle_;
+
+  /**
+   * Latch held while the header or the page lists are read and updated.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<std::recursive_mutex> latch_;
 
+  /**
+   * Cached header of the file, guarded by latch_.
+   */
+  std::shared_ptr<CachedFileHeader> cached_header_;
+
+ private:
+  /**
+   * Shares the descriptor, latch and header of the file named in filename_ if
+   * File objects of it exist already.
+   *
+   * @return  True if the file was open.
+   */
+  bool shareIfOpen();
+
+  /**
+   * Registers the file named in filename_, with the descriptor in handle_, as
+   * opened by this object, with a fresh latch and header cache.
+   */
+  void registerOpen();
+
+ protected:
+  /**
+   * Records the file as a relation in the catalog set with setCatalog(), if
+   * there is one and the file is not in it yet.
+   *
+   * @throws  FileIOException  If the name is too long for the catalog.
+   */
+  void recordRelation() const;
+
+ private:
   friend class FileIterator;
+  friend class Tablespace;
 };
 
 class PageFile : public File {
@@ -243,33 +697,39 @@ class PageFile : public File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param mode      How pages are read and written.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static PageFile create(const std::string& filename);
+  static PageFile create(const std::string& filename,
+                         const FileIoMode mode = FILE_IO_BUFFERED);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_files_ map.
    *
    * @param filename  Name of the file.
+   * @param mode      How pages are read and written.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static PageFile open(const std::string& filename);
+  static PageFile open(const std::string& filename,
+                       const FileIoMode mode = FILE_IO_BUFFERED);
 
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param mode        How pages are read and written.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const FileIoMode mode = FILE_IO_BUFFERED);
 
   /**
    * Copy constructor.
@@ -300,6 +760,14 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in the given page object.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +778,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -319,6 +797,16 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page) override;
 
+  /**
+   * Writes a run of pages with consecutive page numbers into the file with a
+   * single write call.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the first page of the run.
+   * @param pages             Pages to write, in page-number order.
+   */
+  void writePages(const PageId first_page_number,
+                  const std::vector<const Page*>& pages) override;
+
   /**
    * Deletes a page from the file.
    *
@@ -333,6 +821,24 @@ class PageFile : public File {
    */
   FileIterator begin();
 
+  /**
+   * Returns true if the file keeps a free-space map.  Files created before
+   * the map existed keep their free pages in a list instead.
+   */
+  bool hasFreeSpaceMap() const;
+
+  /**
+   * Returns a used page that had at least the given number of bytes free for
+   * a new record, slot included, when it was last written to the file.  Pages
+   * changed in the buffer pool since then may have less, so callers still
+   * handle InsufficientSpaceException.  Without a free-space map, the used
+   * pages are looked at one by one.
+   *
+   * @param record_bytes  Length of the record to place.
+   * @return  Page number, or Page::INVALID_NUMBER if no page has the space.
+   */
+  PageId findPageWithSpace(const std::size_t record_bytes);
+
   /**
    * Returns an iterator representing the page after the last page in the file.
    * This iterator should not be dereferenced.
@@ -341,14 +847,32 @@ class PageFile : public File {
    */
   FileIterator end();
 
+ protected:
+  /**
+   * Returns true if the given page holds part of the free-space map, and so
+   * is never handed out as a page of the file.
+   *
+   * @param page_number   Number of page.
+   */
+  bool isMapPage(const PageId page_number) const;
+
+  /**
+   * Builds the image of a newly allocated page: an empty page carrying its
+   * page number, or zeros for a free-space map page.
+   *
+   * @param page_number   Number of the page.
+   * @param image         Receives Page::SIZE bytes.
+   */
+  void newPageImage(const PageId page_number, char* image) const override;
+
  private:
 
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -358,6 +882,20 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page object.  If <allow_free>
+   * is not set, an exception will be thrown if the page read from disk is not
+   * currently in use.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPageInto(const PageId page_number, Page& page,
+                    const bool allow_free) const;
+
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
@@ -379,6 +917,66 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk.  No bounds checking is
+   * performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header of page.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns the last page in the used list, walking the list the first time
+   * it is asked for.
+   *
+   * @return  Number of the last used page, or Page::INVALID_NUMBER if no page
+   *          is used.
+   */
+  PageId lastUsedPage() const;
+
+  /**
+   * Records the last page in the used list.
+   *
+   * @param page_number   Number of the last used page, or
+   *                      Page::INVALID_NUMBER if no page is used.
+   */
+  void setLastUsedPage(const PageId page_number);
+
+  /**
+   * Returns the free-space map, reading its pages the first time.  The latch
+   * must be held while the map is used.
+   *
+   * @return  The map, or NULL if the file has none.
+   */
+  FreeSpaceMap* spaceMap() const;
+
+  /**
+   * Returns the used page after the given one, in page-number order.
+   *
+   * @param page_number   Number of a used page.
+   * @return  Number of the next used page, or Page::INVALID_NUMBER.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
+  /**
+   * Allocates a page in a file with a free-space map.
+   *
+   * @param map               The free-space map of the file.
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocateMappedPage(FreeSpaceMap& map, PageId &new_page_number,
+                          Page& new_page);
+
+  /**
+   * Deletes a page from a file with a free-space map.
+   *
+   * @param map           The free-space map of the file.
+   * @param page_number   Number of page to delete.
+   */
+  void deleteMappedPage(FreeSpaceMap& map, const PageId page_number);
+
   friend class FileIterator;
 };
 
@@ -388,22 +986,29 @@ class BlobFile : public File {
   /**
    * Creates a new BlobFile.
    *
-   * @param filename  Name of the file.
+   * @param filename    Name of the file.
+   * @param mode        How pages are read and written.
+   * @param compression Whether pages are compressed on disk.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static BlobFile create(const std::string& filename);
+  static BlobFile create(const std::string& filename,
+                         const FileIoMode mode = FILE_IO_BUFFERED,
+                         const PageCompression compression =
+                             PAGE_COMPRESSION_NONE);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_files_ map.
    *
    * @param filename  Name of the file.
+   * @param mode      How pages are read and written.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static BlobFile open(const std::string& filename);
+  static BlobFile open(const std::string& filename,
+                       const FileIoMode mode = FILE_IO_BUFFERED);
 
   /**
    * Constructs a file object representing a file on the filesystem.
@@ -412,12 +1017,17 @@ class BlobFile : public File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param mode        How pages are read and written.
+   * @param compression Whether pages of a new file are compressed on disk.
+   *                    An existing file keeps the choice it was created with.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  BlobFile(const std::string& name, const bool create_new);
+  BlobFile(const std::string& name, const bool create_new,
+           const FileIoMode mode = FILE_IO_BUFFERED,
+           const PageCompression compression = PAGE_COMPRESSION_NONE);
 
   /**
    * Copy constructor.
@@ -448,6 +1058,14 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in the given page object.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +1076,16 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -467,12 +1095,48 @@ class BlobFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page) override;
 
+  /**
+   * Writes a run of pages with consecutive page numbers into the file with a
+   * single write call.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the first page of the run.
+   * @param pages             Pages to write, in page-number order.
+   */
+  void writePages(const PageId first_page_number,
+                  const std::vector<const Page*>& pages) override;
+
   /**
    * Deletes a page from the file.
    *
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number) override;
+
+  /**
+   * Pages of a BlobFile are stored as they are unless it is compressed.
+   */
+  bool rawPages() const override { return !compressed(); }
+
+  /**
+   * Returns true if the pages of this file are compressed on disk.
+   */
+  bool compressed() const;
+
+ protected:
+  /**
+   * Builds the image of a newly allocated page, an empty page.
+   *
+   * @param page_number   Number of the page.
+   * @param image         Receives Page::SIZE bytes.
+   */
+  void newPageImage(const PageId page_number, char* image) const override;
+
+ private:
+  /**
+   * Returns the page mapping table of a compressed file, reading it on first
+   * use, or NULL if the file is not compressed.
+   */
+  PageMappingTable* pageTable() const;
 };
 
 }
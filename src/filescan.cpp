@@ -5,18 +5,49 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const bool bulkRead)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
+	strategy = bulkRead ? new BufAccessStrategy() : NULL;
 	curDirtyFlag = false;
   curPage = NULL;
 	filePageIter = file->begin();
+	pagesAhead = 0;
+	readAheadWindow = 0;
+	maxReadAhead = DEFAULT_READ_AHEAD;
+}
+
+void FileScan::setReadAhead(const std::uint32_t maxPages)
+{
+	maxReadAhead = maxPages;
+	readAheadWindow = std::min(readAheadWindow, maxReadAhead);
+}
+
+void FileScan::readAhead()
+{
+	if (maxReadAhead == 0 || pagesAhead > readAheadWindow / 2)
+	{
+		return;
+	}
+
+	std::vector<PageId> pageIds;
+	while (pagesAhead < readAheadWindow && readAheadIter != file->end())
+	{
+		pageIds.push_back(readAheadIter.getCurrentPageNo());
+		readAheadIter++;
+		pagesAhead++;
+	}
+	bufMgr->prefetch(file, pageIds, strategy);
+
+	// the scan is sequential, keep widening the window up to the maximum
+	readAheadWindow = std::min(std::max(readAheadWindow * 2, (std::uint32_t) 2), maxReadAhead);
 }
 
 FileScan::~FileScan()
@@ -24,13 +55,14 @@ FileScan::~FileScan()
   // generally must unpin last page of the scan
   if (curPage != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.getCurrentPageNo(), curDirtyFlag, strategy);
     curPage = NULL;
 		curDirtyFlag = false;
     filePageIter = file->begin();
   }
   bufMgr->flushFile(file);
   delete file;
+  delete strategy;
 }
 
 void FileScan::scanNext(RecordId& outRid)
@@ -52,8 +84,15 @@ void FileScan::scanNext(RecordId& outRid)
 			throw EndOfFileException();
 		}
 	 
+		// start reading ahead behind the first page
+		readAheadIter = filePageIter;
+		readAheadIter++;
+		pagesAhead = 0;
+		readAheadWindow = std::min((std::uint32_t) 2, maxReadAhead);
+		readAhead();
+
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
+    bufMgr->readPage(file, filePageIter.getCurrentPageNo(), curPage, strategy);
 		curDirtyFlag = false;
 
 		// get the first record off the page
@@ -76,7 +115,7 @@ void FileScan::scanNext(RecordId& outRid)
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.getCurrentPageNo(), curDirtyFlag, strategy);
     curPage = NULL;
     curDirtyFlag = false;
 
@@ -87,8 +126,13 @@ void FileScan::scanNext(RecordId& outRid)
 			throw EndOfFileException();
     }
 
+    // the new page was part of the read-ahead window
+    if (pagesAhead > 0)
+      pagesAhead--;
+    readAhead();
+
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    bufMgr->readPage(file, filePageIter.getCurrentPageNo(), curPage, strategy);
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
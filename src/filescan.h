@@ -9,6 +9,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -24,10 +25,33 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens the relation for a sequential scan.
+   *
+   * @param name      Name of the relation file.
+   * @param bufMgr    Buffer Manager instance used to read the pages.
+   * @param bulkRead  If true, pages are read through a private ring of frames so the scan
+   *                  does not evict the rest of the buffer pool.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const bool bulkRead = true);
 
   ~FileScan();
 
+  /**
+   * Default maximum number of pages the scan reads ahead of the current page.
+   */
+  static const std::uint32_t DEFAULT_READ_AHEAD = 8;
+
+  /**
+   * Sets how many pages the scan may keep in flight ahead of the current page.
+   * The read-ahead window starts small and doubles while the scan proceeds,
+   * up to this maximum. With bulk reading the maximum should stay well below
+   * the ring size of the scan.
+   *
+   * @param maxPages  Maximum read-ahead window in pages, 0 disables read-ahead.
+   */
+  void setReadAhead(const std::uint32_t maxPages);
+
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
@@ -48,6 +72,11 @@ class FileScan
    */
 	BufMgr				*bufMgr;
 
+  /**
+   * Bulk-read strategy the pages are read with, NULL to read through the shared pool.
+   */
+  BufAccessStrategy *strategy;
+
   /**
    * Current page being scanned.
    */
@@ -56,6 +85,32 @@ class FileScan
   FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
+  /**
+   * First page of the file which has not been handed to the prefetcher yet.
+   */
+  FileIterator  readAheadIter;
+
+  /**
+   * Number of pages requested ahead of the current page.
+   */
+  std::uint32_t pagesAhead;
+
+  /**
+   * Current read-ahead window in pages.
+   */
+  std::uint32_t readAheadWindow;
+
+  /**
+   * Upper bound of the read-ahead window in pages.
+   */
+  std::uint32_t maxReadAhead;
+
+  /**
+   * Tops the pages in flight up to the read-ahead window once half of it has
+   * been consumed, and widens the window for the next round.
+   */
+  void readAhead();
+
   /**
    * True if page has been updated
    */
@@ -0,0 +1,141 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "freeSpaceMap.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace badgerdb {
+
+const PageId FreeSpaceMap::ENTRIES_PER_MAP_PAGE;
+const std::size_t FreeSpaceMap::BUCKET_BYTES;
+const std::uint32_t FreeSpaceMap::MAGIC;
+const std::uint8_t FreeSpaceMap::FREE;
+const std::uint8_t FreeSpaceMap::RESERVED;
+
+namespace {
+
+// Number of the group of map page and data pages a page belongs to.
+std::size_t groupOf(const PageId page_number) {
+  return (page_number - 1) / (FreeSpaceMap::ENTRIES_PER_MAP_PAGE + 1);
+}
+
+}
+
+FreeSpaceMap::FreeSpaceMap()
+    : entries_(1, RESERVED),
+      first_free_(1) {
+}
+
+void FreeSpaceMap::grow(const PageId num_pages) {
+  for (PageId page_number = size(); page_number < num_pages; ++page_number) {
+    entries_.push_back(isMapPage(page_number) ? RESERVED : FREE);
+    if (groupOf(page_number) >= group_max_.size()) {
+      group_max_.push_back(FREE);
+    }
+  }
+}
+
+bool FreeSpaceMap::isUsed(const PageId page_number) const {
+  return page_number < size() && entries_[page_number] != FREE &&
+         entries_[page_number] != RESERVED;
+}
+
+void FreeSpaceMap::setUsed(const PageId page_number,
+                           const std::size_t free_bytes) {
+  set(page_number, usedEntry(free_bytes));
+}
+
+void FreeSpaceMap::setFree(const PageId page_number) {
+  set(page_number, FREE);
+  first_free_ = std::min(first_free_, page_number);
+}
+
+PageId FreeSpaceMap::findFree() {
+  while (first_free_ < size() && entries_[first_free_] != FREE) {
+    ++first_free_;
+  }
+  return first_free_ < size() ? first_free_ : Page::INVALID_NUMBER;
+}
+
+PageId FreeSpaceMap::findSpace(const std::size_t free_bytes) {
+  const std::size_t needed =
+      1 + (free_bytes + BUCKET_BYTES - 1) / BUCKET_BYTES;
+  if (needed >= RESERVED) {
+    return Page::INVALID_NUMBER;
+  }
+  for (std::size_t group = 0; group < group_max_.size(); ++group) {
+    if (group_max_[group] < needed) {
+      continue;
+    }
+    const PageId first = group * (ENTRIES_PER_MAP_PAGE + 1) + 2;
+    const PageId last = std::min<PageId>(first + ENTRIES_PER_MAP_PAGE, size());
+    std::uint8_t largest = FREE;
+    for (PageId page_number = first; page_number < last; ++page_number) {
+      const std::uint8_t entry = entries_[page_number];
+      if (entry >= needed) {
+        return page_number;
+      }
+      largest = std::max(largest, entry);
+    }
+    // Nothing here; remember the real largest entry to skip the group later.
+    group_max_[group] = largest;
+  }
+  return Page::INVALID_NUMBER;
+}
+
+PageId FreeSpaceMap::nextUsed(const PageId page_number) const {
+  for (PageId next = page_number + 1; next < size(); ++next) {
+    if (entries_[next] != FREE && entries_[next] != RESERVED) {
+      return next;
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+void FreeSpaceMap::load(const PageId map_page, const char* bytes) {
+  assert(isMapPage(map_page));
+  for (PageId i = 0; i < ENTRIES_PER_MAP_PAGE; ++i) {
+    const PageId page_number = map_page + 1 + i;
+    if (page_number >= size()) {
+      break;
+    }
+    const std::uint8_t entry = static_cast<std::uint8_t>(bytes[i]);
+    entries_[page_number] = entry == RESERVED ? FREE : entry;
+    group_max_[groupOf(page_number)] =
+        std::max(group_max_[groupOf(page_number)], entries_[page_number]);
+  }
+  first_free_ = std::min(first_free_, map_page + 1);
+}
+
+void FreeSpaceMap::store(const PageId map_page, char* bytes) const {
+  assert(isMapPage(map_page));
+  for (PageId i = 0; i < ENTRIES_PER_MAP_PAGE; ++i) {
+    const PageId page_number = map_page + 1 + i;
+    bytes[i] = page_number < size() ? static_cast<char>(entries_[page_number])
+                                    : static_cast<char>(FREE);
+  }
+}
+
+std::uint8_t FreeSpaceMap::usedEntry(const std::size_t free_bytes) {
+  return static_cast<std::uint8_t>(
+      1 + std::min<std::size_t>(RESERVED - 2, free_bytes / BUCKET_BYTES));
+}
+
+void FreeSpaceMap::set(const PageId page_number, const std::uint8_t entry) {
+  assert(page_number < size() && entries_[page_number] != RESERVED);
+  if (entries_[page_number] == entry) {
+    return;
+  }
+  entries_[page_number] = entry;
+  const std::size_t group = groupOf(page_number);
+  group_max_[group] = std::max(group_max_[group], entry);
+  dirty_.insert(mapPageOf(page_number));
+}
+
+}
@@ -0,0 +1,199 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Map of the pages of a PageFile that are in use and of how much free
+ *        space each of them has.
+ *
+ * The map has one byte per page.  A zero byte marks a page that is not in use;
+ * any other byte marks a used page and buckets its free space in steps of
+ * BUCKET_BYTES.  On disk, the bytes are kept in map pages that sit at fixed
+ * positions in the file: page 1 holds the bytes of the ENTRIES_PER_MAP_PAGE
+ * pages after it, the next map page follows those, and so on.
+ *
+ * This class only keeps the map in memory and knows the layout; the file
+ * reads and writes the map pages.
+ */
+class FreeSpaceMap {
+ public:
+  /**
+   * Number of pages whose bytes one map page holds.
+   */
+  static const PageId ENTRIES_PER_MAP_PAGE = Page::SIZE;
+
+  /**
+   * Granularity of the free space recorded for a page.
+   */
+  static const std::size_t BUCKET_BYTES = 32;
+
+  /**
+   * Value stored after the file header of files that have a map.
+   */
+  static const std::uint32_t MAGIC = 0x46534d31;  // "FSM1"
+
+  /**
+   * Returns true if the page with the given number is a map page.
+   *
+   * @param page_number   Number of page.
+   */
+  static bool isMapPage(const PageId page_number) {
+    return page_number != Page::INVALID_NUMBER &&
+           (page_number - 1) % (ENTRIES_PER_MAP_PAGE + 1) == 0;
+  }
+
+  /**
+   * Constructs an empty map, for a file with only the header page.
+   */
+  FreeSpaceMap();
+
+  /**
+   * Extends the map to cover the given number of pages.  New data pages are
+   * not in use.
+   *
+   * @param num_pages   Number of pages in the file, including the header page.
+   */
+  void grow(const PageId num_pages);
+
+  /**
+   * Returns the number of pages the map covers.
+   */
+  PageId size() const { return static_cast<PageId>(entries_.size()); }
+
+  /**
+   * Returns true if the given data page is in use.
+   *
+   * @param page_number   Number of page.
+   */
+  bool isUsed(const PageId page_number) const;
+
+  /**
+   * Marks the given data page as used with the given free space.
+   *
+   * @param page_number   Number of page.
+   * @param free_bytes    Free space of the page.
+   */
+  void setUsed(const PageId page_number, const std::size_t free_bytes);
+
+  /**
+   * Marks the given data page as not in use.
+   *
+   * @param page_number   Number of page.
+   */
+  void setFree(const PageId page_number);
+
+  /**
+   * Returns the lowest numbered data page that is not in use.
+   *
+   * @return  Page number, or Page::INVALID_NUMBER if all pages are used.
+   */
+  PageId findFree();
+
+  /**
+   * Returns the lowest numbered used page with at least the given free space.
+   *
+   * @param free_bytes  Free space needed.
+   * @return  Page number, or Page::INVALID_NUMBER if no page has the space.
+   */
+  PageId findSpace(const std::size_t free_bytes);
+
+  /**
+   * Returns the lowest numbered used page after the given one.
+   *
+   * @param page_number   Number of page to start after.
+   * @return  Page number, or Page::INVALID_NUMBER if there is none.
+   */
+  PageId nextUsed(const PageId page_number) const;
+
+  /**
+   * Fills the bytes of the given map page in from their on-disk form.
+   *
+   * @param map_page  Number of the map page.
+   * @param bytes     ENTRIES_PER_MAP_PAGE bytes of the map page.
+   */
+  void load(const PageId map_page, const char* bytes);
+
+  /**
+   * Writes the bytes of the given map page out in their on-disk form.
+   *
+   * @param map_page  Number of the map page.
+   * @param bytes     Receives ENTRIES_PER_MAP_PAGE bytes.
+   */
+  void store(const PageId map_page, char* bytes) const;
+
+  /**
+   * Returns the map pages changed since clean() was last called.
+   */
+  const std::set<PageId>& dirtyMapPages() const { return dirty_; }
+
+  /**
+   * Forgets about changed map pages, once they have been written.
+   */
+  void clean() { dirty_.clear(); }
+
+ private:
+  /**
+   * Entry of a page that is not in use.
+   */
+  static const std::uint8_t FREE = 0;
+
+  /**
+   * In-memory entry of the header page and of map pages, which are never
+   * handed out.
+   */
+  static const std::uint8_t RESERVED = 0xff;
+
+  /**
+   * Returns the map page holding the byte of the given data page.
+   */
+  static PageId mapPageOf(const PageId page_number) {
+    return page_number - (page_number - 1) % (ENTRIES_PER_MAP_PAGE + 1);
+  }
+
+  /**
+   * Returns the entry of a used page with the given free space.
+   */
+  static std::uint8_t usedEntry(const std::size_t free_bytes);
+
+  /**
+   * Sets the entry of a data page and remembers its map page as changed.
+   */
+  void set(const PageId page_number, const std::uint8_t entry);
+
+  /**
+   * One entry per page, indexed by page number.
+   */
+  std::vector<std::uint8_t> entries_;
+
+  /**
+   * Largest entry of each map page's data pages, indexed by the number of
+   * the map page's group.  It may be too large but never too small, so
+   * groups below the entry a search needs are skipped.
+   */
+  std::vector<std::uint8_t> group_max_;
+
+  /**
+   * No data page below this one is free.
+   */
+  PageId first_free_;
+
+  /**
+   * Map pages changed since they were last written.
+   */
+  std::set<PageId> dirty_;
+};
+
+}
@@ -6,9 +6,21 @@
  */
 
 #include <vector>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "bufPoolGroup.h"
+#include "sharedBufMgr.h"
+#include "mmapFile.h"
+#include "asyncIo.h"
+#include "tablespace.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
 #include "exceptions/insufficient_space_exception.h"
@@ -17,8 +29,12 @@
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -90,18 +106,45 @@ void myTest3_LargeRelationRandom();
 void myTest4_Empty();
 void myTest5_NegativeForward();
 void myTest6_NegativeBackward();
+void myTest7_BulkReadScan();
+void myTest8_ResizePool();
+void myTest9_PoolGroup();
+void myTest10_BufStats();
+void myTest11_PageGuard();
+void myTest12_WarmUp();
+void myTest13_VictimCache();
+void myTest14_OptimisticRead();
+void myTest15_Admission();
+void myTest16_SharedPool();
+void myTest17_FileBackend();
+void myTest18_MmapFile();
+void myTest19_AsyncIo();
+void myTest20_DirectIo();
+void myTest21_HeaderCache();
+void myTest22_FreeSpaceMap();
+void myTest23_Extents();
+void myTest24_Compression();
+void myTest25_Tablespace();
+void myTest26_Catalog();
+void myTest27_BgWriter();
 
 int main(int argc, char **argv)
 {
 
   // Clean up from any previous runs that crashed.
-  try
+	std::ostringstream idxStr;
+	idxStr << relationName << "." << offsetof(tuple,i);
+	intIndexName = idxStr.str();
+	for (const std::string& name : {relationName, intIndexName})
 	{
-    File::remove(relationName);
-  }
-	catch(const FileNotFoundException &)
-	{
-  }
+		try
+		{
+			File::remove(name);
+		}
+		catch(const FileNotFoundException &)
+		{
+		}
+	}
 
 	{
 		// Create a new database file.
@@ -150,6 +193,31 @@ int main(int argc, char **argv)
 
 	File::remove(relationName);
 
+	//----------------buffer and file tests----------------
+	// These run ahead of the index tests below so that they are not held up
+	// by them.
+	myTest7_BulkReadScan();
+	myTest8_ResizePool();
+	myTest9_PoolGroup();
+	myTest10_BufStats();
+	myTest11_PageGuard();
+	myTest12_WarmUp();
+	myTest13_VictimCache();
+	myTest14_OptimisticRead();
+	myTest15_Admission();
+	myTest16_SharedPool();
+	myTest17_FileBackend();
+	myTest18_MmapFile();
+	myTest19_AsyncIo();
+	myTest20_DirectIo();
+	myTest21_HeaderCache();
+	myTest22_FreeSpaceMap();
+	myTest23_Extents();
+	myTest24_Compression();
+	myTest25_Tablespace();
+	myTest26_Catalog();
+	myTest27_BgWriter();
+
 	test1();
 	test2();
 	test3();
@@ -166,7 +234,7 @@ int main(int argc, char **argv)
 
 	delete bufMgr;
 
-  return 1;
+  return 0;
 }
 
 void test1()
@@ -926,7 +994,7 @@ void myTest1_LargeRelationForward()
 	std::cout << "---------------------" << std::endl;
 	std::cout << "create a relation forward with larger size" << std::endl;
 	createRelationForward3(20000);
-	intTests();
+	indexTests();
 	deleteRelation();
 }
 
@@ -936,7 +1004,7 @@ void myTest2_LargeRelationBackward()
 	std::cout << "---------------------" << std::endl;
 	std::cout << "create a relation backward with larger size" << std::endl;
 	createRelationBackward3(20000);
-	intTests();
+	indexTests();
 	deleteRelation();
 }
 
@@ -946,7 +1014,7 @@ void myTest3_LargeRelationRandom()
 	std::cout << "---------------------" << std::endl;
 	std::cout << "create a relation random with larger size" << std::endl;
 	createRelationRandom2(20000);
-	intTests();
+	indexTests();
 	deleteRelation();
 }
 
@@ -980,7 +1048,1573 @@ void myTest6_NegativeBackward()
 	deleteRelation();
 }
 
+void myTest7_BulkReadScan()
+{
+	// Scan a relation twice the size of the buffer pool and make sure the scan leaves the hot pages alone
+	std::cout << "---------------------" << std::endl;
+	std::cout << "bulk-read scan of a relation larger than the buffer pool" << std::endl;
+	createRelationForward3(20000);
+
+	std::vector<PageId> hotPages;
+	Page *page;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && hotPages.size() < 10; iter++)
+	{
+		PageId pageNo = (*iter).page_number();
+		bufMgr->readPage(file1, pageNo, page);
+		bufMgr->unPinPage(file1, pageNo, false);
+		hotPages.push_back(pageNo);
+	}
+
+	{
+		FileScan fscan(relationName, bufMgr);
+		int numRecords = 0;
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				fscan.scanNext(scanRid);
+				numRecords++;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		checkPassFail(numRecords, 20000)
+	}
+
+	int diskreads = bufMgr->getBufStats().diskreads;
+	for (size_t i = 0; i < hotPages.size(); i++)
+	{
+		bufMgr->readPage(file1, hotPages[i], page);
+		bufMgr->unPinPage(file1, hotPages[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads - diskreads, 0)
+
+	deleteRelation();
+}
+
+void myTest8_ResizePool()
+{
+	// Grow the buffer pool under a working set that does not fit, then shrink it back while pages are cached
+	std::cout << "---------------------" << std::endl;
+	std::cout << "online resize of the buffer pool" << std::endl;
+	createRelationForward3(20000);
+
+	std::vector<PageId> pages;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 150; iter++)
+	{
+		pages.push_back((*iter).page_number());
+	}
+
+	bufMgr->resize(200);
+	checkPassFail(bufMgr->getNumBufs(), 200)
+
+	Page *page;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+	}
+
+	// the pages pinned in the upper half of the pool cannot be cut off
+	bool pinned = false;
+	try
+	{
+		bufMgr->resize(100);
+	}
+	catch (const PagePinnedException &e)
+	{
+		pinned = true;
+	}
+	checkPassFail(pinned, true)
+	checkPassFail(bufMgr->getNumBufs(), 200)
+
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+
+	int diskreads = bufMgr->getBufStats().diskreads;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads - diskreads, 0)
+
+	bufMgr->resize(100);
+	checkPassFail(bufMgr->getNumBufs(), 100)
+
+	{
+		FileScan fscan(relationName, bufMgr);
+		int numRecords = 0;
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				fscan.scanNext(scanRid);
+				numRecords++;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+		checkPassFail(numRecords, 20000)
+	}
+
+	deleteRelation();
+}
+
+void myTest9_PoolGroup()
+{
+	// Cap the frames of a relation, then read it and an index file through pools of their own
+	std::cout << "---------------------" << std::endl;
+	std::cout << "file quotas and buffer pool groups" << std::endl;
+	createRelationForward3(5000);
+
+	std::vector<PageId> pages;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 6; iter++)
+	{
+		pages.push_back((*iter).page_number());
+	}
+
+	// with its quota pinned the relation cannot take a sixth frame, although the pool has room
+	bufMgr->setFileQuota(relationName, 5);
+	Page *page;
+	for (size_t i = 0; i < 5; i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+	}
+	bool exceeded = false;
+	try
+	{
+		bufMgr->readPage(file1, pages[5], page);
+	}
+	catch (const BufferExceededException &e)
+	{
+		exceeded = true;
+	}
+	checkPassFail(exceeded, true)
+
+	for (size_t i = 0; i < 5; i++)
+	{
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+	bufMgr->readPage(file1, pages[5], page);
+	bufMgr->unPinPage(file1, pages[5], false);
+	bufMgr->setFileQuota(relationName, 0);
+
+	{
+		const std::string indexFileName = relationName + ".group";
+		try
+		{
+			File::remove(indexFileName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+
+		BufPoolGroup pools("heap", 20);
+		pools.addPool("index", 50);
+		pools.bindFile(indexFileName, "index");
+		bool indexBound = pools.poolFor(indexFileName) == pools.getPool("index");
+		bool relationDefault = pools.poolFor(relationName) == pools.getDefaultPool();
+		checkPassFail(indexBound, true)
+		checkPassFail(relationDefault, true)
+
+		// the relation is scanned through the default pool
+		{
+			FileScan fscan(relationName, pools.poolFor(relationName));
+			int records = 0;
+			try
+			{
+				RecordId scanRid;
+				while (1)
+				{
+					fscan.scanNext(scanRid);
+					records++;
+				}
+			}
+			catch (const EndOfFileException &e)
+			{
+			}
+			checkPassFail(records, 5000)
+		}
+
+		// pages of the bound file go through its own pool and come back intact
+		{
+			BlobFile indexFile = BlobFile::create(indexFileName);
+			BufMgr* indexPool = pools.poolFor(&indexFile);
+			std::vector<PageId> indexPages(10);
+			for (size_t i = 0; i < indexPages.size(); i++)
+			{
+				Page* page;
+				indexPool->allocPage(&indexFile, indexPages[i], page);
+				sprintf(reinterpret_cast<char*>(page), "index page %d", (int) i);
+				indexPool->unPinPage(&indexFile, indexPages[i], true);
+			}
+			indexPool->flushFile(&indexFile);
+
+			Page* page;
+			indexPool->readPage(&indexFile, indexPages[7], page);
+			checkPassFail(std::string(reinterpret_cast<char*>(page)), std::string("index page 7"))
+			indexPool->unPinPage(&indexFile, indexPages[7], false);
+			indexPool->flushFile(&indexFile);
+		}
+		checkPassFail(pools.getDefaultPool()->getBufStats().diskwrites, 0)
+		checkPassFail(pools.getPool("index")->getBufStats().diskwrites, 10)
+		bool heapRead = pools.getDefaultPool()->getBufStats().diskreads > 0;
+		checkPassFail(heapRead, true)
+		File::remove(indexFileName);
+	}
+
+	deleteRelation();
+}
+
+void myTest10_BufStats()
+{
+	// Count a miss and a hit on a page of a cold relation and export them
+	std::cout << "---------------------" << std::endl;
+	std::cout << "buffer pool statistics" << std::endl;
+	createRelationForward3(2000);
+	bufMgr->flushFile(file1);
+	bufMgr->clearBufStats();
+
+	PageId pageNo = (*file1->begin()).page_number();
+	Page *page;
+	for (int i = 0; i < 2; i++)
+	{
+		bufMgr->readPage(file1, pageNo, page);
+		bufMgr->unPinPage(file1, pageNo, false);
+	}
+
+	BufStats stats = bufMgr->getBufStatsSnapshot();
+	checkPassFail(stats.hits, 1)
+	checkPassFail(stats.misses, 1)
+	checkPassFail(stats.diskreads, 1)
+	checkPassFail(stats.readLatency.count, 1)
+	checkPassFail(stats.files[relationName].misses, 1)
+
+	bool exported = stats.toJson().find("\"misses\":1,") != std::string::npos;
+	checkPassFail(exported, true)
+	std::cout << stats.toText();
+
+	deleteRelation();
+}
+
+void myTest11_PageGuard()
+{
+	// Pages held by guards are unpinned when the guards go away, also when an exception is thrown
+	std::cout << "---------------------" << std::endl;
+	std::cout << "page guards" << std::endl;
+	createRelationForward3(1000);
+
+	PageId pageNo = (*file1->begin()).page_number();
+	try
+	{
+		PageGuard guard = bufMgr->readPage(file1, pageNo);
+		PageGuard moved = std::move(guard);
+		checkPassFail(guard.holdsPage(), false)
+		checkPassFail(moved.getPageNo(), pageNo)
+		throw EndOfFileException();
+	}
+	catch (const EndOfFileException &e)
+	{
+	}
+
+	bool unpinned = true;
+	try
+	{
+		bufMgr->flushFile(file1);
+	}
+	catch (const PagePinnedException &e)
+	{
+		unpinned = false;
+	}
+	checkPassFail(unpinned, true)
+
+	deleteRelation();
+}
+
+void myTest12_WarmUp()
+{
+	// Save the pages of a relation resident in the pool, evict them and bring them back from the snapshot
+	std::cout << "---------------------" << std::endl;
+	std::cout << "warm up from a residency snapshot" << std::endl;
+	createRelationForward3(2000);
+	bufMgr->flushFile(file1);
+
+	std::vector<PageId> pages;
+	Page *page;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 20; iter++)
+	{
+		PageId pageNo = (*iter).page_number();
+		bufMgr->readPage(file1, pageNo, page);
+		bufMgr->unPinPage(file1, pageNo, false);
+		pages.push_back(pageNo);
+	}
+
+	const std::string snapshotName = relationName + ".residency";
+	checkPassFail(bufMgr->saveResidency(snapshotName), 20)
+	bufMgr->flushFile(file1);
+
+	std::vector<File*> files(1, file1);
+	checkPassFail(bufMgr->warmUp(snapshotName, files), 20)
+
+	int diskreads = bufMgr->getBufStats().diskreads;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads - diskreads, 0)
+
+	std::remove(snapshotName.c_str());
+	deleteRelation();
+}
+
+void myTest13_VictimCache()
+{
+	// Pages pushed out of the pool by a larger working set come back from the compressed victim cache
+	std::cout << "---------------------" << std::endl;
+	std::cout << "compressed victim cache" << std::endl;
+	createRelationForward3(20000);
+	bufMgr->setVictimCache(2 * 1024 * 1024);
+
+	std::vector<PageId> pages;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 150; iter++)
+	{
+		pages.push_back((*iter).page_number());
+	}
+
+	Page *page;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+
+	int diskreads = bufMgr->getBufStats().diskreads;
+	RecordId rid;
+	rid.page_number = pages[0];
+	rid.slot_number = 1;
+	std::string record;
+	for (size_t i = 0; i < 40; i++)
+	{
+		bufMgr->readPage(file1, pages[i], page);
+		if (i == 0)
+			record = page->getRecord(rid);
+		bufMgr->unPinPage(file1, pages[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads - diskreads, 0)
+	checkPassFail((int) bufMgr->getVictimCacheStats().hits, 40)
+	bool sameRecord = record == file1->readPage(pages[0]).getRecord(rid);
+	checkPassFail(sameRecord, true)
+
+	bufMgr->setVictimCache(0);
+	deleteRelation();
+}
+
+void myTest14_OptimisticRead()
+{
+	// An optimistic read stays valid until the page is modified or leaves its frame
+	std::cout << "---------------------" << std::endl;
+	std::cout << "optimistic reads" << std::endl;
+	createRelationForward3(1000);
+	bufMgr->flushFile(file1);
+
+	PageId pageNo = (*file1->begin()).page_number();
+	OptimisticRead read;
+	checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), false)
+
+	Page *page;
+	bufMgr->readPage(file1, pageNo, page);
+	bufMgr->unPinPage(file1, pageNo, false);
+	checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), true)
+	checkPassFail(bufMgr->validateOptimisticRead(read), true)
+	// a read ends with its validation
+	checkPassFail(bufMgr->validateOptimisticRead(read), false)
+
+	checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), true)
+	bufMgr->readPage(file1, pageNo, page);
+	bufMgr->unPinPage(file1, pageNo, true);
+	checkPassFail(bufMgr->validateOptimisticRead(read), false)
+
+	// a page pinned for writing fails validation while it is pinned, before it is unpinned dirty
+	checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), true)
+	{
+		PageGuard guard = bufMgr->readPage(file1, pageNo, GUARD_WRITE);
+		checkPassFail(bufMgr->validateOptimisticRead(read), false)
+		OptimisticRead during;
+		checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, during), false)
+	}
+	{
+		PageGuard guard = bufMgr->readPage(file1, pageNo);
+		checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), true)
+		guard.markDirty();
+		checkPassFail(bufMgr->validateOptimisticRead(read), false)
+	}
+
+	checkPassFail(bufMgr->beginOptimisticRead(file1, pageNo, read), true)
+	bufMgr->flushFile(file1);
+	checkPassFail(bufMgr->validateOptimisticRead(read), false)
+
+	// the pool is resized under optimistic readers, which wait for nothing and never see freed frame tags
+	{
+		BufMgr pool(20);
+		pool.readPage(file1, pageNo, page);
+		pool.unPinPage(file1, pageNo, false);
+
+		std::atomic<bool> stop(false);
+		std::atomic<int> wrongPages(0);
+		std::thread reader([&]() {
+			while (!stop.load())
+			{
+				OptimisticRead during;
+				if (pool.beginOptimisticRead(file1, pageNo, during))
+				{
+					PageId seen = during.page->page_number();
+					if (pool.validateOptimisticRead(during) && seen != pageNo)
+						wrongPages++;
+				}
+			}
+		});
+		for (int i = 0; i < 200; i++)
+			pool.resize(i % 2 == 0 ? 40 : 20);
+		stop.store(true);
+		reader.join();
+		checkPassFail(wrongPages.load(), 0)
+		checkPassFail(pool.getNumBufs(), (std::uint32_t) 20)
+		pool.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+void myTest15_Admission()
+{
+	// A caller over its pin budget is refused; a request for a frame in a fully pinned pool waits for a pin
+	std::cout << "---------------------" << std::endl;
+	std::cout << "pin budgets and admission control" << std::endl;
+	createRelationForward3(2000);
+
+	std::vector<PageId> pages;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 5; iter++)
+	{
+		pages.push_back((*iter).page_number());
+	}
+
+	Page *page;
+	BufAccessStrategy budget(BufAccessStrategy::BULKREAD_RING_SIZE, 2);
+	bufMgr->readPage(file1, pages[0], page, &budget);
+	bufMgr->readPage(file1, pages[1], page, &budget);
+	bool refused = false;
+	try
+	{
+		bufMgr->readPage(file1, pages[2], page, &budget);
+	}
+	catch (const BufferExceededException &e)
+	{
+		refused = true;
+	}
+	checkPassFail(refused, true)
+	bufMgr->unPinPage(file1, pages[0], false, &budget);
+	bufMgr->readPage(file1, pages[2], page, &budget);
+	checkPassFail((int) budget.getPins(), 2)
+	bufMgr->unPinPage(file1, pages[1], false, &budget);
+	bufMgr->unPinPage(file1, pages[2], false, &budget);
+
+	{
+		BufMgr smallPool(4);
+		smallPool.setAdmissionControl(2000);
+		for (size_t i = 0; i < 4; i++)
+		{
+			smallPool.readPage(file1, pages[i], page);
+		}
+
+		std::thread releaser([&smallPool, &pages]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			smallPool.unPinPage(file1, pages[0], false);
+		});
+		bool admitted = true;
+		try
+		{
+			smallPool.readPage(file1, pages[4], page);
+		}
+		catch (const BufferExceededException &e)
+		{
+			admitted = false;
+		}
+		releaser.join();
+		checkPassFail(admitted, true)
+		bool waited = smallPool.getBufStats().admissionWaits > 0;
+		checkPassFail(waited, true)
+
+		for (size_t i = 1; i < 5; i++)
+		{
+			smallPool.unPinPage(file1, pages[i], false);
+		}
+		smallPool.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+/**
+ * PageFile whose reads end the process, leaving whatever the process holds behind
+ */
+class DyingPageFile : public PageFile
+{
+ public:
+	explicit DyingPageFile(const std::string& name) : PageFile(name, false) {}
+
+	void readPageInto(const PageId page_number, Page& page) const override
+	{
+		_exit(0);
+	}
+};
 
+void myTest16_SharedPool()
+{
+	// Pages read by one process are found in the shared pool by another
+	std::cout << "---------------------" << std::endl;
+	std::cout << "shared buffer pool across processes" << std::endl;
+	createRelationForward3(2000);
+	bufMgr->flushFile(file1);
 
+	std::vector<PageId> pages;
+	for (FileIterator iter = file1->begin(); iter != file1->end() && pages.size() < 2; iter++)
+	{
+		pages.push_back((*iter).page_number());
+	}
 
+	const std::string segment = "/badgerdb_test_pool";
+	SharedBufMgr::removeSegment(segment);
+	{
+		SharedBufMgr sharedPool(segment, 8);
 
+		pid_t worker = fork();
+		if (worker == 0)
+		{
+			int status = 0;
+			try
+			{
+				SharedBufMgr workerPool(segment, 8);
+				Page *page;
+				workerPool.readPage(file1, pages[0], page);
+				workerPool.unPinPage(file1, pages[0], false);
+				workerPool.readPage(file1, pages[1], page);
+				workerPool.unPinPage(file1, pages[1], true);
+			}
+			catch (const BadgerDbException &e)
+			{
+				status = 1;
+			}
+			_exit(status);
+		}
+		int status = -1;
+		waitpid(worker, &status, 0);
+		checkPassFail(status, 0)
+
+		Page *page;
+		sharedPool.readPage(file1, pages[0], page);
+		checkPassFail(page->page_number(), pages[0])
+		sharedPool.unPinPage(file1, pages[0], false);
+		BufStats stats = sharedPool.getBufStats();
+		checkPassFail(stats.diskreads, 2)
+		checkPassFail(stats.hits, 1)
+
+		sharedPool.flushFile(file1);
+		checkPassFail(sharedPool.getBufStats().diskwrites, 1)
+
+		// A process dying in the middle of a read holds the latch and a pin; the next process to take
+		// the latch repairs the pool and the pin is gone
+		worker = fork();
+		if (worker == 0)
+		{
+			SharedBufMgr workerPool(segment, 8);
+			Page *page;
+			workerPool.readPage(file1, pages[0], page);
+			DyingPageFile dyingFile(file1->filename());
+			workerPool.readPage(&dyingFile, pages[1], page);
+			_exit(1);
+		}
+		status = -1;
+		waitpid(worker, &status, 0);
+		checkPassFail(status, 0)
+
+		sharedPool.readPage(file1, pages[1], page);
+		checkPassFail(page->page_number(), pages[1])
+		sharedPool.unPinPage(file1, pages[1], false);
+		bool pinned = false;
+		try
+		{
+			sharedPool.flushFile(file1);
+		}
+		catch (const PagePinnedException &e)
+		{
+			pinned = true;
+		}
+		checkPassFail(pinned, false)
+
+		// A page another process adds to the file is read past the end of the header this process cached
+		int fds[2];
+		checkPassFail(pipe(fds), 0)
+		worker = fork();
+		if (worker == 0)
+		{
+			int status = 0;
+			try
+			{
+				SharedBufMgr workerPool(segment, 8);
+				PageId newPageNo;
+				workerPool.allocPage(file1, newPageNo, page);
+				workerPool.unPinPage(file1, newPageNo, true);
+				workerPool.flushFile(file1);
+				if (write(fds[1], &newPageNo, sizeof(newPageNo)) != (ssize_t) sizeof(newPageNo))
+					status = 1;
+			}
+			catch (const BadgerDbException &e)
+			{
+				status = 1;
+			}
+			_exit(status);
+		}
+		status = -1;
+		waitpid(worker, &status, 0);
+		checkPassFail(status, 0)
+		PageId newPageNo = Page::INVALID_NUMBER;
+		checkPassFail(read(fds[0], &newPageNo, sizeof(newPageNo)), (ssize_t) sizeof(newPageNo))
+		close(fds[0]);
+		close(fds[1]);
+
+		sharedPool.readPage(file1, newPageNo, page);
+		checkPassFail(page->page_number(), newPageNo)
+		sharedPool.unPinPage(file1, newPageNo, false);
+		sharedPool.flushFile(file1);
+	}
+	SharedBufMgr::removeSegment(segment);
+
+	deleteRelation();
+}
+
+void myTest17_FileBackend()
+{
+	// Pages written with pwrite read back intact; times page writes and reads against a seek/write/flush fstream
+	std::cout << "---------------------" << std::endl;
+	std::cout << "positional file I/O against fstream" << std::endl;
+	const std::string ioName = relationName + ".io";
+	const int numPages = 256;
+	try
+	{
+		File::remove(ioName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	std::vector<PageId> pages(numPages);
+	Page page;
+	long pwriteMicros = 0, syncMicros = 0;
+	std::chrono::steady_clock::time_point start;
+	{
+		BlobFile ioFile = BlobFile::create(ioName);
+		for (int i = 0; i < numPages; i++)
+		{
+			ioFile.allocatePageInto(pages[i], page);
+		}
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			sprintf(reinterpret_cast<char*>(&page), "page %d", i);
+			ioFile.writePage(pages[i], page);
+		}
+		pwriteMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		start = std::chrono::steady_clock::now();
+		ioFile.sync();
+		syncMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool intact = true;
+	start = std::chrono::steady_clock::now();
+	{
+		BlobFile ioFile = BlobFile::open(ioName);
+		char expected[32];
+		for (int i = 0; i < numPages; i++)
+		{
+			ioFile.readPageInto(pages[i], page);
+			sprintf(expected, "page %d", i);
+			if (std::string(reinterpret_cast<char*>(&page)) != expected)
+				intact = false;
+		}
+	}
+	long preadMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	checkPassFail(intact, true)
+
+	// the same pages through a stream, the way File did its I/O before
+	start = std::chrono::steady_clock::now();
+	{
+		std::fstream stream(ioName, std::fstream::in | std::fstream::out | std::fstream::binary);
+		for (int i = 0; i < numPages; i++)
+		{
+			sprintf(reinterpret_cast<char*>(&page), "page %d", i);
+			stream.seekp(sizeof(FileHeader) + (std::streamoff) (pages[i] - 1) * Page::SIZE, std::ios::beg);
+			stream.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+			stream.flush();
+		}
+	}
+	long fstreamWriteMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+	{
+		std::fstream stream(ioName, std::fstream::in | std::fstream::binary);
+		for (int i = 0; i < numPages; i++)
+		{
+			stream.seekg(sizeof(FileHeader) + (std::streamoff) (pages[i] - 1) * Page::SIZE, std::ios::beg);
+			stream.read(reinterpret_cast<char*>(&page), Page::SIZE);
+		}
+	}
+	long fstreamReadMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << numPages << " page writes: pwrite " << pwriteMicros << "us (then sync " << syncMicros << "us), fstream " << fstreamWriteMicros << "us" << std::endl;
+	std::cout << numPages << " page reads: pread " << preadMicros << "us, fstream " << fstreamReadMicros << "us" << std::endl;
+
+	File::remove(ioName);
+}
+
+void myTest18_MmapFile()
+{
+	// Pages of memory-mapped files are read in place, also after the mapping grew
+	std::cout << "---------------------" << std::endl;
+	std::cout << "memory-mapped files" << std::endl;
+	const std::string mmapName = relationName + ".mmap";
+	try
+	{
+		File::remove(mmapName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		// enough pages to map more than one chunk
+		MmapBlobFile blobFile(mmapName, true);
+		const int numPages = 2 * FileMapping::CHUNK_BYTES / Page::SIZE;
+		std::vector<PageId> pages(numPages);
+		Page page;
+		blobFile.allocatePageInto(pages[0], page);
+		const Page* first = blobFile.pageAt(pages[0]);
+		for (int i = 1; i < numPages; i++)
+		{
+			blobFile.allocatePageInto(pages[i], page);
+		}
+		for (int i = 0; i < numPages; i++)
+		{
+			sprintf(reinterpret_cast<char*>(&page), "page %d", i);
+			blobFile.writePage(pages[i], page);
+		}
+
+		bool stable = blobFile.pageAt(pages[0]) == first;
+		checkPassFail(stable, true)
+		checkPassFail(std::string(reinterpret_cast<const char*>(blobFile.pageAt(pages[numPages - 1]))), "page " + std::to_string(numPages - 1))
+
+		Page *pooled;
+		bufMgr->readPage(&blobFile, pages[7], pooled);
+		checkPassFail(std::string(reinterpret_cast<char*>(pooled)), "page 7")
+		bufMgr->unPinPage(&blobFile, pages[7], false);
+		bufMgr->flushFile(&blobFile);
+	}
+	File::remove(mmapName);
+
+	createRelationForward3(2000);
+	bufMgr->flushFile(file1);
+	{
+		MmapPageFile pageFile(relationName, false);
+		pageFile.setAccessPattern(ACCESS_SEQUENTIAL);
+		PageId pageNo = file1->getFirstPageNo();
+		pageFile.willNeed(pageNo, 4);
+		Page read = file1->readPage(pageNo);
+		const Page* mapped = pageFile.pageAt(pageNo);
+		checkPassFail(mapped->getRecord(read.begin().getCurrentRecord()), read.getRecord(read.begin().getCurrentRecord()))
+		bool invalid = false;
+		try
+		{
+			pageFile.pageAt(100000);
+		}
+		catch (const InvalidPageException &e)
+		{
+			invalid = true;
+		}
+		checkPassFail(invalid, true)
+	}
+	deleteRelation();
+}
+
+void myTest19_AsyncIo()
+{
+	// Batches of page writes and reads through the I/O engine, with io_uring if the kernel has it and on the thread pool
+	std::cout << "---------------------" << std::endl;
+	std::cout << "asynchronous batched I/O" << std::endl;
+	const std::string ioName = relationName + ".aio";
+	const int numPages = 64;
+	try
+	{
+		File::remove(ioName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		BlobFile blobFile = BlobFile::create(ioName);
+		std::vector<Page> pages(numPages);
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			blobFile.allocatePageInto(pageNos[i], pages[i]);
+		}
+
+		for (int useUring = 1; useUring >= 0; useUring--)
+		{
+			AsyncIo io(AsyncIo::DEFAULT_QUEUE_DEPTH, AsyncIo::DEFAULT_THREADS, useUring == 1);
+			std::cout << "io_uring " << (io.usesUring() ? "in use" : "not in use") << std::endl;
+			for (int i = 0; i < numPages; i++)
+			{
+				sprintf(reinterpret_cast<char*>(&pages[i]), "page %d pass %d", i, useUring);
+				io.submitWrite(&blobFile, pageNos[i], pages[i]);
+			}
+			std::vector<IoCompletion> done;
+			io.complete(done, numPages);
+			int written = 0;
+			for (size_t i = 0; i < done.size(); i++)
+				written += done[i].ok ? 1 : 0;
+			checkPassFail(written, numPages)
+
+			std::vector<Page> readBack(numPages);
+			for (int i = 0; i < numPages; i++)
+			{
+				io.submitRead(&blobFile, pageNos[i], readBack[i]);
+			}
+			done.clear();
+			io.complete(done, numPages);
+			bool intact = done.size() == (size_t) numPages;
+			for (int i = 0; i < numPages; i++)
+			{
+				if (std::string(reinterpret_cast<char*>(&readBack[i])) != std::string(reinterpret_cast<char*>(&pages[i])))
+					intact = false;
+			}
+			checkPassFail(intact, true)
+		}
+
+		// pages asked for while their prefetch read is in flight are waited for, not read twice
+		{
+			BufMgr pool(numPages);
+			pool.prefetch(&blobFile, pageNos);
+			bool intact = true;
+			for (int i = 0; i < numPages; i++)
+			{
+				Page* page;
+				pool.readPage(&blobFile, pageNos[i], page);
+				if (std::string(reinterpret_cast<char*>(page)) != std::string(reinterpret_cast<char*>(&pages[i])))
+					intact = false;
+				pool.unPinPage(&blobFile, pageNos[i], false);
+			}
+			checkPassFail(intact, true)
+			checkPassFail(pool.getBufStatsSnapshot().diskreads, (std::uint64_t) numPages)
+			pool.flushFile(&blobFile);
+		}
+	}
+	File::remove(ioName);
+
+	// pages of a PageFile go through the File interface on the thread pool
+	createRelationForward3(2000);
+	bufMgr->flushFile(file1);
+	{
+		AsyncIo io;
+		PageId pageNo = file1->getFirstPageNo();
+		Page page;
+		io.submitRead(file1, pageNo, page);
+		std::vector<IoCompletion> done;
+		io.complete(done, 1);
+		Page expected = file1->readPage(pageNo);
+		RecordId first = expected.begin().getCurrentRecord();
+		checkPassFail(page.getRecord(first), expected.getRecord(first))
+	}
+	deleteRelation();
+}
+
+void myTest20_DirectIo()
+{
+	// Files written through the pool with direct I/O get the page-aligned layout and read back the same when opened buffered
+	std::cout << "---------------------" << std::endl;
+	std::cout << "direct I/O" << std::endl;
+	const std::string blobName = relationName + ".direct";
+	const std::string pageName = relationName + ".direct2";
+	const int numPages = 40;
+	for (const std::string& name : {blobName, pageName})
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+
+	std::vector<PageId> blobPages(numPages);
+	std::vector<PageId> pagePages(numPages);
+	std::vector<RecordId> rids(numPages);
+	{
+		BlobFile blobFile = BlobFile::create(blobName, FILE_IO_DIRECT);
+		PageFile pageFile = PageFile::create(pageName, FILE_IO_DIRECT);
+		std::cout << "direct I/O " << (blobFile.directIo() ? "in use" : "not supported here") << std::endl;
+		Page *page;
+		for (int i = 0; i < numPages; i++)
+		{
+			bufMgr->allocPage(&blobFile, blobPages[i], page);
+			sprintf(reinterpret_cast<char*>(page), "direct page %d", i);
+			bufMgr->unPinPage(&blobFile, blobPages[i], true);
+
+			bufMgr->allocPage(&pageFile, pagePages[i], page);
+			rids[i] = page->insertRecord("direct record " + std::to_string(i));
+			bufMgr->unPinPage(&pageFile, pagePages[i], true);
+		}
+		bufMgr->flushFile(&blobFile);
+		bufMgr->flushFile(&pageFile);
+	}
+
+	struct stat info;
+	stat(blobName.c_str(), &info);
+	checkPassFail(info.st_size % Page::SIZE, 0)
+	stat(pageName.c_str(), &info);
+	checkPassFail(info.st_size % Page::SIZE, 0)
+
+	{
+		BlobFile blobFile = BlobFile::open(blobName);
+		PageFile pageFile = PageFile::open(pageName);
+		bool intact = true;
+		for (int i = 0; i < numPages; i++)
+		{
+			Page blobPage = blobFile.readPage(blobPages[i]);
+			if (std::string(reinterpret_cast<char*>(&blobPage)) != "direct page " + std::to_string(i))
+				intact = false;
+			if (pageFile.readPage(pagePages[i]).getRecord(rids[i]) != "direct record " + std::to_string(i))
+				intact = false;
+		}
+		checkPassFail(intact, true)
+		int used = 0;
+		for (FileIterator iter = pageFile.begin(); iter != pageFile.end(); ++iter)
+			used++;
+		checkPassFail(used, numPages)
+	}
+	File::remove(blobName);
+	File::remove(pageName);
+}
+
+void myTest21_HeaderCache()
+{
+	// Growing a file appends behind the cached tail of the used list; the header reaches disk when the file is synced or closed
+	std::cout << "---------------------" << std::endl;
+	std::cout << "cached file header" << std::endl;
+	const std::string headerName = relationName + ".header";
+	const int numPages = 4000;
+	PageId highest = Page::INVALID_NUMBER;
+	try
+	{
+		File::remove(headerName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile pageFile = PageFile::create(headerName);
+		PageId pageNo;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numPages; i++)
+		{
+			pageFile.allocatePage(pageNo);
+		}
+		std::cout << numPages << " pages allocated in "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+		// drop the tail, then grow again behind the new tail
+		highest = pageNo;
+		pageFile.deletePage(pageNo);
+		pageFile.deletePage(pageNo - 1);
+		pageFile.allocatePage(pageNo);
+		pageFile.allocatePage(pageNo);
+		pageFile.allocatePage(pageNo);
+		highest = std::max(highest, pageNo);
+		pageFile.sync();
+	}
+
+	{
+		PageFile pageFile = PageFile::open(headerName);
+		int used = 0;
+		PageId last = Page::INVALID_NUMBER;
+		bool ordered = true;
+		for (FileIterator iter = pageFile.begin(); iter != pageFile.end(); ++iter)
+		{
+			if (iter.getCurrentPageNo() <= last)
+				ordered = false;
+			last = iter.getCurrentPageNo();
+			used++;
+		}
+		checkPassFail(used, numPages + 1)
+		checkPassFail(ordered, true)
+		checkPassFail(last, highest)
+	}
+
+	// a page another process added is only looked for on disk once the file is known to be shared
+	{
+		PageFile pageFile = PageFile::open(headerName);
+		pageFile.readPage(highest);
+		pid_t worker = fork();
+		if (worker == 0)
+		{
+			PageId pageNo;
+			pageFile.allocatePage(pageNo);
+			pageFile.flushHeader();
+			_exit(pageNo > highest ? 0 : 1);
+		}
+		int status = -1;
+		waitpid(worker, &status, 0);
+		checkPassFail(status, 0)
+
+		bool invalid = false;
+		try
+		{
+			pageFile.readPage(highest + 1);
+		}
+		catch (const InvalidPageException &e)
+		{
+			invalid = true;
+		}
+		checkPassFail(invalid, true)
+
+		pageFile.markShared();
+		checkPassFail(pageFile.readPage(highest + 1).page_number(), highest + 1)
+	}
+	File::remove(headerName);
+}
+
+void myTest22_FreeSpaceMap()
+{
+	// Pages of new files are tracked in a free-space map: deleted pages are handed out again, map pages never are,
+	// and pages with room for a record are found without trying them
+	std::cout << "---------------------" << std::endl;
+	std::cout << "free-space map" << std::endl;
+	const std::string mapName = relationName + ".fsm";
+	const int numPages = FreeSpaceMap::ENTRIES_PER_MAP_PAGE + 10;
+	try
+	{
+		File::remove(mapName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	PageId fullPage;
+	PageId roomyPage;
+	{
+		PageFile pageFile = PageFile::create(mapName);
+		checkPassFail(pageFile.hasFreeSpaceMap(), true)
+		bool mapPageHandedOut = false;
+		PageId pageNo;
+		for (int i = 0; i < numPages; i++)
+		{
+			pageFile.allocatePage(pageNo);
+			if (FreeSpaceMap::isMapPage(pageNo))
+				mapPageHandedOut = true;
+		}
+		checkPassFail(mapPageHandedOut, false)
+
+		// fill one page up through the pool and leave a few records on the next one
+		Page* page;
+		fullPage = pageFile.getFirstPageNo();
+		bufMgr->readPage(&pageFile, fullPage, page);
+		const std::string record(200, 'x');
+		while (page->hasSpaceForRecord(record))
+			page->insertRecord(record);
+		bufMgr->unPinPage(&pageFile, fullPage, true);
+		bufMgr->flushFile(&pageFile);
+		roomyPage = pageFile.findPageWithSpace(record.length());
+		bool skipsFull = roomyPage != fullPage && roomyPage != Page::INVALID_NUMBER;
+		checkPassFail(skipsFull, true)
+		checkPassFail(pageFile.findPageWithSpace(Page::SIZE), Page::INVALID_NUMBER)
+
+		pageFile.deletePage(roomyPage);
+		pageFile.allocatePage(pageNo);
+		checkPassFail(pageNo, roomyPage)
+	}
+
+	{
+		PageFile pageFile = PageFile::open(mapName);
+		checkPassFail(pageFile.hasFreeSpaceMap(), true)
+		int used = 0;
+		for (FileIterator iter = pageFile.begin(); iter != pageFile.end(); ++iter)
+			used++;
+		checkPassFail(used, numPages)
+		checkPassFail(pageFile.findPageWithSpace(200), roomyPage)
+		bool invalid = false;
+		try
+		{
+			pageFile.readPage(FreeSpaceMap::ENTRIES_PER_MAP_PAGE + 2);
+		}
+		catch (const InvalidPageException &e)
+		{
+			invalid = true;
+		}
+		checkPassFail(invalid, true)
+	}
+	File::remove(mapName);
+}
+
+void myTest23_Extents()
+{
+	// Files grow by whole extents; pages handed out of an extent read back empty and keep what is written to them
+	std::cout << "---------------------" << std::endl;
+	std::cout << "extent preallocation" << std::endl;
+	const std::string extentName = relationName + ".extent";
+	const PageId extentPages = 32;
+	const int numPages = 100;
+	try
+	{
+		File::remove(extentName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	std::vector<PageId> pages(numPages);
+	{
+		BlobFile blobFile = BlobFile::create(extentName);
+		blobFile.setExtentPages(extentPages);
+		Page *page;
+		for (int i = 0; i < numPages; i++)
+		{
+			bufMgr->allocPage(&blobFile, pages[i], page);
+			if (i % 2 == 0)
+			{
+				sprintf(reinterpret_cast<char*>(page), "extent page %d", i);
+				bufMgr->unPinPage(&blobFile, pages[i], true);
+			}
+			else
+				bufMgr->unPinPage(&blobFile, pages[i], false);
+		}
+		bufMgr->flushFile(&blobFile);
+
+		// the file ends with the last extent, not with the last page
+		struct stat info;
+		stat(extentName.c_str(), &info);
+		const PageId extents = (numPages + extentPages - 1) / extentPages;
+		checkPassFail((PageId) (info.st_size / Page::SIZE), extents * extentPages + 1)
+	}
+
+	{
+		BlobFile blobFile = BlobFile::open(extentName);
+		bool intact = true;
+		Page empty;
+		for (int i = 0; i < numPages; i++)
+		{
+			Page read = blobFile.readPage(pages[i]);
+			if (i % 2 == 0 && std::string(reinterpret_cast<char*>(&read)) != "extent page " + std::to_string(i))
+				intact = false;
+			if (i % 2 == 1 && memcmp(&read, &empty, Page::SIZE) != 0)
+				intact = false;
+		}
+		checkPassFail(intact, true)
+
+		// a reopened file starts a new extent behind its pages
+		PageId pageNo;
+		blobFile.allocatePage(pageNo);
+		checkPassFail(pageNo, (PageId) numPages + 1)
+	}
+	File::remove(extentName);
+}
+
+void myTest24_Compression()
+{
+	// Compressed pages read back unchanged, take a fraction of the space and move when they outgrow their sectors
+	std::cout << "---------------------" << std::endl;
+	std::cout << "page compression" << std::endl;
+	const std::string compressedName = relationName + ".compressed";
+	const std::string plainName = relationName + ".plain";
+	const int numPages = 200;
+	const int keysPerPage = Page::SIZE / sizeof(int) / 2;
+	for (const std::string& name : {compressedName, plainName})
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+
+	// half-full pages of sorted keys, like the leaves of an index
+	std::vector<PageId> pages(numPages);
+	{
+		BlobFile compressedFile = BlobFile::create(compressedName, FILE_IO_BUFFERED, PAGE_COMPRESSION_AUTO);
+		BlobFile plainFile = BlobFile::create(plainName);
+		checkPassFail(compressedFile.compressed(), true)
+		for (BlobFile* blobFile : {&compressedFile, &plainFile})
+		{
+			Page *page;
+			for (int i = 0; i < numPages; i++)
+			{
+				bufMgr->allocPage(blobFile, pages[i], page);
+				int* keys = reinterpret_cast<int*>(page);
+				for (int k = 0; k < keysPerPage; k++)
+					keys[k] = i * keysPerPage * 3 + k * 3;
+				bufMgr->unPinPage(blobFile, pages[i], true);
+			}
+			bufMgr->flushFile(blobFile);
+		}
+	}
+
+	struct stat compressedInfo;
+	struct stat plainInfo;
+	stat(compressedName.c_str(), &compressedInfo);
+	stat(plainName.c_str(), &plainInfo);
+	const bool smaller = compressedInfo.st_size * 4 < plainInfo.st_size;
+	checkPassFail(smaller, true)
+
+	// an incompressible page no longer fits its sectors and is moved
+	Page noise;
+	unsigned int seed = 1;
+	for (std::size_t b = 0; b < Page::SIZE; b++)
+	{
+		seed = seed * 1103515245 + 12345;
+		reinterpret_cast<char*>(&noise)[b] = (char) (seed >> 16);
+	}
+	{
+		BlobFile blobFile = BlobFile::open(compressedName);
+		checkPassFail(blobFile.rawPages(), false)
+		blobFile.writePage(pages[0], noise);
+	}
+
+	{
+		BlobFile blobFile = BlobFile::open(compressedName);
+		Page moved = blobFile.readPage(pages[0]);
+		bool intact = memcmp(&noise, &moved, Page::SIZE) == 0;
+		for (int i = 1; i < numPages; i++)
+		{
+			Page read = blobFile.readPage(pages[i]);
+			const int* keys = reinterpret_cast<const int*>(&read);
+			for (int k = 0; k < keysPerPage; k++)
+				if (keys[k] != i * keysPerPage * 3 + k * 3)
+					intact = false;
+			for (int k = keysPerPage; k < 2 * keysPerPage; k++)
+				if (keys[k] != 0)
+					intact = false;
+		}
+		checkPassFail(intact, true)
+	}
+	File::remove(compressedName);
+	File::remove(plainName);
+}
+
+void myTest25_Tablespace()
+{
+	// Many files share the descriptor of one container, survive reopening it and hand their extents on once removed
+	std::cout << "---------------------" << std::endl;
+	std::cout << "tablespace" << std::endl;
+	const std::string spaceName = relationName + ".space";
+	const int numFiles = 50;
+	const int numPages = 70;
+	try
+	{
+		File::remove(spaceName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	std::vector<PageId> pages(numPages);
+	{
+		Tablespace space(spaceName, true);
+		bool shared = true;
+		for (int f = 0; f < numFiles; f++)
+		{
+			TablespaceFile file = TablespaceFile::create(space, "index." + std::to_string(f));
+			Page *page;
+			for (int i = 0; i < numPages; i++)
+			{
+				bufMgr->allocPage(&file, pages[i], page);
+				sprintf(reinterpret_cast<char*>(page), "file %d page %d", f, i);
+				bufMgr->unPinPage(&file, pages[i], true);
+			}
+			bufMgr->flushFile(&file);
+			if (file.descriptor() != TablespaceFile::open(space, "index.0").descriptor())
+				shared = false;
+		}
+		checkPassFail(shared, true)
+	}
+
+	{
+		Tablespace space(spaceName, false);
+		checkPassFail(space.fileNames().size(), (std::size_t) numFiles)
+		bool intact = true;
+		for (int f = 0; f < numFiles; f += 7)
+		{
+			TablespaceFile file = TablespaceFile::open(space, "index." + std::to_string(f));
+			for (int i = 0; i < numPages; i++)
+			{
+				Page *page;
+				bufMgr->readPage(&file, pages[i], page);
+				if (std::string(reinterpret_cast<char*>(page)) != "file " + std::to_string(f) + " page " + std::to_string(i))
+					intact = false;
+				bufMgr->unPinPage(&file, pages[i], false);
+			}
+			bufMgr->flushFile(&file);
+		}
+		checkPassFail(intact, true)
+
+		// a new file takes the extents of a removed one and reads back empty
+		struct stat before;
+		stat(spaceName.c_str(), &before);
+		space.removeFile("index.3");
+		checkPassFail(space.contains("index.3"), false)
+		TablespaceFile file = TablespaceFile::create(space, "index.new");
+		Page empty;
+		bool reused = true;
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			file.allocatePage(pageNo);
+			Page read = file.readPage(pageNo);
+			if (memcmp(&read, &empty, Page::SIZE) != 0)
+				reused = false;
+		}
+		struct stat after;
+		stat(spaceName.c_str(), &after);
+		const bool inPlace = reused && after.st_size == before.st_size;
+		checkPassFail(inPlace, true)
+	}
+	File::remove(spaceName);
+}
+
+void myTest26_Catalog()
+{
+	// Indexes recorded in the catalog are opened from it with their current root, and the catalog survives reopening
+	std::cout << "---------------------" << std::endl;
+	std::cout << "catalog" << std::endl;
+	const std::string catalogName = relationName + ".catalog";
+	for (const std::string& name : {catalogName, intIndexName})
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+	checkPassFail(File::exists(intIndexName), false)
+
+	createRelationForward3(5000);
+
+	// a file of the index's name that holds no such index is not opened as one
+	{
+		BlobFile staleFile = BlobFile::create(intIndexName);
+		PageId pageNo;
+		staleFile.allocatePage(pageNo);
+		staleFile.allocatePage(pageNo);
+	}
+	bool badInfo = false;
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+	}
+	catch (const BadIndexInfoException &e)
+	{
+		badInfo = true;
+	}
+	checkPassFail(badInfo, true)
+	File::remove(intIndexName);
+
+	{
+		Catalog catalog(catalogName, true);
+		File::setCatalog(&catalog);
+
+		// relations are recorded as they are created, or opened as the index scans the relation, and dropped
+		// as they are removed
+		const std::string newName = relationName + ".new";
+		{
+			PageFile newFile = PageFile::create(newName);
+		}
+		CatalogEntry entry;
+		const bool created = catalog.lookup(newName, entry) && entry.type == CATALOG_RELATION;
+		checkPassFail(created, true)
+		File::remove(newName);
+		checkPassFail(catalog.contains(newName), false)
+
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, NULL, &catalog);
+			checkPassFail(intScan(&index,300,GT,400,LT), 99)
+		}
+		checkPassFail(File::exists(intIndexName), true)
+		const bool opened = catalog.lookup(relationName, entry) && entry.type == CATALOG_RELATION;
+		checkPassFail(opened, true)
+
+		// the root split while the index was built, and the catalog followed it
+		const bool moved = catalog.lookup(intIndexName, entry) && entry.type == CATALOG_INDEX &&
+		                   entry.root_page != entry.header_page + 1;
+		checkPassFail(moved, true)
+		File::setCatalog(NULL);
+	}
+
+	{
+		Catalog catalog(catalogName, false);
+		checkPassFail(catalog.entries().size(), (std::size_t) 2)
+		CatalogEntry entry;
+		catalog.lookup(intIndexName, entry);
+		checkPassFail(entry.relation_name, relationName)
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, NULL, &catalog);
+			checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		}
+
+		// a root the catalog lost track of, as after a crash before the index was closed, is taken from the
+		// metadata page
+		const PageId root = entry.root_page;
+		entry.root_page = entry.header_page + 1;
+		catalog.put(entry);
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, NULL, &catalog);
+			checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		}
+		catalog.lookup(intIndexName, entry);
+		checkPassFail(entry.root_page, root)
+
+		// an entry recorded for another attribute type is not opened as this index
+		badInfo = false;
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), DOUBLE, NULL, &catalog);
+		}
+		catch (const BadIndexInfoException &e)
+		{
+			badInfo = true;
+		}
+		checkPassFail(badInfo, true)
+
+		// an entry whose file was removed behind the catalog is dropped and the index built anew
+		File::remove(intIndexName);
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, NULL, &catalog);
+			checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+		}
+		checkPassFail(catalog.contains(intIndexName), true)
+
+		catalog.removeFile(intIndexName);
+		checkPassFail(File::exists(intIndexName), false)
+		checkPassFail(catalog.contains(intIndexName), false)
+
+		File::setCatalog(&catalog);
+		deleteRelation();
+		File::setCatalog(NULL);
+		checkPassFail(catalog.contains(relationName), false)
+	}
+	File::remove(catalogName);
+}
+
+void myTest27_BgWriter()
+{
+	// The background writer cleans the dirty pages ahead of the clock, so replacing them needs no write
+	std::cout << "---------------------" << std::endl;
+	std::cout << "background writer" << std::endl;
+	const std::string bgName = relationName + ".bgw";
+	const int numPages = 32;
+	try
+	{
+		File::remove(bgName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	{
+		BlobFile blobFile = BlobFile::create(bgName);
+		BufMgr pool(numPages);
+		BgWriterConfig config;
+		config.delayMs = 5;
+		config.maxPagesPerRound = numPages;
+		config.scanAhead = numPages;
+		pool.startBgWriter(config);
+
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			Page* page;
+			pool.allocPage(&blobFile, pageNos[i], page);
+			sprintf(reinterpret_cast<char*>(page), "page %d", i);
+			pool.unPinPage(&blobFile, pageNos[i], true);
+		}
+		for (int i = 0; i < 400 && pool.getBufStatsSnapshot().diskwrites < numPages; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+		// a new page for every frame, with the writer still running
+		pool.clearBufStats();
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page* page;
+			pool.allocPage(&blobFile, pageNo, page);
+			pool.unPinPage(&blobFile, pageNo, false);
+		}
+		BufStats stats = pool.getBufStatsSnapshot();
+		checkPassFail(stats.dirtyEvictions, 0)
+		checkPassFail(stats.cleanEvictions, numPages)
+		pool.stopBgWriter();
+
+		// what the writer wrote is what the pages held
+		Page* page;
+		pool.readPage(&blobFile, pageNos[numPages - 1], page);
+		checkPassFail(std::string(reinterpret_cast<char*>(page)), "page " + std::to_string(numPages - 1))
+		pool.unPinPage(&blobFile, pageNos[numPages - 1], false);
+		pool.flushFile(&blobFile);
+	}
+	File::remove(bgName);
+
+	// pages disposed of while the writer runs stay deleted, and a page reusing the number keeps its content
+	{
+		PageFile pageFile = PageFile::create(bgName);
+		BufMgr pool(numPages);
+		BgWriterConfig config;
+		config.delayMs = 1;
+		config.maxPagesPerRound = numPages;
+		config.scanAhead = numPages;
+		pool.startBgWriter(config);
+
+		std::string oldRecord(sizeof(RECORD), 'o');
+		std::string newRecord(sizeof(RECORD), 'n');
+		int reused = 0;
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page* page;
+			pool.allocPage(&pageFile, pageNo, page);
+			page->insertRecord(oldRecord);
+			pool.unPinPage(&pageFile, pageNo, true);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			pool.disposePage(&pageFile, pageNo);
+
+			PageId reusedNo;
+			pool.allocPage(&pageFile, reusedNo, page);
+			RecordId rid = page->insertRecord(newRecord);
+			pool.unPinPage(&pageFile, reusedNo, true);
+			pool.flushFile(&pageFile);
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			if (pageFile.readPage(reusedNo).getRecord(rid) == newRecord)
+				reused++;
+		}
+		pool.stopBgWriter();
+		checkPassFail(reused, numPages)
+	}
+	File::remove(bgName);
+}
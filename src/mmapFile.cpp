@@ -0,0 +1,195 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "mmapFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "exceptions/file_io_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+FileMapping::FileMapping(const int fd, const std::string& name,
+                         const std::size_t reserveBytes)
+    : fd_(fd), name_(name), base_(NULL), reserved_(reserveBytes),
+      mapped_(0), valid_(0), pattern_(ACCESS_NORMAL) {
+  // Only address space is reserved here; the file is mapped over it with
+  // MAP_FIXED as it grows, so the mapping never moves.
+  void* base = mmap(NULL, reserved_, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    throw FileIOException(name_, std::strerror(errno));
+  }
+  base_ = static_cast<char*>(base);
+}
+
+FileMapping::~FileMapping() {
+  munmap(base_, reserved_);
+}
+
+char* FileMapping::at(const off_t position, const std::size_t length) {
+  const std::size_t end = position + length;
+  if (end <= valid_.load(std::memory_order_acquire)) {
+    return base_ + position;
+  }
+  if (end > reserved_) {
+    return NULL;
+  }
+
+  std::lock_guard<std::mutex> guard(latch_);
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    throw FileIOException(name_, std::strerror(errno));
+  }
+  const std::size_t file_bytes =
+      std::min(static_cast<std::size_t>(st.st_size), reserved_);
+  if (end > file_bytes) {
+    return NULL;
+  }
+  if (file_bytes > mapped_) {
+    const std::size_t new_mapped = std::min(
+        (file_bytes + CHUNK_BYTES - 1) / CHUNK_BYTES * CHUNK_BYTES, reserved_);
+    void* chunk = mmap(base_ + mapped_, new_mapped - mapped_,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_,
+                       mapped_);
+    if (chunk == MAP_FAILED) {
+      throw FileIOException(name_, std::strerror(errno));
+    }
+    advise(base_ + mapped_, new_mapped - mapped_);
+    mapped_ = new_mapped;
+  }
+  valid_.store(file_bytes, std::memory_order_release);
+  return base_ + position;
+}
+
+void FileMapping::advise(char* start, const std::size_t length) {
+  int advice = MADV_NORMAL;
+  if (pattern_ == ACCESS_SEQUENTIAL) {
+    advice = MADV_SEQUENTIAL;
+  } else if (pattern_ == ACCESS_RANDOM) {
+    advice = MADV_RANDOM;
+  }
+  // Hints only; a failure is not worth reporting.
+  madvise(start, length, advice);
+}
+
+void FileMapping::setAccessPattern(const FileAccessPattern pattern) {
+  std::lock_guard<std::mutex> guard(latch_);
+  pattern_ = pattern;
+  if (mapped_ > 0) {
+    advise(base_, mapped_);
+  }
+}
+
+void FileMapping::willNeed(const off_t position, const std::size_t length) {
+  const std::size_t valid = valid_.load(std::memory_order_acquire);
+  if (static_cast<std::size_t>(position) >= valid) {
+    return;
+  }
+  // madvise() wants a start on a memory page boundary.
+  const std::size_t page_bytes = sysconf(_SC_PAGESIZE);
+  const std::size_t start = position / page_bytes * page_bytes;
+  const std::size_t end = std::min(valid, position + length);
+  madvise(base_ + start, end - start, MADV_WILLNEED);
+}
+
+
+MmapBlobFile::MmapBlobFile(const std::string& name, const bool create_new,
+                           const std::size_t reserveBytes)
+    : BlobFile(name, create_new),
+      mapping_(handle_->fd(), name, reserveBytes) {
+  if (compressed()) {
+    // Pages of a compressed file are not where pagePosition() says.
+    throw FileIOException(name, "compressed files cannot be mapped");
+  }
+}
+
+void MmapBlobFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  BlobFile::allocatePageInto(new_page_number, new_page);
+  mapping_.at(pagePosition(new_page_number), Page::SIZE);
+}
+
+void MmapBlobFile::readPageInto(const PageId page_number, Page& page) const {
+  const char* mapped = mapping_.at(pagePosition(page_number), Page::SIZE);
+  if (mapped == NULL) {
+    BlobFile::readPageInto(page_number, page);
+    return;
+  }
+  std::memcpy(&page, mapped, Page::SIZE);
+}
+
+const Page* MmapBlobFile::pageAt(const PageId page_number) const {
+  const char* mapped = mapping_.at(pagePosition(page_number), Page::SIZE);
+  if (mapped == NULL) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return reinterpret_cast<const Page*>(mapped);
+}
+
+void MmapBlobFile::setAccessPattern(const FileAccessPattern pattern) {
+  mapping_.setAccessPattern(pattern);
+}
+
+void MmapBlobFile::willNeed(const PageId first_page_number,
+                            const PageId count) {
+  mapping_.willNeed(pagePosition(first_page_number),
+                    static_cast<std::size_t>(count) * Page::SIZE);
+}
+
+
+MmapPageFile::MmapPageFile(const std::string& name, const bool create_new,
+                           const std::size_t reserveBytes)
+    : PageFile(name, create_new),
+      mapping_(handle_->fd(), name, reserveBytes) {
+}
+
+void MmapPageFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  PageFile::allocatePageInto(new_page_number, new_page);
+  mapping_.at(pagePosition(new_page_number), Page::SIZE);
+}
+
+void MmapPageFile::readPageInto(const PageId page_number, Page& page) const {
+  const char* mapped = mapping_.at(pagePosition(page_number), Page::SIZE);
+  if (mapped == NULL) {
+    PageFile::readPageInto(page_number, page);
+    return;
+  }
+  std::memcpy(&page, pageAt(page_number), Page::SIZE);
+}
+
+const Page* MmapPageFile::pageAt(const PageId page_number) const {
+  // The header on disk may lag behind, so the bounds come from the cached one.
+  const char* mapped = mapping_.at(pagePosition(page_number), Page::SIZE);
+  if (mapped == NULL || page_number >= readHeader().num_pages ||
+      isMapPage(page_number)) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const Page* page = reinterpret_cast<const Page*>(mapped);
+  if (page->page_number() == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return page;
+}
+
+void MmapPageFile::setAccessPattern(const FileAccessPattern pattern) {
+  mapping_.setAccessPattern(pattern);
+}
+
+void MmapPageFile::willNeed(const PageId first_page_number,
+                            const PageId count) {
+  mapping_.willNeed(pagePosition(first_page_number),
+                    static_cast<std::size_t>(count) * Page::SIZE);
+}
+
+}
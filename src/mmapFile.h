@@ -0,0 +1,307 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Expected way pages of a memory-mapped file are going to be read,
+ *        passed on to the kernel as madvise() hints.
+ */
+enum FileAccessPattern {
+  ACCESS_NORMAL,      // no particular order
+  ACCESS_SEQUENTIAL,  // in page order, e.g. a file scan
+  ACCESS_RANDOM       // in no order, e.g. index lookups; disables kernel read-ahead
+};
+
+/**
+ * @brief Shared mapping of a file into memory.
+ *
+ * The mapping reserves a range of address space up front and maps the file
+ * into it chunk by chunk as the file grows, so addresses handed out stay
+ * valid for the lifetime of the mapping.  Bytes past the end of the file are
+ * never handed out.
+ */
+class FileMapping {
+ public:
+  /**
+   * Number of bytes the mapping grows by.
+   */
+  static const std::size_t CHUNK_BYTES = 1 << 20;
+
+  /**
+   * Default amount of address space reserved for a mapping.
+   */
+  static const std::size_t DEFAULT_RESERVE_BYTES = std::size_t(1) << 32;
+
+  /**
+   * Reserves address space for the file.  The file is mapped as its pages
+   * are asked for.
+   *
+   * @param fd            Descriptor of the file, opened for reading and writing.
+   * @param name          Name of the file, for error messages.
+   * @param reserveBytes  Largest part of the file that is ever mapped.
+   * @throws  FileIOException  If the address space can not be reserved.
+   */
+  FileMapping(const int fd, const std::string& name,
+              const std::size_t reserveBytes);
+
+  /**
+   * Unmaps the file.
+   */
+  ~FileMapping();
+
+  /**
+   * Returns the address of the given byte range of the file, mapping more of
+   * the file if it has grown.
+   *
+   * @param position  Position of the range in the file.
+   * @param length    Length of the range.
+   * @return  Address of the range, or NULL if the range is not all inside the
+   *          file or past the reserved address space.
+   */
+  char* at(const off_t position, const std::size_t length);
+
+  /**
+   * Sets the access pattern of the whole mapping, including chunks mapped
+   * later on.
+   *
+   * @param pattern   Expected access pattern.
+   */
+  void setAccessPattern(const FileAccessPattern pattern);
+
+  /**
+   * Asks the kernel to read the given byte range of the file in the
+   * background.  Parts of the range not yet mapped are ignored.
+   *
+   * @param position  Position of the range in the file.
+   * @param length    Length of the range.
+   */
+  void willNeed(const off_t position, const std::size_t length);
+
+ private:
+  FileMapping(const FileMapping&);
+  FileMapping& operator=(const FileMapping&);
+
+  /**
+   * Applies the access pattern to the given mapped range.
+   */
+  void advise(char* start, const std::size_t length);
+
+  /**
+   * Descriptor of the mapped file.
+   */
+  const int fd_;
+
+  /**
+   * Name of the mapped file.
+   */
+  const std::string name_;
+
+  /**
+   * Start of the reserved address space.
+   */
+  char* base_;
+
+  /**
+   * Size of the reserved address space.
+   */
+  const std::size_t reserved_;
+
+  /**
+   * Number of bytes of the file mapped so far, a multiple of CHUNK_BYTES.
+   */
+  std::size_t mapped_;
+
+  /**
+   * Number of bytes of the file known to exist, at most mapped_.  Ranges
+   * below it are served without taking the latch.
+   */
+  std::atomic<std::size_t> valid_;
+
+  /**
+   * Current access pattern.
+   */
+  FileAccessPattern pattern_;
+
+  /**
+   * Latch held while the mapping grows.
+   */
+  std::mutex latch_;
+};
+
+/**
+ * @brief BlobFile whose pages are read out of a shared memory mapping of the
+ *        file instead of with a read system call.
+ *
+ * Reads copy the page straight from the mapping, and pageAt() hands out a
+ * pointer to the page in the mapping without any copy at all, for read-only
+ * use such as serving index lookups.  Writes still go through the file
+ * descriptor; the kernel keeps the mapping coherent with them.
+ */
+class MmapBlobFile : public BlobFile {
+ public:
+  /**
+   * Constructs a memory-mapped file object.
+   *
+   * @param name          Name of file.
+   * @param create_new    Whether to create a new file.
+   * @param reserveBytes  Largest part of the file that is ever mapped; pages
+   *                      past it are read with a system call.
+   * @throws  FileExistsException     If the underlying file exists and
+   *                                  create_new is true.
+   * @throws  FileNotFoundException   If the underlying file doesn't exist and
+   *                                  create_new is false.
+   * @throws  FileIOException         If the file is compressed.
+   */
+  MmapBlobFile(const std::string& name, const bool create_new,
+               const std::size_t reserveBytes = FileMapping::DEFAULT_RESERVE_BYTES);
+
+  /**
+   * Allocates a new page in the file and maps it.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Reads an existing page from the mapping into the given page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Returns the page as it is in the mapping, without copying it.  The
+   * pointer stays valid as long as this object exists; the page changes under
+   * it when it is written.
+   *
+   * @param page_number   Number of page.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page is not in the mapped part of
+   *                                the file.
+   */
+  const Page* pageAt(const PageId page_number) const;
+
+  /**
+   * Sets the expected access pattern of the file.
+   *
+   * @param pattern   Expected access pattern.
+   */
+  void setAccessPattern(const FileAccessPattern pattern);
+
+  /**
+   * Asks the kernel to read the given pages in the background, e.g. ahead of
+   * a scan.
+   *
+   * @param first_page_number   Number of the first page.
+   * @param count               Number of pages.
+   */
+  void willNeed(const PageId first_page_number, const PageId count);
+
+ private:
+  MmapBlobFile(const MmapBlobFile&);
+  MmapBlobFile& operator=(const MmapBlobFile&);
+
+  /**
+   * Mapping of the file.  Mutable since mapping more of a grown file does not
+   * change the file.
+   */
+  mutable FileMapping mapping_;
+};
+
+/**
+ * @brief PageFile whose pages are read out of a shared memory mapping of the
+ *        file instead of with a read system call.
+ *
+ * @see MmapBlobFile
+ */
+class MmapPageFile : public PageFile {
+ public:
+  /**
+   * Constructs a memory-mapped file object.
+   *
+   * @param name          Name of file.
+   * @param create_new    Whether to create a new file.
+   * @param reserveBytes  Largest part of the file that is ever mapped; pages
+   *                      past it are read with a system call.
+   * @throws  FileExistsException     If the underlying file exists and
+   *                                  create_new is true.
+   * @throws  FileNotFoundException   If the underlying file doesn't exist and
+   *                                  create_new is false.
+   */
+  MmapPageFile(const std::string& name, const bool create_new,
+               const std::size_t reserveBytes = FileMapping::DEFAULT_RESERVE_BYTES);
+
+  /**
+   * Allocates a new page in the file and maps it.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Reads an existing page from the mapping into the given page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Returns the page as it is in the mapping, without copying it.  The
+   * pointer stays valid as long as this object exists; the page changes under
+   * it when it is written.
+   *
+   * @param page_number   Number of page.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file, is
+   *                                not currently used or is not in the mapped
+   *                                part of the file.
+   */
+  const Page* pageAt(const PageId page_number) const;
+
+  /**
+   * Sets the expected access pattern of the file.
+   *
+   * @param pattern   Expected access pattern.
+   */
+  void setAccessPattern(const FileAccessPattern pattern);
+
+  /**
+   * Asks the kernel to read the given pages in the background, e.g. ahead of
+   * a scan.
+   *
+   * @param first_page_number   Number of the first page.
+   * @param count               Number of pages.
+   */
+  void willNeed(const PageId first_page_number, const PageId count);
+
+ private:
+  MmapPageFile(const MmapPageFile&);
+  MmapPageFile& operator=(const MmapPageFile&);
+
+  /**
+   * Mapping of the file.
+   */
+  mutable FileMapping mapping_;
+};
+
+}
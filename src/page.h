@@ -336,6 +336,7 @@ class Page {
   friend class File;
   friend class PageFile;
   friend class BlobFile;
+  friend class TablespaceFile;
   friend class PageIterator;
 };
 
@@ -0,0 +1,184 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "pageCodec.h"
+
+namespace badgerdb {
+
+// shortest back reference worth encoding, and the size of the table of recent positions
+static const std::size_t MIN_MATCH = 4;
+static const int HASH_BITS = 12;
+static const std::size_t MAX_OFFSET = 65535;
+
+static std::uint32_t read32(const char* p)
+{
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// lengths of 15 and more continue in extra bytes, each adding up to 255
+static void writeLength(std::string& dst, std::size_t length)
+{
+  while (length >= 255)
+  {
+    dst.push_back((char) 255);
+    length -= 255;
+  }
+  dst.push_back((char) length);
+}
+
+static void writeToken(std::string& dst, const char* literals, const std::size_t numLiterals,
+                       const std::size_t offset, const std::size_t matchLength)
+{
+  std::size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+  unsigned char token = (unsigned char) ((std::min<std::size_t>(numLiterals, 15) << 4) | std::min<std::size_t>(matchCode, 15));
+  dst.push_back((char) token);
+
+  if (numLiterals >= 15)
+    writeLength(dst, numLiterals - 15);
+  dst.append(literals, numLiterals);
+
+  if (matchLength == 0)
+    return;
+
+  dst.push_back((char) (offset & 0xff));
+  dst.push_back((char) (offset >> 8));
+  if (matchCode >= 15)
+    writeLength(dst, matchCode - 15);
+}
+
+std::size_t PageCodec::compress(const char* src, const std::size_t length, std::string& dst)
+{
+  dst.clear();
+  dst.reserve(length / 2);
+
+  int table[1 << HASH_BITS];
+  for (int i = 0; i < (1 << HASH_BITS); i++)
+    table[i] = -1;
+
+  std::size_t anchor = 0;
+  std::size_t pos = 0;
+  while (pos + MIN_MATCH <= length)
+  {
+    std::uint32_t sequence = read32(src + pos);
+    std::uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+    int candidate = table[hash];
+    table[hash] = (int) pos;
+
+    if (candidate < 0 || pos - candidate > MAX_OFFSET || read32(src + candidate) != sequence)
+    {
+      pos++;
+      continue;
+    }
+
+    std::size_t matchLength = MIN_MATCH;
+    while (pos + matchLength < length && src[candidate + matchLength] == src[pos + matchLength])
+      matchLength++;
+
+    writeToken(dst, src + anchor, pos - anchor, pos - candidate, matchLength);
+    pos += matchLength;
+    anchor = pos;
+  }
+
+  // whatever is left goes out as literals
+  writeToken(dst, src + anchor, length - anchor, 0, 0);
+  return dst.size();
+}
+
+// reads a length continued in extra bytes; false if the input ends first
+static bool readLength(const unsigned char*& in, const unsigned char* end, std::size_t& length)
+{
+  unsigned char byte;
+  do
+  {
+    if (in >= end)
+      return false;
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+bool PageCodec::decompress(const char* src, const std::size_t length, char* dst, const std::size_t dstLength)
+{
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+  const unsigned char* end = in + length;
+  std::size_t out = 0;
+
+  while (in < end)
+  {
+    unsigned char token = *in++;
+
+    std::size_t numLiterals = token >> 4;
+    if (numLiterals == 15 && !readLength(in, end, numLiterals))
+      return false;
+    if (numLiterals > (std::size_t) (end - in) || numLiterals > dstLength - out)
+      return false;
+    std::memcpy(dst + out, in, numLiterals);
+    in += numLiterals;
+    out += numLiterals;
+
+    // the last token has no back reference
+    if (in == end)
+      break;
+
+    if (end - in < 2)
+      return false;
+    std::size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+
+    std::size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(in, end, matchLength))
+      return false;
+    matchLength += MIN_MATCH;
+
+    if (offset == 0 || offset > out || matchLength > dstLength - out)
+      return false;
+
+    // copied byte by byte, a reference may overlap the bytes it produces
+    for (std::size_t i = 0; i < matchLength; i++, out++)
+      dst[out] = dst[out - offset];
+  }
+
+  return out == dstLength;
+}
+
+std::size_t PageCodec::compressDelta(const char* src, const std::size_t length, std::string& dst)
+{
+  std::string deltas(length, '\0');
+  std::uint32_t previous = 0;
+  for (std::size_t pos = 0; pos + sizeof(std::uint32_t) <= length; pos += sizeof(std::uint32_t))
+  {
+    std::uint32_t word = read32(src + pos);
+    std::uint32_t delta = word - previous;
+    std::memcpy(&deltas[pos], &delta, sizeof(delta));
+    previous = word;
+  }
+  return compress(deltas.data(), length, dst);
+}
+
+bool PageCodec::decompressDelta(const char* src, const std::size_t length, char* dst, const std::size_t dstLength)
+{
+  if (!decompress(src, length, dst, dstLength))
+    return false;
+
+  // undo the differences in place
+  std::uint32_t previous = 0;
+  for (std::size_t pos = 0; pos + sizeof(std::uint32_t) <= dstLength; pos += sizeof(std::uint32_t))
+  {
+    std::uint32_t word = read32(dst + pos) + previous;
+    std::memcpy(dst + pos, &word, sizeof(word));
+    previous = word;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,70 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace badgerdb {
+
+/**
+* @brief A fast byte-oriented LZ77 codec for pages.
+* The compressed form is a sequence of tokens, each a run of literal bytes followed by a back reference
+* (offset and length) into the bytes already produced; the last token has literals only. Pages with
+* unused space or repetitive content, like index nodes with small keys, shrink a lot, at a speed close
+* to that of copying the page.
+*/
+class PageCodec
+{
+ public:
+	/**
+	 * Compresses a block of bytes.
+	 *
+	 * @param src   	Bytes to compress
+	 * @param length  Number of bytes to compress, at most 64KB apart matches are found
+	 * @param dst   	Compressed bytes are returned via this string, replacing its contents
+	 * @return Size of the compressed bytes
+	 */
+  static std::size_t compress(const char* src, const std::size_t length, std::string& dst);
+
+	/**
+	 * Decompresses a block of bytes compressed by compress().
+	 *
+	 * @param src   	Compressed bytes
+	 * @param length  Number of compressed bytes
+	 * @param dst   	Buffer the original bytes are written to
+	 * @param dstLength	Number of original bytes
+	 * @return true if the compressed bytes are well formed and decompress to exactly dstLength bytes
+	 */
+  static bool decompress(const char* src, const std::size_t length, char* dst, const std::size_t dstLength);
+
+	/**
+	 * Compresses a block of 32-bit words after replacing each word by its difference to the word before.
+	 * Sorted integers, like the keys of index nodes, turn into runs of small repeated values that the
+	 * LZ77 pass packs tightly.
+	 *
+	 * @param src   	Bytes to compress
+	 * @param length  Number of bytes to compress, a multiple of 4
+	 * @param dst   	Compressed bytes are returned via this string, replacing its contents
+	 * @return Size of the compressed bytes
+	 */
+  static std::size_t compressDelta(const char* src, const std::size_t length, std::string& dst);
+
+	/**
+	 * Decompresses a block of bytes compressed by compressDelta().
+	 *
+	 * @param src   	Compressed bytes
+	 * @param length  Number of compressed bytes
+	 * @param dst   	Buffer the original bytes are written to
+	 * @param dstLength	Number of original bytes, a multiple of 4
+	 * @return true if the compressed bytes are well formed and decompress to exactly dstLength bytes
+	 */
+  static bool decompressDelta(const char* src, const std::size_t length, char* dst, const std::size_t dstLength);
+};
+
+}
@@ -0,0 +1,178 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "pageMapping.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace badgerdb {
+
+const std::size_t PageMappingTable::SECTOR_BYTES;
+const std::uint32_t PageMappingTable::MAGIC;
+const std::size_t PageMappingTable::DIRECTORY_OFFSET;
+const std::size_t PageMappingTable::DIRECTORY_BYTES;
+const std::size_t PageMappingTable::ENTRIES_PER_CHUNK;
+const std::size_t PageMappingTable::MAX_CHUNKS;
+
+namespace {
+
+// Sectors taken by one chunk of the table.
+const std::uint32_t CHUNK_SECTORS = Page::SIZE / PageMappingTable::SECTOR_BYTES;
+
+}
+
+PageMappingTable::PageMappingTable()
+    : end_sector_(0),
+      directory_dirty_(false) {
+}
+
+bool PageMappingTable::grow(const PageId num_pages) {
+  while (size() < num_pages) {
+    const std::size_t chunk = size() / ENTRIES_PER_CHUNK;
+    if (chunk >= chunks_.size()) {
+      if (chunks_.size() >= MAX_CHUNKS) {
+        return false;
+      }
+      chunks_.push_back(allocate(CHUNK_SECTORS));
+      directory_dirty_ = true;
+    }
+    const Entry empty = {0 /* sector */, 0 /* bytes */, ENCODING_EMPTY,
+                         0 /* sectors */};
+    entries_.push_back(empty);
+    dirty_chunks_.insert(chunk);
+  }
+  return true;
+}
+
+std::uint32_t PageMappingTable::place(const PageId page_number,
+                                      const std::size_t bytes,
+                                      const PageEncoding encoding) {
+  Entry& entry = entries_[page_number];
+  const std::uint32_t needed = sectorsFor(bytes);
+  if (entry.sectors >= needed) {
+    // Fits where it is; hand back what it no longer needs.
+    if (entry.sectors > needed) {
+      release(entry.sector + needed, entry.sectors - needed);
+    }
+  } else {
+    if (entry.sectors > 0) {
+      release(entry.sector, entry.sectors);
+    }
+    entry.sector = allocate(needed);
+  }
+  entry.sectors = static_cast<std::uint8_t>(needed);
+  entry.bytes = static_cast<std::uint16_t>(bytes);
+  entry.encoding = static_cast<std::uint8_t>(encoding);
+  dirty_chunks_.insert(page_number / ENTRIES_PER_CHUNK);
+  return entry.sector;
+}
+
+void PageMappingTable::loadDirectory(const char* bytes) {
+  std::uint32_t count;
+  std::memcpy(&count, bytes, sizeof(count));
+  count = std::min<std::uint32_t>(count, MAX_CHUNKS);
+  chunks_.resize(count);
+  if (count > 0) {
+    std::memcpy(&chunks_[0], bytes + sizeof(count), count * sizeof(std::uint32_t));
+  }
+}
+
+void PageMappingTable::storeDirectory(char* bytes) const {
+  std::memset(bytes, 0, DIRECTORY_BYTES);
+  const std::uint32_t count = static_cast<std::uint32_t>(chunks_.size());
+  std::memcpy(bytes, &count, sizeof(count));
+  if (count > 0) {
+    std::memcpy(bytes + sizeof(count), &chunks_[0], count * sizeof(std::uint32_t));
+  }
+}
+
+void PageMappingTable::loadChunk(const std::size_t chunk, const char* bytes) {
+  const std::size_t first = chunk * ENTRIES_PER_CHUNK;
+  if (entries_.size() < first + ENTRIES_PER_CHUNK) {
+    entries_.resize(first + ENTRIES_PER_CHUNK);
+  }
+  std::memcpy(&entries_[first], bytes, ENTRIES_PER_CHUNK * sizeof(Entry));
+}
+
+void PageMappingTable::storeChunk(const std::size_t chunk, char* bytes) const {
+  std::memset(bytes, 0, Page::SIZE);
+  const std::size_t first = chunk * ENTRIES_PER_CHUNK;
+  if (first >= entries_.size()) {
+    return;
+  }
+  const std::size_t count = std::min(ENTRIES_PER_CHUNK, entries_.size() - first);
+  std::memcpy(bytes, &entries_[first], count * sizeof(Entry));
+}
+
+void PageMappingTable::finishLoad(const PageId num_pages) {
+  entries_.resize(num_pages);
+
+  // Every sector not in the run of a page or a chunk is free.
+  std::vector<std::pair<std::uint32_t, std::uint32_t> > used;
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].encoding != ENCODING_EMPTY && entries_[i].sectors > 0) {
+      used.push_back(std::make_pair(entries_[i].sector,
+                                    (std::uint32_t) entries_[i].sectors));
+    }
+  }
+  for (std::size_t i = 0; i < chunks_.size(); ++i) {
+    used.push_back(std::make_pair(chunks_[i], CHUNK_SECTORS));
+  }
+  std::sort(used.begin(), used.end());
+
+  free_runs_.clear();
+  end_sector_ = 0;
+  for (std::size_t i = 0; i < used.size(); ++i) {
+    if (used[i].first > end_sector_) {
+      free_runs_[end_sector_] = used[i].first - end_sector_;
+    }
+    end_sector_ = std::max(end_sector_, used[i].first + used[i].second);
+  }
+  clean();
+}
+
+std::uint32_t PageMappingTable::allocate(const std::uint32_t sectors) {
+  for (std::map<std::uint32_t, std::uint32_t>::iterator it = free_runs_.begin();
+       it != free_runs_.end(); ++it) {
+    if (it->second < sectors) {
+      continue;
+    }
+    const std::uint32_t sector = it->first;
+    const std::uint32_t left = it->second - sectors;
+    free_runs_.erase(it);
+    if (left > 0) {
+      free_runs_[sector + sectors] = left;
+    }
+    return sector;
+  }
+  const std::uint32_t sector = end_sector_;
+  end_sector_ += sectors;
+  return sector;
+}
+
+void PageMappingTable::release(std::uint32_t sector, std::uint32_t sectors) {
+  // Merge with the runs on either side.
+  std::map<std::uint32_t, std::uint32_t>::iterator next = free_runs_.lower_bound(sector);
+  if (next != free_runs_.begin()) {
+    std::map<std::uint32_t, std::uint32_t>::iterator previous = next;
+    --previous;
+    if (previous->first + previous->second == sector) {
+      sector = previous->first;
+      sectors += previous->second;
+      free_runs_.erase(previous);
+    }
+  }
+  if (next != free_runs_.end() && sector + sectors == next->first) {
+    sectors += next->second;
+    free_runs_.erase(next);
+  }
+  free_runs_[sector] = sectors;
+}
+
+}
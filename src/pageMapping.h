@@ -0,0 +1,280 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+#include <sys/types.h>
+
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief How a page of a compressed file is stored.
+ */
+enum PageEncoding {
+  ENCODING_EMPTY = 0,     // not written since it was allocated; takes no space
+  ENCODING_RAW = 1,       // stored as it is
+  ENCODING_LZ = 2,        // PageCodec::compress()
+  ENCODING_DELTA_LZ = 3   // PageCodec::compressDelta()
+};
+
+/**
+ * @brief Table mapping the pages of a compressed BlobFile to the variable
+ *        amount of space they take on disk.
+ *
+ * Past the header page, a compressed file is a sequence of SECTOR_BYTES
+ * sectors.  Each page is stored in a run of sectors just long enough for its
+ * compressed bytes; a page that grows out of its run moves to a new one and
+ * its old run is reused.  The table itself is kept in chunks of
+ * ENTRIES_PER_CHUNK entries, each stored in a run of sectors of its own; the
+ * header page lists where the chunks are.
+ *
+ * This class only keeps the table and the sector space in memory and knows
+ * the layout; the file reads and writes the sectors.
+ */
+class PageMappingTable {
+ public:
+  /**
+   * Unit of space on disk.
+   */
+  static const std::size_t SECTOR_BYTES = 512;
+
+  /**
+   * Value stored after the file header of compressed files.
+   */
+  static const std::uint32_t MAGIC = 0x435a5031;  // "CZP1"
+
+  /**
+   * Position of the chunk directory in the header page.
+   */
+  static const std::size_t DIRECTORY_OFFSET = 24;
+
+  /**
+   * Bytes of the chunk directory, which ends with the header page.
+   */
+  static const std::size_t DIRECTORY_BYTES = Page::SIZE - DIRECTORY_OFFSET;
+
+  /**
+   * @brief Where a page is stored.
+   */
+  struct Entry {
+    /**
+     * First sector of the run holding the page.
+     */
+    std::uint32_t sector;
+
+    /**
+     * Number of bytes stored.
+     */
+    std::uint16_t bytes;
+
+    /**
+     * How the page is stored, a PageEncoding.
+     */
+    std::uint8_t encoding;
+
+    /**
+     * Number of sectors of the run, which may be more than the bytes need.
+     */
+    std::uint8_t sectors;
+  };
+
+  /**
+   * Number of entries in a chunk of the table.
+   */
+  static const std::size_t ENTRIES_PER_CHUNK = Page::SIZE / sizeof(Entry);
+
+  /**
+   * Most chunks the directory can list.
+   */
+  static const std::size_t MAX_CHUNKS =
+      (DIRECTORY_BYTES - sizeof(std::uint32_t)) / sizeof(std::uint32_t);
+
+  /**
+   * Returns the position in the file of the given sector.
+   *
+   * @param sector  Number of sector.
+   */
+  static off_t sectorPosition(const std::uint32_t sector) {
+    return (off_t) Page::SIZE + (off_t) sector * SECTOR_BYTES;
+  }
+
+  /**
+   * Returns the number of sectors needed for the given number of bytes.
+   *
+   * @param bytes   Number of bytes.
+   */
+  static std::uint32_t sectorsFor(const std::size_t bytes) {
+    return static_cast<std::uint32_t>((bytes + SECTOR_BYTES - 1) / SECTOR_BYTES);
+  }
+
+  /**
+   * Constructs a table without any pages; grow() or loading adds them.
+   */
+  PageMappingTable();
+
+  /**
+   * Extends the table to cover the given number of pages, adding chunks as
+   * needed.  New pages are empty.
+   *
+   * @param num_pages   Number of pages in the file, including the header page.
+   * @return  False if the directory has no room for another chunk.
+   */
+  bool grow(const PageId num_pages);
+
+  /**
+   * Returns the number of pages the table covers.
+   */
+  PageId size() const { return static_cast<PageId>(entries_.size()); }
+
+  /**
+   * Returns where the given page is stored.
+   *
+   * @param page_number   Number of page.
+   */
+  const Entry& entry(const PageId page_number) const {
+    return entries_[page_number];
+  }
+
+  /**
+   * Finds room for a new version of the given page, in place if its run is
+   * long enough and in another run otherwise, and records it.
+   *
+   * @param page_number   Number of page.
+   * @param bytes         Number of bytes to store.
+   * @param encoding      How the bytes are encoded.
+   * @return  First sector to write the bytes to.
+   */
+  std::uint32_t place(const PageId page_number, const std::size_t bytes,
+                      const PageEncoding encoding);
+
+  /**
+   * Returns the number of sectors from the first one up to the last one in
+   * use.
+   */
+  std::uint32_t endSector() const { return end_sector_; }
+
+  /**
+   * Fills the directory in from the directory area of the header page.
+   *
+   * @param bytes   DIRECTORY_BYTES bytes of the header page.
+   */
+  void loadDirectory(const char* bytes);
+
+  /**
+   * Writes the directory out into the directory area of the header page.
+   *
+   * @param bytes   Receives DIRECTORY_BYTES bytes.
+   */
+  void storeDirectory(char* bytes) const;
+
+  /**
+   * Returns the number of chunks of the table.
+   */
+  std::size_t numChunks() const { return chunks_.size(); }
+
+  /**
+   * Returns the first sector of the run holding the given chunk.
+   *
+   * @param chunk   Number of chunk.
+   */
+  std::uint32_t chunkSector(const std::size_t chunk) const {
+    return chunks_[chunk];
+  }
+
+  /**
+   * Fills the entries of the given chunk in from their on-disk form.  Once
+   * all chunks are loaded, finishLoad() trims the table.
+   *
+   * @param chunk   Number of chunk.
+   * @param bytes   Page::SIZE bytes of the chunk.
+   */
+  void loadChunk(const std::size_t chunk, const char* bytes);
+
+  /**
+   * Writes the entries of the given chunk out in their on-disk form.
+   *
+   * @param chunk   Number of chunk.
+   * @param bytes   Receives Page::SIZE bytes.
+   */
+  void storeChunk(const std::size_t chunk, char* bytes) const;
+
+  /**
+   * Trims the loaded table to the pages of the file and works out the runs of
+   * unused sectors.
+   *
+   * @param num_pages   Number of pages in the file, including the header page.
+   */
+  void finishLoad(const PageId num_pages);
+
+  /**
+   * Returns the chunks changed since clean() was last called.
+   */
+  const std::set<std::size_t>& dirtyChunks() const { return dirty_chunks_; }
+
+  /**
+   * Returns true if chunks were added since clean() was last called.
+   */
+  bool directoryDirty() const { return directory_dirty_; }
+
+  /**
+   * Forgets about changed chunks and directory, once they have been written.
+   */
+  void clean() {
+    dirty_chunks_.clear();
+    directory_dirty_ = false;
+  }
+
+ private:
+  /**
+   * Takes a run of the given number of sectors from the unused ones, or from
+   * the end of the file.
+   */
+  std::uint32_t allocate(const std::uint32_t sectors);
+
+  /**
+   * Hands a run of sectors back.
+   */
+  void release(const std::uint32_t sector, const std::uint32_t sectors);
+
+  /**
+   * Where each page is stored, indexed by page number.
+   */
+  std::vector<Entry> entries_;
+
+  /**
+   * First sector of each chunk of the table.
+   */
+  std::vector<std::uint32_t> chunks_;
+
+  /**
+   * Runs of unused sectors below end_sector_, by first sector.
+   */
+  std::map<std::uint32_t, std::uint32_t> free_runs_;
+
+  /**
+   * One past the last sector in use.
+   */
+  std::uint32_t end_sector_;
+
+  /**
+   * Chunks changed since they were last written.
+   */
+  std::set<std::size_t> dirty_chunks_;
+
+  /**
+   * Whether chunks were added since the directory was last written.
+   */
+  bool directory_dirty_;
+};
+
+}
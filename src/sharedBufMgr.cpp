@@ -0,0 +1,581 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sharedBufMgr.h"
+#include "exceptions/shared_pool_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+
+namespace badgerdb {
+
+static const std::uint32_t SEGMENT_MAGIC = 0x42444253;
+
+// how long a process attaching to a segment waits for its creator to set it up
+static const int ATTACH_TIMEOUT_MS = 5000;
+
+static std::size_t alignUp(std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool processAlive(pid_t pid)
+{
+  return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+SharedBufMgr::SegmentLatch::SegmentLatch(SharedBufMgr* ownerIn)
+	: owner(ownerIn)
+{
+  pthread_mutex_t* latch = &owner->header->latch;
+  int rc = pthread_mutex_lock(latch);
+  if (rc == EOWNERDEAD)
+  {
+    // the previous owner died holding the latch, maybe half way through a change; the latch is only
+    // marked consistent once the segment is. Otherwise it is released inconsistent, which makes it
+    // unusable for every process
+    try
+    {
+      owner->repair();
+    }
+    catch (const BadgerDbException &e)
+    {
+      pthread_mutex_unlock(latch);
+      throw;
+    }
+    pthread_mutex_consistent(latch);
+  }
+  else if (rc == ENOTRECOVERABLE)
+    throw SharedPoolException(owner->segmentName, "segment could not be repaired after a process died holding its latch");
+  else if (rc != 0)
+    throw SharedPoolException(owner->segmentName, std::strerror(rc));
+}
+
+SharedBufMgr::SegmentLatch::~SegmentLatch()
+{
+  pthread_mutex_unlock(&owner->header->latch);
+}
+
+
+std::uint32_t SharedBufMgr::tableSize(std::uint32_t bufs)
+{
+  return ((std::uint32_t) (bufs * 1.2)) + 1;
+}
+
+std::size_t SharedBufMgr::layout(std::uint32_t bufs, std::size_t& bucketsOff, std::size_t& framesOff, std::size_t& pinsOff,
+                                 std::size_t& poolOff)
+{
+  bucketsOff = alignUp(sizeof(SegmentHeader), 64);
+  framesOff = alignUp(bucketsOff + tableSize(bufs) * sizeof(std::int32_t), 64);
+  pinsOff = alignUp(framesOff + bufs * sizeof(SharedFrame), 64);
+  poolOff = alignUp(pinsOff + (std::size_t) bufs * MAX_PROCESSES * sizeof(std::uint32_t), 4096);
+  return poolOff + (std::size_t) bufs * sizeof(Page);
+}
+
+void SharedBufMgr::mapParts()
+{
+  std::size_t bucketsOff, framesOff, pinsOff, poolOff;
+  layout(header->numBufs, bucketsOff, framesOff, pinsOff, poolOff);
+  char* start = static_cast<char*>(base);
+  buckets = reinterpret_cast<std::int32_t*>(start + bucketsOff);
+  frames = reinterpret_cast<SharedFrame*>(start + framesOff);
+  pins = reinterpret_cast<std::uint32_t*>(start + pinsOff);
+  pool = reinterpret_cast<Page*>(start + poolOff);
+}
+
+SharedBufMgr::SharedBufMgr(const std::string& name, std::uint32_t bufs)
+	: segmentName(name), base(MAP_FAILED), bytes(0), header(NULL), processSlot(-1)
+{
+  if (bufs == 0)
+    throw SharedPoolException(name, "a pool needs at least one frame");
+
+  bool created = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST)
+  {
+    created = false;
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0)
+    throw SharedPoolException(name, std::strerror(errno));
+
+  if (created)
+  {
+    std::size_t bucketsOff, framesOff, pinsOff, poolOff;
+    bytes = layout(bufs, bucketsOff, framesOff, pinsOff, poolOff);
+    if (ftruncate(fd, bytes) != 0)
+    {
+      int err = errno;
+      close(fd);
+      shm_unlink(name.c_str());
+      throw SharedPoolException(name, std::strerror(err));
+    }
+  }
+  else
+  {
+    // the creator sizes the segment right after creating it
+    struct stat st;
+    int waitedMs = 0;
+    while (fstat(fd, &st) == 0 && (std::size_t) st.st_size < sizeof(SegmentHeader) && waitedMs < ATTACH_TIMEOUT_MS)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      waitedMs++;
+    }
+    if ((std::size_t) st.st_size < sizeof(SegmentHeader))
+    {
+      close(fd);
+      throw SharedPoolException(name, "segment was never set up by its creator");
+    }
+    bytes = st.st_size;
+  }
+
+  base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    throw SharedPoolException(name, std::strerror(errno));
+  header = static_cast<SegmentHeader*>(base);
+
+  if (created)
+  {
+    // the segment is zero filled, so only what is not zero needs setting up
+    header->magic = SEGMENT_MAGIC;
+    header->numBufs = bufs;
+    header->htSize = tableSize(bufs);
+    header->clockHand = bufs - 1;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->latch, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    mapParts();
+    for (std::uint32_t i = 0; i < header->htSize; i++)
+      buckets[i] = -1;
+    for (std::uint32_t i = 0; i < bufs; i++)
+      frames[i].next = -1;
+
+    header->ready.store(1, std::memory_order_release);
+  }
+  else
+  {
+    int waitedMs = 0;
+    while (header->ready.load(std::memory_order_acquire) == 0 && waitedMs < ATTACH_TIMEOUT_MS)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      waitedMs++;
+    }
+    std::size_t bucketsOff, framesOff, pinsOff, poolOff;
+    if (header->ready.load(std::memory_order_acquire) == 0 || header->magic != SEGMENT_MAGIC
+        || layout(header->numBufs, bucketsOff, framesOff, pinsOff, poolOff) != bytes)
+    {
+      munmap(base, bytes);
+      throw SharedPoolException(name, "segment is not a buffer pool");
+    }
+    mapParts();
+  }
+
+  try
+  {
+    SegmentLatch latch(this);
+    processSlot = attachProcess();
+  }
+  catch (const BadgerDbException &e)
+  {
+    munmap(base, bytes);
+    throw;
+  }
+}
+
+SharedBufMgr::~SharedBufMgr()
+{
+  // pins this process did not release go with it
+  try
+  {
+    SegmentLatch latch(this);
+    reclaimPins(processSlot);
+    header->processes[processSlot].used = false;
+  }
+  catch (const BadgerDbException &e)
+  {
+  }
+
+  for (std::map<std::int32_t, File*>::iterator it = ownFiles.begin(); it != ownFiles.end(); ++it)
+    delete it->second;
+  munmap(base, bytes);
+}
+
+void SharedBufMgr::removeSegment(const std::string& name)
+{
+  shm_unlink(name.c_str());
+}
+
+
+std::int32_t SharedBufMgr::attachProcess()
+{
+  // a slot is free if it is unused or its process died without detaching
+  for (std::uint32_t i = 0; i < MAX_PROCESSES; i++)
+  {
+    SharedProcess& process = header->processes[i];
+    if (process.used && processAlive(process.pid))
+      continue;
+    if (process.used)
+      reclaimPins(i);
+    process.pid = getpid();
+    process.used = true;
+    return i;
+  }
+  throw SharedPoolException(segmentName, "too many processes attached to the pool");
+}
+
+void SharedBufMgr::reclaimPins(std::int32_t slot)
+{
+  for (std::uint32_t i = 0; i < header->numBufs; i++)
+  {
+    std::uint32_t& count = pins[i * MAX_PROCESSES + slot];
+    frames[i].pinCnt -= std::min<std::int32_t>(frames[i].pinCnt, count);
+    count = 0;
+  }
+}
+
+void SharedBufMgr::repair()
+{
+  // nothing can be trusted about a segment whose shape is wrong
+  std::size_t bucketsOff, framesOff, pinsOff, poolOff;
+  if (header->magic != SEGMENT_MAGIC || header->htSize != tableSize(header->numBufs)
+      || layout(header->numBufs, bucketsOff, framesOff, pinsOff, poolOff) != bytes)
+    throw SharedPoolException(segmentName, "segment damaged by a process that died holding its latch");
+  if (header->clockHand >= header->numBufs)
+    header->clockHand = 0;
+
+  for (std::uint32_t i = 0; i < MAX_PROCESSES; i++)
+  {
+    SharedProcess& process = header->processes[i];
+    if (process.used && !processAlive(process.pid))
+    {
+      reclaimPins(i);
+      process.used = false;
+    }
+  }
+
+  // the dead process may have left a chain half linked or a frame out of its chain
+  for (std::uint32_t i = 0; i < header->htSize; i++)
+    buckets[i] = -1;
+  for (std::uint32_t i = 0; i < header->numBufs; i++)
+  {
+    SharedFrame& frame = frames[i];
+    frame.next = -1;
+
+    std::int32_t pinCnt = 0;
+    for (std::uint32_t slot = 0; slot < MAX_PROCESSES; slot++)
+    {
+      if (header->processes[slot].used)
+        pinCnt += pins[i * MAX_PROCESSES + slot];
+    }
+
+    bool known = frame.valid && frame.fileId >= 0 && frame.fileId < (std::int32_t) MAX_FILES
+                 && header->files[frame.fileId].used && lookup(frame.fileId, frame.pageNo) < 0;
+    if (!known)
+    {
+      if (pinCnt > 0)
+        throw SharedPoolException(segmentName, "pinned frame lost its page when a process died holding the latch");
+      frame.valid = false;
+      frame.dirty = false;
+      frame.pinCnt = 0;
+      continue;
+    }
+
+    frame.pinCnt = pinCnt;
+    insert(frame.fileId, frame.pageNo, i);
+  }
+}
+
+void SharedBufMgr::pin(std::int32_t frameNo)
+{
+  frames[frameNo].pinCnt++;
+  pins[frameNo * MAX_PROCESSES + processSlot]++;
+}
+
+void SharedBufMgr::unpin(std::int32_t frameNo)
+{
+  frames[frameNo].pinCnt--;
+
+  // a page may be unpinned by another process than the one which pinned it
+  std::uint32_t slot = processSlot;
+  for (std::uint32_t i = 0; pins[frameNo * MAX_PROCESSES + slot] == 0 && i < MAX_PROCESSES; i++)
+    slot = i;
+  if (pins[frameNo * MAX_PROCESSES + slot] > 0)
+    pins[frameNo * MAX_PROCESSES + slot]--;
+}
+
+std::int32_t SharedBufMgr::findFileId(const File* file) const
+{
+  for (std::uint32_t i = 0; i < MAX_FILES; i++)
+  {
+    if (header->files[i].used && file->filename() == header->files[i].path)
+      return i;
+  }
+  return -1;
+}
+
+std::int32_t SharedBufMgr::fileId(const File* file)
+{
+  // other processes may add pages to the file through the pool
+  file->markShared();
+
+  std::int32_t id = findFileId(file);
+  if (id >= 0)
+    return id;
+
+  if (file->filename().size() >= MAX_PATH_LEN)
+    throw SharedPoolException(segmentName, "file path too long: " + file->filename());
+  for (std::uint32_t i = 0; i < MAX_FILES; i++)
+  {
+    SharedFile& entry = header->files[i];
+    if (!entry.used)
+    {
+      std::strcpy(entry.path, file->filename().c_str());
+      entry.blob = dynamic_cast<const BlobFile*>(file) != NULL;
+      entry.used = true;
+      return i;
+    }
+  }
+  throw SharedPoolException(segmentName, "too many files in the pool");
+}
+
+File* SharedBufMgr::fileFor(std::int32_t id, File* hint)
+{
+  const SharedFile& entry = header->files[id];
+  if (hint != NULL && hint->filename() == entry.path)
+    return hint;
+
+  // the id may have been given to another file since this process opened the file
+  std::map<std::int32_t, File*>::iterator it = ownFiles.find(id);
+  if (it != ownFiles.end())
+  {
+    if (it->second->filename() == entry.path)
+      return it->second;
+    delete it->second;
+    ownFiles.erase(it);
+  }
+
+  File* file;
+  if (entry.blob)
+    file = new BlobFile(entry.path, false);
+  else
+    file = new PageFile(entry.path, false);
+  file->markShared();
+  ownFiles[id] = file;
+  return file;
+}
+
+
+std::uint32_t SharedBufMgr::hash(std::int32_t id, PageId pageNo) const
+{
+  return ((std::uint32_t) id * 2654435761u + pageNo) % header->htSize;
+}
+
+std::int32_t SharedBufMgr::lookup(std::int32_t id, PageId pageNo) const
+{
+  for (std::int32_t frameNo = buckets[hash(id, pageNo)]; frameNo >= 0; frameNo = frames[frameNo].next)
+  {
+    if (frames[frameNo].fileId == id && frames[frameNo].pageNo == pageNo)
+      return frameNo;
+  }
+  return -1;
+}
+
+void SharedBufMgr::insert(std::int32_t id, PageId pageNo, std::int32_t frameNo)
+{
+  std::uint32_t bucket = hash(id, pageNo);
+  frames[frameNo].next = buckets[bucket];
+  buckets[bucket] = frameNo;
+}
+
+void SharedBufMgr::remove(std::int32_t id, PageId pageNo)
+{
+  std::int32_t* link = &buckets[hash(id, pageNo)];
+  while (*link >= 0)
+  {
+    SharedFrame& frame = frames[*link];
+    if (frame.fileId == id && frame.pageNo == pageNo)
+    {
+      *link = frame.next;
+      frame.next = -1;
+      return;
+    }
+    link = &frame.next;
+  }
+}
+
+
+void SharedBufMgr::writeFrame(std::int32_t frameNo, File* hint)
+{
+  SharedFrame& frame = frames[frameNo];
+  fileFor(frame.fileId, hint)->writePage(frame.pageNo, pool[frameNo]);
+  frame.dirty = false;
+  header->diskwrites++;
+}
+
+std::int32_t SharedBufMgr::allocBuf(File* hint)
+{
+  // two rounds of the clock clear every reference bit, so a third finds nothing new
+  for (std::uint32_t i = 0; i < 2 * header->numBufs; i++)
+  {
+    header->clockHand = (header->clockHand + 1) % header->numBufs;
+    std::int32_t frameNo = header->clockHand;
+    SharedFrame& frame = frames[frameNo];
+
+    if (!frame.valid)
+      return frameNo;
+    if (frame.refbit)
+    {
+      frame.refbit = false;
+      continue;
+    }
+    if (frame.pinCnt > 0)
+      continue;
+
+    if (frame.dirty)
+      writeFrame(frameNo, hint);
+    remove(frame.fileId, frame.pageNo);
+    frame.valid = false;
+    return frameNo;
+  }
+  throw BufferExceededException();
+}
+
+
+void SharedBufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+  SegmentLatch latch(this);
+  header->accesses++;
+
+  std::int32_t id = fileId(file);
+  std::int32_t frameNo = lookup(id, pageNo);
+  if (frameNo >= 0)
+  {
+    header->hits++;
+    frames[frameNo].refbit = true;
+    pin(frameNo);
+    page = &pool[frameNo];
+    return;
+  }
+
+  header->misses++;
+  frameNo = allocBuf(file);
+  file->readPageInto(pageNo, pool[frameNo]);
+  header->diskreads++;
+
+  SharedFrame& frame = frames[frameNo];
+  frame.fileId = id;
+  frame.pageNo = pageNo;
+  frame.pinCnt = 0;
+  frame.dirty = false;
+  frame.refbit = true;
+  frame.valid = true;
+  insert(id, pageNo, frameNo);
+  pin(frameNo);
+  page = &pool[frameNo];
+}
+
+void SharedBufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
+{
+  SegmentLatch latch(this);
+
+  std::int32_t id = findFileId(file);
+  std::int32_t frameNo = id < 0 ? -1 : lookup(id, pageNo);
+  if (frameNo < 0)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  SharedFrame& frame = frames[frameNo];
+  if (frame.pinCnt == 0)
+    throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+  if (dirty)
+    frame.dirty = true;
+  unpin(frameNo);
+}
+
+void SharedBufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
+{
+  SegmentLatch latch(this);
+  header->accesses++;
+
+  std::int32_t id = fileId(file);
+  std::int32_t frameNo = allocBuf(file);
+  file->allocatePageInto(pageNo, pool[frameNo]);
+
+  SharedFrame& frame = frames[frameNo];
+  frame.fileId = id;
+  frame.pageNo = pageNo;
+  frame.pinCnt = 0;
+  frame.dirty = false;
+  frame.refbit = true;
+  frame.valid = true;
+  insert(id, pageNo, frameNo);
+  pin(frameNo);
+  page = &pool[frameNo];
+}
+
+void SharedBufMgr::flushFile(const File* file)
+{
+  SegmentLatch latch(this);
+
+  file->flushHeader();
+
+  std::int32_t id = findFileId(file);
+  if (id < 0)
+    return;
+
+  for (std::uint32_t i = 0; i < header->numBufs; i++)
+  {
+    SharedFrame& frame = frames[i];
+    if (!frame.valid || frame.fileId != id)
+      continue;
+    if (frame.pinCnt > 0)
+      throw PagePinnedException(file->filename(), frame.pageNo, i);
+    if (frame.dirty)
+      writeFrame(i, const_cast<File*>(file));
+    remove(id, frame.pageNo);
+    frame.valid = false;
+  }
+
+  // no page of the file is left, so its slot in the file table can be reused
+  header->files[id].used = false;
+  std::map<std::int32_t, File*>::iterator it = ownFiles.find(id);
+  if (it != ownFiles.end())
+  {
+    delete it->second;
+    ownFiles.erase(it);
+  }
+}
+
+BufStats SharedBufMgr::getBufStats()
+{
+  SegmentLatch latch(this);
+  BufStats stats;
+  stats.accesses = header->accesses;
+  stats.diskreads = header->diskreads;
+  stats.diskwrites = header->diskwrites;
+  stats.hits = header->hits;
+  stats.misses = header->misses;
+  return stats;
+}
+
+}
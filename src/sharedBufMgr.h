@@ -0,0 +1,328 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <sys/types.h>
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Buffer pool living in a POSIX shared memory segment, so that several worker processes
+* share one cache of pages instead of each holding its own copy.
+* The frames, their descriptors and the page table are all placed in the segment. Since File objects
+* are per process, pages are identified by the path of their file and their page number; a process
+* that has to write back a dirty page of a file it never opened opens the file itself.
+* The pool is serialized by one process-shared latch in the segment. The latch is robust: if a process
+* dies holding it, the next process taking it drops the pins of the dead processes, links the page table
+* anew from the frame descriptors and goes on, or throws if the segment is beyond repair.
+* The first process to name a segment creates it with the given number of frames; later processes
+* attach to it and use the number of frames it was created with. The segment outlives the processes
+* until it is removed with removeSegment().
+*/
+class SharedBufMgr
+{
+ public:
+	/**
+   * Largest number of distinct files the pool can hold pages of
+	 */
+  static const std::uint32_t MAX_FILES = 64;
+
+	/**
+   * Longest file path the pool accepts, including the terminating null
+	 */
+  static const std::uint32_t MAX_PATH_LEN = 256;
+
+	/**
+   * Largest number of processes attached to the pool at once
+	 */
+  static const std::uint32_t MAX_PROCESSES = 32;
+
+ private:
+	/**
+   * A file known to the pool
+	 */
+  struct SharedFile
+  {
+    char path[MAX_PATH_LEN];
+    bool used;
+    bool blob;
+  };
+
+	/**
+   * A process attached to the pool
+	 */
+  struct SharedProcess
+  {
+    pid_t pid;
+    bool used;
+  };
+
+	/**
+   * Descriptor of a frame, the shared counterpart of BufDesc. Frames of a hash bucket are chained by index.
+	 */
+  struct SharedFrame
+  {
+    std::int32_t fileId;
+    PageId pageNo;
+    std::int32_t pinCnt;
+    std::int32_t next;
+    bool valid;
+    bool dirty;
+    bool refbit;
+  };
+
+	/**
+   * Start of the segment
+	 */
+  struct SegmentHeader
+  {
+    std::uint32_t magic;
+    std::atomic<std::uint32_t> ready;
+    std::uint32_t numBufs;
+    std::uint32_t htSize;
+    std::uint32_t clockHand;
+    pthread_mutex_t latch;
+    std::uint64_t accesses;
+    std::uint64_t diskreads;
+    std::uint64_t diskwrites;
+    std::uint64_t hits;
+    std::uint64_t misses;
+    SharedFile files[MAX_FILES];
+    SharedProcess processes[MAX_PROCESSES];
+  };
+
+	/**
+   * Holds the latch of the segment for a scope, repairing the segment if the last owner of the latch died
+	 *
+	 * @throws SharedPoolException if the segment can not be repaired
+	 */
+  class SegmentLatch
+  {
+   public:
+    explicit SegmentLatch(SharedBufMgr* ownerIn);
+    ~SegmentLatch();
+
+   private:
+    SharedBufMgr* owner;
+  };
+
+	/**
+   * Name of the segment
+	 */
+  std::string segmentName;
+
+	/**
+   * Mapping of the segment in this process
+	 */
+  void* base;
+
+	/**
+   * Size of the segment in bytes
+	 */
+  std::size_t bytes;
+
+	/**
+   * Header of the segment
+	 */
+  SegmentHeader* header;
+
+	/**
+   * Page table, one chain of frames per bucket, -1 ending a chain
+	 */
+  std::int32_t* buckets;
+
+	/**
+   * Frame descriptors
+	 */
+  SharedFrame* frames;
+
+	/**
+   * Pins every attached process holds on every frame, MAX_PROCESSES counters per frame
+	 */
+  std::uint32_t* pins;
+
+	/**
+   * Slot of this process in the process table
+	 */
+  std::int32_t processSlot;
+
+	/**
+   * Frames
+	 */
+  Page* pool;
+
+	/**
+   * Files this process opened itself to write back pages of, keyed by file id
+	 */
+  std::map<std::int32_t, File*> ownFiles;
+
+	/**
+   * Returns the number of buckets of the page table for the given number of frames
+	 */
+  static std::uint32_t tableSize(std::uint32_t bufs);
+
+	/**
+   * Returns the segment size needed for the given number of frames and the offsets of its parts
+	 */
+  static std::size_t layout(std::uint32_t bufs, std::size_t& bucketsOff, std::size_t& framesOff, std::size_t& pinsOff,
+                            std::size_t& poolOff);
+
+	/**
+   * Points the members at the parts of the mapped segment
+	 */
+  void mapParts();
+
+	/**
+   * Takes a slot in the process table for this process. Assumes the latch is held.
+	 *
+	 * @throws SharedPoolException if the process table is full
+	 */
+  std::int32_t attachProcess();
+
+	/**
+   * Drops the pins the process in the given slot holds. Assumes the latch is held.
+	 */
+  void reclaimPins(std::int32_t slot);
+
+	/**
+   * Brings the segment back to a consistent state after a process died holding the latch: the pins of
+	 * dead processes are dropped, the pin counts are recomputed and the page table is linked anew from the
+	 * frame descriptors, dropping frames which hold no known page. Assumes the latch is held.
+	 *
+	 * @throws SharedPoolException if the segment header is damaged, or a frame pinned by a live process
+	 *				 holds no known page
+	 */
+  void repair();
+
+	/**
+   * Pins the frame for this process. Assumes the latch is held.
+	 */
+  void pin(std::int32_t frameNo);
+
+	/**
+   * Unpins the frame for this process. Assumes the latch is held.
+	 */
+  void unpin(std::int32_t frameNo);
+
+	/**
+   * Returns the id of the file in the segment, registering it if needed. Assumes the latch is held.
+	 *
+	 * @throws SharedPoolException if the path is too long or the file table is full
+	 */
+  std::int32_t fileId(const File* file);
+
+	/**
+   * Returns the id of the file if it is registered, else -1. Assumes the latch is held.
+	 */
+  std::int32_t findFileId(const File* file) const;
+
+	/**
+   * Returns a file object of this process for the given file id, opening the file if needed
+	 */
+  File* fileFor(std::int32_t id, File* hint);
+
+	/**
+   * Page table operations, assume the latch is held
+	 */
+  std::uint32_t hash(std::int32_t id, PageId pageNo) const;
+  std::int32_t lookup(std::int32_t id, PageId pageNo) const;
+  void insert(std::int32_t id, PageId pageNo, std::int32_t frameNo);
+  void remove(std::int32_t id, PageId pageNo);
+
+	/**
+   * Writes the page in the frame back to its file. Assumes the latch is held.
+	 */
+  void writeFrame(std::int32_t frameNo, File* hint);
+
+	/**
+   * Picks a frame with the clock algorithm, writing back the page it held if it is dirty. Assumes the latch is held.
+	 *
+	 * @throws BufferExceededException if all frames are pinned
+	 */
+  std::int32_t allocBuf(File* hint);
+
+ public:
+	/**
+   * Creates the named segment with the given number of frames, or attaches to it if it exists already.
+	 *
+	 * @param name   	Name of the segment, a POSIX shared memory name such as "/badgerdb"
+	 * @param bufs   	Number of frames if the segment is created
+	 * @throws SharedPoolException if the segment can not be created or attached to
+	 */
+  SharedBufMgr(const std::string& name, std::uint32_t bufs);
+
+	/**
+   * Detaches from the segment, closing the files this process opened for it.
+	 * Pages stay in the segment, dirty ones included, for the other processes.
+	 */
+  ~SharedBufMgr();
+
+	/**
+   * Removes the named segment. Processes attached to it keep their mapping.
+	 */
+  static void removeSegment(const std::string& name);
+
+	/**
+	 * Reads the given page from the file into a frame and returns the pointer to page.
+	 * If the requested page is already present in the pool, by any process, pointer to that frame is returned
+	 * otherwise a new frame is allocated from the pool for reading the page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page);
+
+	/**
+	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+   * @throws  PageNotPinnedException If the page is not already pinned
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+
+	/**
+	 * Allocates a new, empty page in the file and returns the Page object, pinned in the pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page);
+
+	/**
+	 * Writes out all dirty pages of the file and removes its pages from the pool, whichever process read them.
+	 * The file must be flushed before it is deleted, as with BufMgr; this also frees its entry in the file table.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the pool
+	 */
+  void flushFile(const File* file);
+
+	/**
+   * Returns the number of frames of the pool
+	 */
+  std::uint32_t getNumBufs() const { return header->numBufs; }
+
+	/**
+   * Returns the counters the pool shares between its processes. Only the access, hit, miss and disk
+	 * counters are kept.
+	 */
+  BufStats getBufStats();
+};
+
+}
@@ -0,0 +1,410 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "tablespace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const std::uint32_t Tablespace::MAGIC;
+const PageId Tablespace::EXTENT_PAGES;
+
+namespace {
+
+/**
+ * Bytes at the start of a catalog page: the next page of the chain and the
+ * number of catalog bytes the page holds.
+ */
+const std::size_t CATALOG_PAGE_HEADER = 2 * sizeof(std::uint32_t);
+
+/**
+ * Catalog bytes one page holds.
+ */
+const std::size_t CATALOG_PAGE_BYTES = Page::SIZE - CATALOG_PAGE_HEADER;
+
+template <typename T>
+void append(std::string& bytes, const T& value) {
+  bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * Reads values off the catalog bytes, failing once they run out.
+ */
+class CatalogReader {
+ public:
+  CatalogReader(const std::string& bytes, const std::string& filename)
+      : bytes_(bytes), filename_(filename), position_(0) {}
+
+  template <typename T>
+  T next() {
+    T value;
+    take(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+  }
+
+  std::string nextString(const std::size_t length) {
+    std::string value(length, '\0');
+    take(&value[0], length);
+    return value;
+  }
+
+ private:
+  void take(char* destination, const std::size_t length) {
+    if (position_ + length > bytes_.size()) {
+      throw FileIOException(filename_, "tablespace catalog is truncated");
+    }
+    std::memcpy(destination, bytes_.data() + position_, length);
+    position_ += length;
+  }
+
+  const std::string& bytes_;
+  const std::string& filename_;
+  std::size_t position_;
+};
+
+}
+
+Tablespace::Tablespace(const std::string& name, const bool create_new,
+                       const FileIoMode mode)
+    : container_(name, create_new, mode),
+      dirty_(false) {
+  if (create_new) {
+    Page root;
+    PageId root_number;
+    container_.allocatePageInto(root_number, root);
+    catalog_pages_.push_back(root_number);
+    dirty_ = true;
+    flush();
+  } else {
+    loadCatalog();
+  }
+}
+
+Tablespace::~Tablespace() {
+  try {
+    flush();
+  } catch (const FileIOException& e) {
+    std::cerr << e.message() << std::endl;
+  }
+}
+
+bool Tablespace::contains(const std::string& file_name) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return segments_.find(file_name) != segments_.end();
+}
+
+std::vector<std::string> Tablespace::fileNames() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::vector<std::string> names;
+  for (std::map<std::string, TablespaceSegment>::const_iterator it =
+           segments_.begin();
+       it != segments_.end(); ++it) {
+    names.push_back(it->first);
+  }
+  return names;
+}
+
+void Tablespace::removeFile(const std::string& file_name) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::map<std::string, TablespaceSegment>::iterator it =
+      segments_.find(file_name);
+  if (it == segments_.end()) {
+    throw FileNotFoundException(openName(file_name));
+  }
+  if (File::isOpen(openName(file_name))) {
+    throw FileOpenException(openName(file_name));
+  }
+  free_extents_.insert(free_extents_.end(), it->second.extents.begin(),
+                       it->second.extents.end());
+  segments_.erase(it);
+  dirty_ = true;
+}
+
+void Tablespace::flush() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (dirty_) {
+    std::string bytes;
+    append(bytes, MAGIC);
+    append(bytes, static_cast<std::uint32_t>(segments_.size()));
+    for (std::map<std::string, TablespaceSegment>::const_iterator it =
+             segments_.begin();
+         it != segments_.end(); ++it) {
+      append(bytes, static_cast<std::uint32_t>(it->first.size()));
+      bytes.append(it->first);
+      append(bytes, it->second.header);
+      append(bytes, static_cast<std::uint32_t>(it->second.extents.size()));
+      for (std::size_t i = 0; i < it->second.extents.size(); ++i) {
+        append(bytes, it->second.extents[i]);
+      }
+    }
+    append(bytes, static_cast<std::uint32_t>(free_extents_.size()));
+    for (std::size_t i = 0; i < free_extents_.size(); ++i) {
+      append(bytes, free_extents_[i]);
+    }
+
+    // The chain only grows; pages past the catalog hold no bytes.
+    Page page;
+    while (catalog_pages_.size() * CATALOG_PAGE_BYTES < bytes.size()) {
+      PageId page_number;
+      container_.allocatePageInto(page_number, page);
+      catalog_pages_.push_back(page_number);
+    }
+    for (std::size_t i = 0; i < catalog_pages_.size(); ++i) {
+      char* raw = reinterpret_cast<char*>(&page);
+      std::memset(raw, 0, Page::SIZE);
+      const std::uint32_t next = i + 1 < catalog_pages_.size()
+                                     ? catalog_pages_[i + 1]
+                                     : Page::INVALID_NUMBER;
+      const std::size_t start = i * CATALOG_PAGE_BYTES;
+      const std::uint32_t used = start < bytes.size()
+          ? static_cast<std::uint32_t>(
+                std::min(CATALOG_PAGE_BYTES, bytes.size() - start))
+          : 0;
+      std::memcpy(raw, &next, sizeof(next));
+      std::memcpy(raw + sizeof(next), &used, sizeof(used));
+      std::memcpy(raw + CATALOG_PAGE_HEADER, bytes.data() + start, used);
+      container_.writePage(catalog_pages_[i], page);
+    }
+    dirty_ = false;
+  }
+  container_.flushHeader();
+}
+
+TablespaceSegment* Tablespace::addSegment(const std::string& file_name) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (segments_.find(file_name) != segments_.end()) {
+    throw FileExistsException(openName(file_name));
+  }
+  TablespaceSegment& segment = segments_[file_name];
+  // Page 0 of a file is its header, kept here rather than in an extent.
+  const FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
+                             0 /* num_free_pages */, 0 /* first_free_page */};
+  segment.header = header;
+  dirty_ = true;
+  return &segment;
+}
+
+TablespaceSegment* Tablespace::findSegment(const std::string& file_name) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::map<std::string, TablespaceSegment>::iterator it =
+      segments_.find(file_name);
+  if (it == segments_.end()) {
+    throw FileNotFoundException(openName(file_name));
+  }
+  return &it->second;
+}
+
+void Tablespace::growSegment(TablespaceSegment& segment) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const Page empty;
+  PageId first;
+  if (!free_extents_.empty()) {
+    // Pages handed out have to read back empty, as in a new extent.
+    first = free_extents_.back();
+    const std::vector<const Page*> pages(EXTENT_PAGES, &empty);
+    container_.writePages(first, pages);
+    free_extents_.pop_back();
+  } else {
+    // Nothing else allocates from the container meanwhile, so the pages of
+    // the extent follow each other.
+    Page page;
+    PageId page_number;
+    container_.allocatePageInto(first, page);
+    for (PageId i = 1; i < EXTENT_PAGES; ++i) {
+      container_.allocatePageInto(page_number, page);
+    }
+  }
+  segment.extents.push_back(first);
+  dirty_ = true;
+}
+
+void Tablespace::storeHeader(TablespaceSegment& segment,
+                             const FileHeader& header) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  segment.header = header;
+  dirty_ = true;
+}
+
+void Tablespace::loadCatalog() {
+  std::string bytes;
+  PageId page_number = container_.getFirstPageNo();
+  while (page_number != Page::INVALID_NUMBER) {
+    const Page page = container_.readPage(page_number);
+    const char* raw = reinterpret_cast<const char*>(&page);
+    std::uint32_t next;
+    std::uint32_t used;
+    std::memcpy(&next, raw, sizeof(next));
+    std::memcpy(&used, raw + sizeof(next), sizeof(used));
+    if (used > CATALOG_PAGE_BYTES) {
+      throw FileIOException(name(), "tablespace catalog is corrupt");
+    }
+    bytes.append(raw + CATALOG_PAGE_HEADER, used);
+    catalog_pages_.push_back(page_number);
+    page_number = next;
+  }
+
+  CatalogReader reader(bytes, name());
+  if (reader.next<std::uint32_t>() != MAGIC) {
+    throw FileIOException(name(), "not a tablespace");
+  }
+  const std::uint32_t num_files = reader.next<std::uint32_t>();
+  for (std::uint32_t f = 0; f < num_files; ++f) {
+    const std::string file_name =
+        reader.nextString(reader.next<std::uint32_t>());
+    TablespaceSegment& segment = segments_[file_name];
+    segment.header = reader.next<FileHeader>();
+    segment.extents.resize(reader.next<std::uint32_t>());
+    for (std::size_t i = 0; i < segment.extents.size(); ++i) {
+      segment.extents[i] = reader.next<PageId>();
+    }
+  }
+  free_extents_.resize(reader.next<std::uint32_t>());
+  for (std::size_t i = 0; i < free_extents_.size(); ++i) {
+    free_extents_[i] = reader.next<PageId>();
+  }
+}
+
+
+TablespaceFile TablespaceFile::create(Tablespace& space,
+                                      const std::string& name) {
+  return TablespaceFile(space, name, true /* create_new */);
+}
+
+TablespaceFile TablespaceFile::open(Tablespace& space,
+                                    const std::string& name) {
+  return TablespaceFile(space, name, false /* create_new */);
+}
+
+TablespaceFile::TablespaceFile(Tablespace& space, const std::string& name,
+                               const bool create_new)
+    : File(space.openName(name), space.handle(),
+           segmentOf(space, name, create_new)->header),
+      space_(&space),
+      segment_(space.findSegment(name)) {
+}
+
+TablespaceFile::TablespaceFile(const TablespaceFile& other)
+    : File(other.filename_, other.handle_, other.readHeader()),
+      space_(other.space_),
+      segment_(other.segment_) {
+}
+
+TablespaceFile& TablespaceFile::operator=(const TablespaceFile& rhs) {
+  if (this != &rhs) {
+    flushHeader();
+    close();
+    filename_ = rhs.filename_;
+    space_ = rhs.space_;
+    segment_ = rhs.segment_;
+    openAttached(rhs.handle_, rhs.readHeader());
+  }
+  return *this;
+}
+
+TablespaceFile::~TablespaceFile() {
+  // ~File() can no longer reach storeHeader() of this class.
+  flushHeader();
+}
+
+Page TablespaceFile::allocatePage(PageId &new_page_number) {
+  Page new_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void TablespaceFile::allocatePageInto(PageId &new_page_number,
+                                      Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+  new_page.initialize();
+
+  new_page_number = header.num_pages;
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = header.num_pages;
+  }
+  ++header.num_pages;
+
+  // The empty page is already on disk as part of an extent.
+  if ((new_page_number - 1) / Tablespace::EXTENT_PAGES >=
+      segment_->extents.size()) {
+    space_->growSegment(*segment_);
+  }
+  writeHeader(header);
+}
+
+Page TablespaceFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void TablespaceFile::readPageInto(const PageId page_number, Page& page) const {
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&page), Page::SIZE);
+}
+
+void TablespaceFile::writePage(const PageId page_number, const Page& new_page) {
+  writeAt(pagePosition(page_number), reinterpret_cast<const char*>(&new_page),
+          Page::SIZE);
+}
+
+void TablespaceFile::writePages(const PageId first_page_number,
+                                const std::vector<const Page*>& pages) {
+  std::size_t done = 0;
+  while (done < pages.size()) {
+    // Pages are consecutive on disk up to the end of their extent.
+    const PageId page_number = first_page_number + done;
+    const std::size_t in_extent = std::min<std::size_t>(
+        pages.size() - done,
+        Tablespace::EXTENT_PAGES - (page_number - 1) % Tablespace::EXTENT_PAGES);
+    if (in_extent == 1) {
+      writePage(page_number, *pages[done]);
+    } else {
+      std::vector<char> run(in_extent * Page::SIZE);
+      for (std::size_t i = 0; i < in_extent; ++i) {
+        std::memcpy(&run[i * Page::SIZE], pages[done + i], Page::SIZE);
+      }
+      writeAt(pagePosition(page_number), run.data(), run.size());
+    }
+    done += in_extent;
+  }
+}
+
+void TablespaceFile::deletePage(const PageId page_number) {
+  throw InvalidPageException(page_number, filename_);
+}
+
+off_t TablespaceFile::pagePosition(const PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  const std::size_t extent = (page_number - 1) / Tablespace::EXTENT_PAGES;
+  if (page_number == Page::INVALID_NUMBER ||
+      extent >= segment_->extents.size()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return space_->containerPosition(segment_->extents[extent] +
+                                   (page_number - 1) % Tablespace::EXTENT_PAGES);
+}
+
+void TablespaceFile::storeHeader(const FileHeader& header) const {
+  space_->storeHeader(*segment_, header);
+}
+
+TablespaceSegment* TablespaceFile::segmentOf(Tablespace& space,
+                                             const std::string& name,
+                                             const bool create_new) {
+  return create_new ? space.addSegment(name) : space.findSegment(name);
+}
+
+}
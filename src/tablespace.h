@@ -0,0 +1,367 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Pages of one file of a Tablespace, as recorded in its catalog.
+ */
+struct TablespaceSegment {
+  /**
+   * Header of the file.
+   */
+  FileHeader header;
+
+  /**
+   * First page in the container of each extent of the file, in file order.
+   */
+  std::vector<PageId> extents;
+};
+
+/**
+ * @brief Container file on disk holding many BlobFiles, e.g. the indexes of a
+ *        database, behind a single descriptor.
+ *
+ * The container is a BlobFile.  Its page 1 starts a chain of catalog pages
+ * recording, for each file inside, its name, its header and the extents of
+ * EXTENT_PAGES container pages that hold its pages; page n of a file is page
+ * (n - 1) % EXTENT_PAGES of its extent number (n - 1) / EXTENT_PAGES.
+ * Extents of removed files are handed to files that grow later.  Files inside
+ * are opened as TablespaceFile objects, which share the container's
+ * descriptor, so opening one costs no system call.
+ *
+ * The catalog is kept in memory and written by flush() and when the
+ * tablespace is destroyed.
+ *
+ * @warning The tablespace has to outlive the TablespaceFile objects opened on
+ *          it.  Opening and closing files is not threadsafe.
+ */
+class Tablespace {
+ public:
+  /**
+   * Value the catalog starts with.
+   */
+  static const std::uint32_t MAGIC = 0x54425331;  // "TBS1"
+
+  /**
+   * Number of container pages a file grows by at a time.
+   */
+  static const PageId EXTENT_PAGES = 64;
+
+  /**
+   * Opens or creates a tablespace.
+   *
+   * @param name        Name of the container file.
+   * @param create_new  Whether to create a new container.
+   * @param mode        How pages are read and written.
+   * @throws  FileExistsException     If the container exists and create_new is
+   *                                  true.
+   * @throws  FileNotFoundException   If the container doesn't exist and
+   *                                  create_new is false.
+   * @throws  FileIOException         If the container holds no catalog.
+   */
+  Tablespace(const std::string& name, const bool create_new,
+             const FileIoMode mode = FILE_IO_BUFFERED);
+
+  /**
+   * Writes the catalog out.
+   */
+  ~Tablespace();
+
+  /**
+   * Returns the name of the container file.
+   */
+  const std::string& name() const { return container_.filename(); }
+
+  /**
+   * Returns true if a file with the given name is in the tablespace.
+   *
+   * @param file_name   Name of the file inside the tablespace.
+   */
+  bool contains(const std::string& file_name) const;
+
+  /**
+   * Returns the names of the files in the tablespace, in name order.
+   */
+  std::vector<std::string> fileNames() const;
+
+  /**
+   * Removes a file from the tablespace, keeping its extents for reuse.
+   *
+   * @param file_name   Name of the file inside the tablespace.
+   * @throws  FileNotFoundException   If there is no such file.
+   * @throws  FileOpenException       If the file is open.
+   */
+  void removeFile(const std::string& file_name);
+
+  /**
+   * Writes the catalog and the container header to disk if they changed.
+   *
+   * @throws  FileIOException  If they can not be written.
+   */
+  void flush();
+
+ private:
+  Tablespace(const Tablespace&);
+  Tablespace& operator=(const Tablespace&);
+
+  /**
+   * Returns the name the given file inside is known by among open files.
+   */
+  std::string openName(const std::string& file_name) const {
+    return name() + ":" + file_name;
+  }
+
+  /**
+   * Adds a file to the catalog and returns its segment.
+   */
+  TablespaceSegment* addSegment(const std::string& file_name);
+
+  /**
+   * Returns the segment of a file in the catalog.
+   */
+  TablespaceSegment* findSegment(const std::string& file_name);
+
+  /**
+   * Gives a segment another extent of empty pages, reusing one of a removed
+   * file if there is any.
+   */
+  void growSegment(TablespaceSegment& segment);
+
+  /**
+   * Records the header of a file in the catalog.
+   */
+  void storeHeader(TablespaceSegment& segment, const FileHeader& header);
+
+  /**
+   * Returns the position in the container of the given container page.
+   */
+  off_t containerPosition(const PageId page_number) const {
+    return container_.pageOffset(page_number);
+  }
+
+  /**
+   * Returns the descriptor of the container.
+   */
+  const std::shared_ptr<FileDescriptor>& handle() const {
+    return container_.handle_;
+  }
+
+  /**
+   * Reads the catalog from its chain of pages.
+   */
+  void loadCatalog();
+
+  /**
+   * Container holding the catalog and the pages of all files.
+   */
+  BlobFile container_;
+
+  /**
+   * Files in the tablespace, by name.  Segments stay where they are while
+   * their file is in the catalog.
+   */
+  std::map<std::string, TablespaceSegment> segments_;
+
+  /**
+   * First container page of each extent of removed files.
+   */
+  std::vector<PageId> free_extents_;
+
+  /**
+   * Container pages of the catalog chain, in chain order.
+   */
+  std::vector<PageId> catalog_pages_;
+
+  /**
+   * Whether the catalog changed since it was last written.
+   */
+  bool dirty_;
+
+  /**
+   * Latch guarding the catalog and container allocation.  Taken after the
+   * latch of a TablespaceFile, never before it.
+   */
+  mutable std::mutex mutex_;
+
+  friend class TablespaceFile;
+};
+
+/**
+ * @brief BlobFile-like file stored inside a Tablespace.
+ *
+ * Pages are stored as they are, in the extents of the container the catalog
+ * lists for the file, and are read and written through the container's
+ * descriptor.  The header lives in the catalog.
+ */
+class TablespaceFile : public File {
+ public:
+  /**
+   * Creates a new file in a tablespace.
+   *
+   * @param space   Tablespace to create the file in.
+   * @param name    Name of the file inside the tablespace.
+   * @throws  FileExistsException     If the tablespace has a file of that name.
+   */
+  static TablespaceFile create(Tablespace& space, const std::string& name);
+
+  /**
+   * Opens a file of a tablespace.
+   *
+   * @param space   Tablespace holding the file.
+   * @param name    Name of the file inside the tablespace.
+   * @throws  FileNotFoundException   If the tablespace has no such file.
+   */
+  static TablespaceFile open(Tablespace& space, const std::string& name);
+
+  /**
+   * Constructs a file object representing a file of a tablespace.
+   *
+   * @param space       Tablespace holding the file.
+   * @param name        Name of the file inside the tablespace.
+   * @param create_new  Whether to create a new file.
+   * @throws  FileExistsException     If the file exists and create_new is
+   *                                  true.
+   * @throws  FileNotFoundException   If the file doesn't exist and create_new
+   *                                  is false.
+   */
+  TablespaceFile(Tablespace& space, const std::string& name,
+                 const bool create_new);
+
+  /**
+   * Copy constructor.
+   *
+   * @param other File object to copy.
+   */
+  TablespaceFile(const TablespaceFile& other);
+
+  /**
+   * Assignment operator.
+   *
+   * @param rhs File object to assign.
+   * @return    Newly assigned file object.
+   */
+  TablespaceFile& operator=(const TablespaceFile& rhs);
+
+  /**
+   * Hands the header to the catalog before the file is closed.
+   */
+  ~TablespaceFile();
+
+  /**
+   * Allocates a new page in the file.
+   *
+   * @return The new page.
+   */
+  Page allocatePage(PageId &new_page_number) override;
+
+  /**
+   * Allocates a new page in the file, building it in the given page object.
+   *
+   * @param new_page_number   Number of the new page is returned via this.
+   * @param new_page          Page object which receives the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Reads an existing page from the file.
+   *
+   * @param page_number   Number of page to read.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
+   */
+  Page readPage(const PageId page_number) const override;
+
+  /**
+   * Reads an existing page from the file straight into the given page object.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page object which receives the page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Writes a page into the file at the given page number.
+   *
+   * @param page_number Number of page whose contents to replace.
+   * @param new_page    Page to write.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
+   */
+  void writePage(const PageId page_number, const Page& new_page) override;
+
+  /**
+   * Writes a run of pages with consecutive page numbers into the file, with
+   * one write call per extent the run touches.
+   *
+   * @param first_page_number Number of the first page of the run.
+   * @param pages             Pages to write, in page-number order.
+   * @throws  InvalidPageException  If a page doesn't exist in the file.
+   */
+  void writePages(const PageId first_page_number,
+                  const std::vector<const Page*>& pages) override;
+
+  /**
+   * Deletes a page from the file.  Not supported, as with BlobFile.
+   *
+   * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  Always.
+   */
+  void deletePage(const PageId page_number) override;
+
+  /**
+   * Pages are stored as they are.
+   */
+  bool rawPages() const override { return true; }
+
+ protected:
+  /**
+   * Returns the position of the page in the container.
+   *
+   * @param page_number   Number of page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
+   */
+  off_t pagePosition(const PageId page_number) const override;
+
+  /**
+   * Records the header in the catalog of the tablespace.
+   *
+   * @param header  File header to store.
+   */
+  void storeHeader(const FileHeader& header) const override;
+
+ private:
+  /**
+   * Returns the catalog entry of a file of a tablespace, adding it first if
+   * a new file is created.
+   */
+  static TablespaceSegment* segmentOf(Tablespace& space,
+                                      const std::string& name,
+                                      const bool create_new);
+
+  /**
+   * Tablespace holding the file.
+   */
+  Tablespace* space_;
+
+  /**
+   * Catalog entry of the file.
+   */
+  TablespaceSegment* segment_;
+};
+
+}
@@ -0,0 +1,93 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "victimCache.h"
+#include "pageCodec.h"
+
+namespace badgerdb {
+
+VictimCache::VictimCache(const std::size_t budgetBytes)
+	: budget(budgetBytes)
+{
+}
+
+void VictimCache::erase(EntryMap::iterator it)
+{
+  stats.bytesUsed -= it->second->data.size();
+  entries.erase(it->second);
+  index.erase(it);
+}
+
+void VictimCache::put(const File* file, const PageId pageNo, const Page& page)
+{
+  drop(file, pageNo);
+
+  Entry entry;
+  entry.file = file;
+  entry.pageNo = pageNo;
+  PageCodec::compress(reinterpret_cast<const char*>(&page), Page::SIZE, entry.data);
+
+  // a page that does not shrink by a quarter is cheaper to read back from disk
+  if (entry.data.size() > Page::SIZE - Page::SIZE / 4 || entry.data.size() > budget)
+  {
+    stats.rejections++;
+    return;
+  }
+
+  while (stats.bytesUsed + entry.data.size() > budget)
+  {
+    const Entry& oldest = entries.front();
+    erase(index.find(std::make_pair(oldest.file, oldest.pageNo)));
+    stats.evictions++;
+  }
+
+  stats.bytesUsed += entry.data.size();
+  stats.insertions++;
+  entries.push_back(Entry());
+  entries.back().file = file;
+  entries.back().pageNo = pageNo;
+  entries.back().data.swap(entry.data);
+  index[std::make_pair(file, pageNo)] = --entries.end();
+}
+
+bool VictimCache::take(const File* file, const PageId pageNo, Page& page)
+{
+  EntryMap::iterator it = index.find(std::make_pair(file, pageNo));
+  if (it == index.end())
+  {
+    stats.misses++;
+    return false;
+  }
+
+  const std::string& data = it->second->data;
+  bool ok = PageCodec::decompress(data.data(), data.size(), reinterpret_cast<char*>(&page), Page::SIZE);
+  erase(it);
+
+  if (!ok)
+  {
+    stats.misses++;
+    return false;
+  }
+  stats.hits++;
+  return true;
+}
+
+void VictimCache::drop(const File* file, const PageId pageNo)
+{
+  EntryMap::iterator it = index.find(std::make_pair(file, pageNo));
+  if (it != index.end())
+    erase(it);
+}
+
+void VictimCache::dropFile(const File* file)
+{
+  EntryMap::iterator it = index.lower_bound(std::make_pair(file, (PageId) 0));
+  while (it != index.end() && it->first.first == file)
+    erase(it++);
+}
+
+}
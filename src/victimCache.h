@@ -0,0 +1,161 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief Statistics of the victim cache
+*/
+struct VictimCacheStats
+{
+	/**
+   * Number of misses of the buffer pool served from the victim cache
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Number of misses of the buffer pool that had to go to disk
+	 */
+  std::uint64_t misses;
+
+	/**
+   * Number of pages stored
+	 */
+  std::uint64_t insertions;
+
+	/**
+   * Number of pages dropped to stay within the memory budget
+	 */
+  std::uint64_t evictions;
+
+	/**
+   * Number of pages not stored because they did not compress
+	 */
+  std::uint64_t rejections;
+
+	/**
+   * Bytes of compressed pages currently held
+	 */
+  std::size_t bytesUsed;
+
+	/**
+   * Constructor of VictimCacheStats class 
+	 */
+  VictimCacheStats()
+		: hits(0), misses(0), insertions(0), evictions(0), rejections(0), bytesUsed(0)
+  {
+  }
+};
+
+
+/**
+* @brief Second tier below the buffer pool: keeps pages evicted from the pool compressed in memory, so
+* that reading them again costs a decompression instead of a disk read. Pages are dropped least recently
+* stored first once the memory budget is used up. A page leaves the cache when it is taken back into the
+* pool, so the cache never holds a copy of a resident page.
+* The cache is not latched on its own; the buffer manager owning it serializes the calls.
+*/
+class VictimCache
+{
+ private:
+	/**
+	 * A compressed page
+	 */
+  struct Entry
+  {
+    const File* file;
+    PageId pageNo;
+    std::string data;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef std::map<std::pair<const File*, PageId>, EntryList::iterator> EntryMap;
+
+	/**
+   * Entries, least recently stored first
+	 */
+  EntryList entries;
+
+	/**
+   * Entries keyed by file and page number
+	 */
+  EntryMap index;
+
+	/**
+   * Most bytes of compressed pages held
+	 */
+  std::size_t budget;
+
+	/**
+   * Usage statistics
+	 */
+  VictimCacheStats stats;
+
+	/**
+   * Drops the given entry
+	 */
+  void erase(EntryMap::iterator it);
+
+ public:
+	/**
+   * Constructor of VictimCache class
+	 *
+	 * @param budgetBytes	Most bytes of compressed pages to hold
+	 */
+  explicit VictimCache(const std::size_t budgetBytes);
+
+	/**
+	 * Stores a page evicted from the buffer pool. The page must be clean, i.e. equal to its copy on disk.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page   	Contents of the page
+	 */
+  void put(const File* file, const PageId pageNo, const Page& page);
+
+	/**
+	 * Takes a page out of the cache.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page   	The page is decompressed into this object if it is in the cache
+	 * @return true if the page was in the cache
+	 */
+  bool take(const File* file, const PageId pageNo, Page& page);
+
+	/**
+	 * Drops a page, e.g. because it has been deleted from the file.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void drop(const File* file, const PageId pageNo);
+
+	/**
+	 * Drops all pages of a file, e.g. because the file object is about to go away.
+	 *
+	 * @param file   	File object
+	 */
+  void dropFile(const File* file);
+
+	/**
+   * Get the usage statistics
+	 */
+  const VictimCacheStats& getStats() const
+  {
+		return stats;
+  }
+};
+
+}